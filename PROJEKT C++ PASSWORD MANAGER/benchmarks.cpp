@@ -0,0 +1,2380 @@
+/**
+ * \file benchmarks.cpp
+ * \brief The synthetic-vault generator, the benchmarks and the stress, crash and self tests.
+ *
+ * Built into its own executable, so the password manager itself carries none of these modes:
+ *
+ *     g++ -std=c++17 -O2 -pthread -o pm-bench benchmarks.cpp
+ */
+
+#include "password_manager.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+
+
+/**
+ * \brief Writes a synthetic vault file used by the benchmarks.
+ *
+ * The records are generated deterministically from their index, encrypted with encryptData() and written
+ * with PasswordData::toString(), so the file looks exactly like a vault created through the menu.
+ *
+ * \param fileName The file to (over)write.
+ * \param count The number of password sets to generate.
+ */
+void writeSyntheticVault(const std::string& fileName, std::size_t count) {
+
+    static const char* const categories[] = {"work", "private", "bank", "social", "shopping", "games", "mail", "other"};
+
+    std::ofstream file(fileName, std::ios::trunc);
+    for (std::size_t i = 0; i < count; i++) {
+        std::string id = std::to_string(i);
+
+        PasswordData data;
+        data.name = PasswordManager::encryptData("account" + id);
+        data.password = PasswordManager::encryptData("p4ss!" + id + "word");
+        data.category = PasswordManager::encryptData(categories[i % 8]);
+        data.website = PasswordManager::encryptData("www.site" + id + ".com");
+        data.login = PasswordManager::encryptData("user" + id);
+
+        file << data.toString();
+    }
+}
+
+
+/**
+ * \brief The getline based loader that PasswordManager::loadToVector() used before it mapped the file.
+ *
+ * Kept only as the baseline for benchmarkLoad().
+ */
+std::vector<PasswordData> loadWithGetline(const std::string& fileName) {
+
+    std::ifstream file(fileName);
+    std::string line;
+    std::vector<PasswordData> loadedPasswords;
+
+    while (std::getline(file, line)) {
+
+        if (line.empty()) {
+            continue;
+        }
+
+        PasswordData data;
+
+        data.name = line;
+        std::getline(file, data.password);
+        std::getline(file, data.category);
+        std::getline(file, data.website);
+        std::getline(file, data.login);
+
+        loadedPasswords.push_back(data);
+    }
+
+    return loadedPasswords;
+}
+
+
+/**
+ * \brief Measures a single vault load in a child process.
+ *
+ * Every measurement runs in a freshly forked process so the peak resident set size reported by wait4()
+ * belongs to that load alone. Where the platform allows it, the vault pages are dropped from the page
+ * cache first, so the time is as close to a cold start as an unprivileged process can get.
+ *
+ * \param fileName The vault to load.
+ * \param variant 0 = nothing (process baseline), 1 = getline loader, 2 = mmap index only, 3 = loadRecords() through PasswordManager.
+ * \param milliseconds Receives the load time.
+ * \param peakKilobytes Receives the peak resident set size of the child.
+ * \return The number of records the variant loaded.
+ */
+std::size_t measureLoad(const std::string& fileName, int variant, double& milliseconds, long& peakKilobytes) {
+
+    int channel[2];
+    if (::pipe(channel) != 0) {
+        return 0;
+    }
+
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        ::close(channel[0]);
+
+#ifdef POSIX_FADV_DONTNEED
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+#endif
+
+        auto start = std::chrono::steady_clock::now();
+        std::size_t loaded = 0;
+
+        if (variant == 1) {
+            loaded = loadWithGetline(fileName).size();
+        } else if (variant == 2) {
+            MappedFile file(fileName);
+            std::vector<RecordView> records = indexRecords(file.view());
+            loaded = records.size();
+        } else if (variant == 3) {
+            PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+            loaded = manager.passwordCount();
+        }
+
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ::write(channel[1], &elapsed, sizeof(elapsed));
+        ::write(channel[1], &loaded, sizeof(loaded));
+        ::_exit(0);
+    }
+
+    ::close(channel[1]);
+
+    std::size_t loaded = 0;
+    milliseconds = 0;
+    ::read(channel[0], &milliseconds, sizeof(milliseconds));
+    ::read(channel[0], &loaded, sizeof(loaded));
+    ::close(channel[0]);
+
+    int status = 0;
+    struct rusage usage{};
+    ::wait4(pid, &status, 0, &usage);
+
+#ifdef __APPLE__
+    peakKilobytes = usage.ru_maxrss / 1024;
+#else
+    peakKilobytes = usage.ru_maxrss;
+#endif
+
+    return loaded;
+}
+
+
+/**
+ * \brief Compares the start-up cost of the vault loaders.
+ *
+ * Generates a synthetic vault and prints the load time and peak memory of the old getline loader, the
+ * bare mmap index and the current loadRecords().
+ *
+ * \param count The number of password sets in the synthetic vault.
+ */
+void benchmarkLoad(std::size_t count) {
+
+    const std::string fileName = "bench_vault.txt";
+    writeSyntheticVault(fileName, count);
+
+    static const char* const names[] = {"process baseline", "getline loader", "mmap index", "loadRecords"};
+
+    std::cout << "records: " << count << "\n";
+    for (int variant = 0; variant < 4; variant++) {
+        double milliseconds = 0;
+        long peakKilobytes = 0;
+        std::size_t loaded = measureLoad(fileName, variant, milliseconds, peakKilobytes);
+
+        std::printf("%-18s %10.2f ms %10ld KB peak RSS %10zu records\n",
+                    names[variant], milliseconds, peakKilobytes, loaded);
+    }
+
+    std::remove(fileName.c_str());
+}
+
+
+/**
+ * \brief Compares name lookups through the name index with the old linear scan.
+ *
+ * For every vault size a synthetic vault is written and opened with PasswordManager, then random
+ * existing names are looked up with findByName() and with a scan that decrypts every name, the way
+ * searchPasswords() used to do it.
+ */
+void benchmarkLookup() {
+
+    const std::string fileName = "bench_vault.txt";
+    const std::size_t sizes[] = {1000, 100000, 1000000};
+
+    for (std::size_t count : sizes) {
+        writeSyntheticVault(fileName, count);
+
+        auto start = std::chrono::steady_clock::now();
+        PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+        double openMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::mt19937 random(42);
+        std::vector<std::string> queries;
+        for (int i = 0; i < 1000; i++) {
+            queries.push_back("account" + std::to_string(random() % count));
+        }
+
+        std::size_t hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (const auto& query : queries) {
+            hits += manager.findByName(query).size();
+        }
+        double indexNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+                         / queries.size();
+
+        // The scan is far slower, so it only gets a handful of queries on the big vaults.
+        std::size_t scanQueries = count >= 1000000 ? 5 : count >= 100000 ? 50 : queries.size();
+        std::vector<PasswordData> raw = manager.loadToVector();
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < scanQueries; i++) {
+            for (const auto& password : raw) {
+                if (PasswordManager::decryptData(password.name) == queries[i]) {
+                    hits++;
+                }
+            }
+        }
+        double scanNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+                        / scanQueries;
+
+        std::printf("%8zu records: open %9.2f ms, index lookup %10.0f ns, linear scan %14.0f ns (%zu hits)\n",
+                    count, openMs, indexNs, scanNs, hits);
+    }
+
+    std::remove(fileName.c_str());
+}
+
+
+/**
+ * \brief Writes a synthetic binary vault sealed with ChaCha20-Poly1305, used by the benchmarks.
+ *
+ * The records are the same as those of writeSyntheticVault(). Record nonces come from a counter rather
+ * than from makeNonce(), which only keeps them unique, but that is all a benchmark vault needs.
+ *
+ * \param fileName The file to (over)write.
+ * \param count The number of password sets to generate.
+ * \param masterPassword The master password of the vault; its key is derived with minimumKdfIterations.
+ */
+void writeSealedSyntheticVault(const std::string& fileName, std::size_t count, const std::string& masterPassword) {
+
+    static const char* const categories[] = {"work", "private", "bank", "social", "shopping", "games", "mail", "other"};
+
+    std::string vaultKey;
+    VaultHeader header = makeVaultHeader(masterPassword, minimumKdfIterations, vaultKey);
+    ChaCha20Poly1305Cipher cipher(vaultKey);
+
+    std::ofstream file(fileName, std::ios::trunc | std::ios::binary);
+    std::string buffer = encodeHeader(header);
+
+    for (std::size_t i = 0; i < count; i++) {
+        std::string id = std::to_string(i);
+
+        PasswordData data;
+        data.nonce.assign(cipher.nonceSize(), '\0');
+        std::memcpy(data.nonce.data() + 4, &i, sizeof(i));
+        data.name = cipher.seal("account" + id, data.nonce, Field::Name);
+        data.password = cipher.seal("p4ss!" + id + "word", data.nonce, Field::Password);
+        data.category = cipher.seal(categories[i % 8], data.nonce, Field::Category);
+        data.website = cipher.seal("www.site" + id + ".com", data.nonce, Field::Website);
+        data.login = cipher.seal("user" + id, data.nonce, Field::Login);
+
+        encodeBinaryRecord(buffer, viewOf(data));
+        if (buffer.size() >= (1 << 20)) {
+            file << buffer;
+            buffer.clear();
+        }
+    }
+    file << buffer;
+}
+
+
+/**
+ * \brief Shows how opening a vault scales with the number of threads.
+ *
+ * A text vault and a sealed binary vault of the same password sets are generated, and each is opened with
+ * PasswordManager on 1, 2, 4, ... threads up to the given maximum. The time covers everything the
+ * constructor does: key derivation, both loader passes and the index rebuild.
+ *
+ * \param count The number of password sets per vault.
+ * \param maxThreads The largest thread count to try; 0 means one per core.
+ */
+void benchmarkThreads(std::size_t count, std::size_t maxThreads) {
+
+    if (maxThreads == 0) {
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<std::size_t> threadCounts;
+    for (std::size_t threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    const std::string textFile = "bench_vault.txt";
+    const std::string sealedFile = "bench_vault.pmv";
+    writeSyntheticVault(textFile, count);
+    writeSealedSyntheticVault(sealedFile, count, mainPassword);
+
+    std::printf("records: %zu, cores: %u\n", count, std::thread::hardware_concurrency());
+    for (const auto& vault : {std::make_pair("text/shift", textFile), std::make_pair("binary/aead", sealedFile)}) {
+        double single = 0;
+        for (std::size_t threads : threadCounts) {
+            auto start = std::chrono::steady_clock::now();
+            PasswordManager manager(vault.second, mainPassword, threads, IndexSidecar::Ignore);
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (threads == 1) {
+                single = elapsed;
+            }
+            std::printf("%-12s %3zu threads %10.1f ms  speedup %5.2fx  (%zu records)\n",
+                        vault.first, threads, elapsed, single / elapsed, manager.passwordCount());
+        }
+    }
+
+    std::remove(textFile.c_str());
+    std::remove(sealedFile.c_str());
+}
+
+
+/**
+ * \brief Times substring and prefix queries through the trigram index.
+ *
+ * A synthetic vault is opened and queries of very different selectivity are run against it, from one
+ * matching record to tens of thousands, each averaged over many runs.
+ *
+ * \param count The number of password sets in the synthetic vault.
+ */
+void benchmarkSearch(std::size_t count) {
+
+    const std::string fileName = "bench_vault.txt";
+    writeSyntheticVault(fileName, count);
+
+    auto start = std::chrono::steady_clock::now();
+    PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+    manager.prepareTextSearch();
+    double openMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::printf("records: %zu, open and index %.1f ms\n", count, openMs);
+
+    std::string last = std::to_string(count / 2 + 7);
+    const std::pair<std::string, bool> queries[] = {
+        {"site" + last + ".", false}, {"user" + last, true}, {last, false},
+        {"1234", false}, {"account99", true}, {"USER4", true}, {"77", false}};
+
+    for (const auto& query : queries) {
+        std::size_t hits = 0;
+        int runs = 0;
+        start = std::chrono::steady_clock::now();
+        do {
+            hits = manager.findContaining(query.first, query.second).size();
+            runs++;
+        } while (runs < 1000 && std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+        double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()
+                              / runs;
+
+        std::printf("%-9s %-16s %12.1f us %10zu hits\n", query.second ? "prefix" : "contains", query.first.c_str(),
+                    microseconds, hits);
+    }
+
+    std::remove(fileName.c_str());
+}
+
+
+/**
+ * \brief Compares fuzzy name lookups through the BK-tree with a scan over every name.
+ *
+ * The synthetic vault gets random pronounceable names, since the account<n> names of
+ * writeSyntheticVault() are all within a few edits of each other and would make any fuzzy index
+ * degenerate. Every query is an existing name with one or two random typos. Both ways have to return
+ * the same ranked results.
+ *
+ * \param count The number of password sets in the synthetic vault.
+ */
+void benchmarkFuzzy(std::size_t count) {
+
+    const std::string fileName = "bench_vault.txt";
+    std::mt19937 random(7);
+    std::vector<std::string> names;
+
+    {
+        static const char consonants[] = "bcdfghjklmnprstvwz";
+        static const char vowels[] = "aeiou";
+        std::ofstream file(fileName, std::ios::trunc);
+        for (std::size_t i = 0; i < count; i++) {
+            std::string name;
+            for (std::size_t syllables = 2 + random() % 4; syllables > 0; syllables--) {
+                name += consonants[random() % 18];
+                name += vowels[random() % 5];
+            }
+            names.push_back(name);
+
+            PasswordData data;
+            data.name = PasswordManager::encryptData(name);
+            data.password = PasswordManager::encryptData("p4ss" + std::to_string(i));
+            data.category = PasswordManager::encryptData("other");
+            data.website = PasswordManager::encryptData("www." + name + ".com");
+            data.login = PasswordManager::encryptData("user" + std::to_string(i));
+            file << data.toString();
+        }
+    }
+
+    PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+
+    std::vector<std::string> queries;
+    for (int i = 0; i < 200; i++) {
+        std::string query = names[random() % count];
+        for (std::size_t typos = 1 + random() % 2; typos > 0; typos--) {
+            std::size_t at = random() % query.size();
+            switch (random() % 3) {
+                case 0: query[at] = static_cast<char>('a' + random() % 26); break;
+                case 1: query.erase(at, 1); break;
+                default: query.insert(at, 1, static_cast<char>('a' + random() % 26)); break;
+            }
+        }
+        queries.push_back(query);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    manager.findClosest(queries[0], maxTypos, 5);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<std::vector<BkTree::Match>> fromTree;
+    start = std::chrono::steady_clock::now();
+    for (const auto& query : queries) {
+        fromTree.push_back(manager.findClosest(query, maxTypos, 5));
+    }
+    double treeUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()
+                    / queries.size();
+
+    // The same ranking as BkTree::closest(): (distance, name, id), all records of the best 5 names.
+    std::size_t scanQueries = std::min<std::size_t>(queries.size(), count >= 1000000 ? 10 : 50);
+    std::size_t mismatches = 0;
+    start = std::chrono::steady_clock::now();
+    for (std::size_t q = 0; q < scanQueries; q++) {
+        EditDistance distanceFromQuery(queries[q]);
+        std::vector<std::tuple<std::size_t, const std::string*, RecordStore::Id>> within;
+        for (RecordStore::Id id = 0; id < names.size(); id++) {
+            std::size_t distance = distanceFromQuery.to(names[id]);
+            if (distance <= maxTypos) {
+                within.emplace_back(distance, &names[id], id);
+            }
+        }
+        std::sort(within.begin(), within.end(), [](const auto& x, const auto& y) {
+            return std::get<0>(x) != std::get<0>(y) ? std::get<0>(x) < std::get<0>(y)
+                 : *std::get<1>(x) != *std::get<1>(y) ? *std::get<1>(x) < *std::get<1>(y) : std::get<2>(x) < std::get<2>(y);
+        });
+        std::vector<BkTree::Match> expected;
+        std::size_t distinct = 0;
+        for (std::size_t i = 0; i < within.size(); i++) {
+            if (i == 0 || *std::get<1>(within[i]) != *std::get<1>(within[i - 1])) {
+                if (++distinct > 5) {
+                    break;
+                }
+            }
+            expected.push_back({std::get<0>(within[i]), std::get<2>(within[i])});
+        }
+        bool same = expected.size() == fromTree[q].size();
+        for (std::size_t i = 0; same && i < expected.size(); i++) {
+            same = expected[i].distance == fromTree[q][i].distance && expected[i].id == fromTree[q][i].id;
+        }
+        mismatches += same ? 0 : 1;
+    }
+    double scanUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()
+                    / scanQueries;
+
+    std::printf("%zu records: tree build %.1f ms, bk-tree %.1f us/query, brute force %.1f us/query, %zu/%zu mismatches\n",
+                count, buildMs, treeUs, scanUs, mismatches, scanQueries);
+
+    std::remove(fileName.c_str());
+}
+
+
+/**
+ * \brief The number of heap bytes currently handed out by malloc, or 0 where the C library can't tell.
+ */
+std::size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    // Large blocks are mapped separately and only show up in hblkhd.
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * \brief Compares the memory taken by the record store with one PasswordData per password set.
+ *
+ * A synthetic vault is sealed with ChaCha20-Poly1305 and opened. Its password sets are then loaded once
+ * more as a std::vector<PasswordData>, the way PasswordManager used to keep them, and once more into a
+ * RecordStore. For each, the heap growth measured by malloc is reported per record where the C library
+ * can tell it, next to the count from the structure itself: the capacities of the vector and of the
+ * strings that don't fit the small string buffer for the vector, and RecordStore::memoryBytes() for the store.
+ *
+ * \param count The number of password sets in the synthetic vault.
+ */
+void benchmarkMemory(std::size_t count) {
+
+    const std::string fileName = "bench_vault.pmv";
+    writeSealedSyntheticVault(fileName, count, mainPassword);
+
+    {
+        PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+
+        std::size_t before = heapInUse();
+        std::vector<PasswordData> vector = manager.loadToVector();
+        std::size_t vectorHeap = heapInUse() - before;
+
+        std::size_t vectorBytes = vector.capacity() * sizeof(PasswordData);
+        for (const auto& data : vector) {
+            for (const std::string* field : {&data.name, &data.password, &data.category, &data.website,
+                                             &data.login, &data.nonce}) {
+                vectorBytes += field->capacity() > 15 ? field->capacity() + 1 : 0;
+            }
+        }
+        std::vector<PasswordData>().swap(vector);
+
+        before = heapInUse();
+        RecordStore store = manager.loadRecords();
+        std::size_t storeHeap = heapInUse() - before;
+        std::size_t storeBytes = store.memoryBytes();
+
+        auto perRecord = [count](std::size_t bytes) {
+            return static_cast<double>(bytes) / static_cast<double>(count);
+        };
+        std::printf("%zu records, %zu distinct categories\n", count, store.categoryCount());
+        std::printf("%-28s %8.1f bytes/record counted, %8.1f measured\n", "std::vector<PasswordData>",
+                    perRecord(vectorBytes), perRecord(vectorHeap));
+        std::printf("%-28s %8.1f bytes/record counted, %8.1f measured\n", "RecordStore",
+                    perRecord(storeBytes), perRecord(storeHeap));
+        if (storeHeap > 0) {
+            std::printf("reduction: %.1f%% (%.1f MB saved)\n", 100.0 - 100.0 * storeHeap / vectorHeap,
+                        (static_cast<double>(vectorHeap) - storeHeap) / (1 << 20));
+        }
+    }
+
+    std::remove(fileName.c_str());
+}
+
+
+/**
+ * \brief Compares scans over one field in the old record layout and in the columns of RecordStore.
+ *
+ * A synthetic text vault is loaded both as a std::vector<PasswordData>, where a scan strides over whole
+ * records, and as a RecordStore, where it walks one column. Its shift cipher seals equal plaintexts to
+ * equal bytes, so both scans compare sealed bytes and decrypt nothing:
+ *
+ * - an exact name match, which the store answers from the length column first;
+ * - a category filter, which the store answers from the column of category ids.
+ *
+ * \param count The number of password sets in the synthetic vault.
+ */
+void benchmarkScan(std::size_t count) {
+
+    const std::string fileName = "bench_vault.txt";
+    writeSyntheticVault(fileName, count);
+
+    {
+        PasswordManager manager(fileName, mainPassword, 1, IndexSidecar::Ignore);
+        std::vector<PasswordData> records = manager.loadToVector();
+        RecordStore store = manager.loadRecords();
+
+        std::mt19937 random(42);
+        std::vector<std::string> names;
+        for (int i = 0; i < 20; i++) {
+            names.push_back(PasswordManager::encryptData("account" + std::to_string(random() % count)));
+        }
+        static const char* const categories[] = {"work", "bank", "mail", "other"};
+
+        auto time = [](const char* label, std::size_t queries, const auto& scan) {
+            std::size_t hits = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < queries; i++) {
+                hits += scan(i);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::printf("%-32s %10.3f ms/scan %10zu hits\n", label, ms / queries, hits);
+        };
+
+        std::printf("%zu records\n", count);
+        time("name, AoS", names.size(), [&](std::size_t i) {
+            std::size_t hits = 0;
+            for (const auto& data : records) {
+                hits += data.name == names[i];
+            }
+            return hits;
+        });
+        time("name, SoA length column", names.size(), [&](std::size_t i) {
+            return store.scanSealed(Field::Name, names[i]).size();
+        });
+        time("category, AoS", 4, [&](std::size_t i) {
+            std::string sealed = PasswordManager::encryptData(categories[i]);
+            std::vector<std::size_t> ids;
+            for (std::size_t id = 0; id < records.size(); id++) {
+                if (records[id].category == sealed) {
+                    ids.push_back(id);
+                }
+            }
+            return ids.size();
+        });
+        time("category, SoA id column", 4, [&](std::size_t i) {
+            return store.scanCategory(categories[i]).size();
+        });
+    }
+
+    std::remove(fileName.c_str());
+}
+
+
+/**
+ * \struct SyntheticSpec
+ * \brief Describes a synthetic vault for writeGeneratedVault() and the benchmark suite.
+ *
+ * The length of every field is drawn uniformly from its range, and every password set falls into one
+ * of `categories` categories with equal probability. A password set depends only on the seed and its
+ * index, see syntheticRecord(), so the same spec always yields the same vault.
+ */
+struct SyntheticSpec {
+
+    struct Range {
+        std::size_t min;
+        std::size_t max;
+    };
+
+    std::size_t count = 100000;
+    std::uint64_t seed = 1;
+    std::size_t categories = 8;
+    VaultFormat format = VaultFormat::Text;
+
+    Range name{6, 20};
+    Range password{10, 24};
+    Range website{12, 32};
+    Range login{4, 16};
+};
+
+
+/**
+ * \brief Generates one password set of a synthetic vault, in plaintext.
+ *
+ * The random numbers come from splitmix64 seeded with the spec's seed and the index, rather than from
+ * a <random> distribution, whose output differs between standard libraries. Names, websites and logins
+ * are made of lower case letters and digits, passwords of any printable character but the space, and
+ * the categories are called category0, category1 and so on.
+ *
+ * \param spec The vault the password set belongs to.
+ * \param index The position of the password set in the vault.
+ */
+PasswordData syntheticRecord(const SyntheticSpec& spec, std::size_t index) {
+
+    static const std::string alphanumeric = "abcdefghijklmnopqrstuvwxyz0123456789";
+    static const std::string printable = [] {
+        std::string characters;
+        for (char c = '!'; c <= '~'; c++) {
+            characters += c;
+        }
+        return characters;
+    }();
+
+    std::uint64_t state = spec.seed ^ (index * 0xD1B54A32D192ED03ull);
+    auto next = [&state]() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    };
+    auto length = [&next](SyntheticSpec::Range range) {
+        return range.min + next() % (range.max - range.min + 1);
+    };
+    auto text = [&next](std::size_t size, const std::string& alphabet) {
+        std::string result(size, ' ');
+        for (char& c : result) {
+            c = alphabet[next() % alphabet.size()];
+        }
+        return result;
+    };
+
+    PasswordData data;
+    data.name = text(length(spec.name), alphanumeric);
+    data.password = text(length(spec.password), printable);
+    data.category = "category" + std::to_string(next() % spec.categories);
+
+    std::size_t websiteLength = length(spec.website);
+    data.website = websiteLength > 8 ? "www." + text(websiteLength - 8, alphanumeric) + ".com"
+                                     : text(websiteLength, alphanumeric);
+    data.login = text(length(spec.login), alphanumeric);
+    return data;
+}
+
+
+/**
+ * \brief Writes the synthetic vault a spec describes.
+ *
+ * A text vault is written with encryptData() and PasswordData::toString(), exactly like a vault created
+ * through the menu. A binary vault is sealed with ChaCha20-Poly1305 under mainPassword, with its key
+ * derived with minimumKdfIterations and the record index as nonce, like writeSealedSyntheticVault().
+ *
+ * \param fileName The file to (over)write.
+ * \param spec The vault to generate.
+ * \return False if the file could not be written.
+ */
+bool writeGeneratedVault(const std::string& fileName, const SyntheticSpec& spec) {
+
+    std::unique_ptr<ChaCha20Poly1305Cipher> cipher;
+    std::string buffer;
+    if (spec.format == VaultFormat::Binary) {
+        std::string vaultKey;
+        VaultHeader header = makeVaultHeader(mainPassword, minimumKdfIterations, vaultKey);
+        cipher = std::make_unique<ChaCha20Poly1305Cipher>(vaultKey);
+        buffer = encodeHeader(header);
+    }
+
+    std::ofstream file(fileName, std::ios::trunc | std::ios::binary);
+    for (std::size_t i = 0; i < spec.count; i++) {
+        PasswordData data = syntheticRecord(spec, i);
+
+        if (cipher == nullptr) {
+            PasswordManager::encryptInPlace(data.name);
+            PasswordManager::encryptInPlace(data.password);
+            PasswordManager::encryptInPlace(data.category);
+            PasswordManager::encryptInPlace(data.website);
+            PasswordManager::encryptInPlace(data.login);
+            buffer += data.toString();
+        } else {
+            data.nonce.assign(cipher->nonceSize(), '\0');
+            std::memcpy(data.nonce.data() + 4, &i, sizeof(i));
+            data.name = cipher->seal(data.name, data.nonce, Field::Name);
+            data.password = cipher->seal(data.password, data.nonce, Field::Password);
+            data.category = cipher->seal(data.category, data.nonce, Field::Category);
+            data.website = cipher->seal(data.website, data.nonce, Field::Website);
+            data.login = cipher->seal(data.login, data.nonce, Field::Login);
+            encodeBinaryRecord(buffer, viewOf(data));
+        }
+
+        if (buffer.size() >= (1 << 20)) {
+            file << buffer;
+            buffer.clear();
+        }
+    }
+    file << buffer;
+    file.close();
+    return !file.fail();
+}
+
+
+/**
+ * \struct SuiteOptions
+ * \brief Everything the benchmark suite and the vault generator can be told on the command line.
+ */
+struct SuiteOptions {
+    SyntheticSpec spec;
+
+    /// Threads PasswordManager loads on; 0 means one per core.
+    std::size_t threads = 0;
+
+    /// Queries per run of the search benchmark.
+    std::size_t reads = 10000;
+
+    /// Adds and deletes per run of the add and delete benchmarks.
+    std::size_t writes = 200;
+
+    /// Runs per benchmark; the median run is reported next to the fastest and the slowest.
+    std::size_t repeat = 5;
+
+    /// table, json or csv.
+    std::string format = "table";
+
+    /// Where the results go; empty means standard output.
+    std::string output;
+
+    /// The flush policy the add and delete benchmarks run under.
+    FlushPolicy flush;
+};
+
+
+/**
+ * \brief Parses one --key=value option of --bench-suite and --generate.
+ *
+ * The field lengths are given as min:max, e.g. --name=4:12.
+ *
+ * \return False if the option is unknown or its value is invalid; the options are left unchanged then.
+ */
+bool parseSuiteOption(const std::string& argument, SuiteOptions& options) {
+
+    std::size_t equals = argument.find('=');
+    if (argument.compare(0, 2, "--") != 0 || equals == std::string::npos) {
+        return false;
+    }
+    std::string key = argument.substr(2, equals - 2);
+    std::string value = argument.substr(equals + 1);
+
+    auto number = [](const std::string& text, std::uint64_t& result) {
+        char* end = nullptr;
+        errno = 0;
+        result = std::strtoull(text.c_str(), &end, 10);
+        return !text.empty() && std::isdigit(static_cast<unsigned char>(text[0])) && *end == '\0' && errno == 0;
+    };
+    auto count = [&number](const std::string& text, std::size_t& result, std::size_t least) {
+        std::uint64_t parsed = 0;
+        if (!number(text, parsed) || parsed < least) {
+            return false;
+        }
+        result = static_cast<std::size_t>(parsed);
+        return true;
+    };
+    auto range = [&count](const std::string& text, SyntheticSpec::Range& result) {
+        std::size_t colon = text.find(':');
+        SyntheticSpec::Range parsed{0, 0};
+        if (colon == std::string::npos || !count(text.substr(0, colon), parsed.min, 1)
+            || !count(text.substr(colon + 1), parsed.max, parsed.min)) {
+            return false;
+        }
+        result = parsed;
+        return true;
+    };
+
+    SyntheticSpec& spec = options.spec;
+    if (key == "count") {
+        return count(value, spec.count, 1);
+    } else if (key == "seed") {
+        return number(value, spec.seed);
+    } else if (key == "categories") {
+        return count(value, spec.categories, 1);
+    } else if (key == "name") {
+        return range(value, spec.name);
+    } else if (key == "password") {
+        return range(value, spec.password);
+    } else if (key == "website") {
+        return range(value, spec.website);
+    } else if (key == "login") {
+        return range(value, spec.login);
+    } else if (key == "vault" && (value == "text" || value == "binary")) {
+        spec.format = value == "text" ? VaultFormat::Text : VaultFormat::Binary;
+        return true;
+    } else if (key == "threads") {
+        return count(value, options.threads, 0);
+    } else if (key == "reads") {
+        return count(value, options.reads, 1);
+    } else if (key == "writes") {
+        return count(value, options.writes, 1);
+    } else if (key == "repeat") {
+        return count(value, options.repeat, 1);
+    } else if (key == "format" && (value == "table" || value == "json" || value == "csv")) {
+        options.format = value;
+        return true;
+    } else if (key == "out") {
+        options.output = value;
+        return true;
+    } else if (key == "flush") {
+        return parseFlushPolicy(value, options.flush);
+    }
+    return false;
+}
+
+
+/**
+ * \struct SuiteResult
+ * \brief The timings of one benchmark of the suite.
+ */
+struct SuiteResult {
+    std::string benchmark;
+
+    /// Units of work per run: records for generate, load and sort, queries for search and category,
+    /// password sets for add and delete.
+    std::size_t operations = 0;
+
+    /// What the last run found, loaded or changed, so a result that looks too good can be told apart
+    /// from one that did nothing.
+    std::size_t items = 0;
+
+    /// Wall time of every run in milliseconds, sorted.
+    std::vector<double> runs;
+
+    double median() const {
+        return runs[runs.size() / 2];
+    }
+};
+
+
+/**
+ * \brief Writes the results of the benchmark suite as a table, as JSON or as CSV.
+ *
+ * JSON holds one object with the configuration and an array of results; CSV has one row per benchmark,
+ * each repeating the configuration, so rows from different runs can simply be appended to one file.
+ * Both carry the time the suite ran as a Unix timestamp.
+ */
+void writeSuiteResults(std::FILE* out, const SuiteOptions& options, const std::vector<SuiteResult>& results) {
+
+    const SyntheticSpec& spec = options.spec;
+    const char* vault = spec.format == VaultFormat::Text ? "text" : "binary";
+    long long timestamp = static_cast<long long>(std::time(nullptr));
+
+    auto perOperation = [](const SuiteResult& result) {
+        return result.median() * 1000 / result.operations;
+    };
+    auto perSecond = [](const SuiteResult& result) {
+        return result.operations / (result.median() / 1000);
+    };
+
+    if (options.format == "json") {
+        std::fprintf(out, "{\n  \"timestamp\": %lld,\n  \"config\": {\"records\": %zu, \"seed\": %llu, "
+                          "\"categories\": %zu, \"vault\": \"%s\", \"threads\": %zu, \"repeat\": %zu, "
+                          "\"name\": [%zu, %zu], \"password\": [%zu, %zu], \"website\": [%zu, %zu], "
+                          "\"login\": [%zu, %zu]},\n  \"results\": [\n",
+                     timestamp, spec.count, static_cast<unsigned long long>(spec.seed), spec.categories, vault,
+                     options.threads, options.repeat, spec.name.min, spec.name.max, spec.password.min,
+                     spec.password.max, spec.website.min, spec.website.max, spec.login.min, spec.login.max);
+        for (std::size_t i = 0; i < results.size(); i++) {
+            const SuiteResult& result = results[i];
+            std::fprintf(out, "    {\"benchmark\": \"%s\", \"operations\": %zu, \"items\": %zu, \"median_ms\": %.3f, "
+                              "\"min_ms\": %.3f, \"max_ms\": %.3f, \"us_per_op\": %.4f, \"ops_per_sec\": %.1f}%s\n",
+                         result.benchmark.c_str(), result.operations, result.items, result.median(),
+                         result.runs.front(), result.runs.back(), perOperation(result), perSecond(result),
+                         i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+    } else if (options.format == "csv") {
+        std::fprintf(out, "timestamp,records,seed,categories,vault,threads,benchmark,operations,items,"
+                          "median_ms,min_ms,max_ms,us_per_op,ops_per_sec\n");
+        for (const SuiteResult& result : results) {
+            std::fprintf(out, "%lld,%zu,%llu,%zu,%s,%zu,%s,%zu,%zu,%.3f,%.3f,%.3f,%.4f,%.1f\n", timestamp,
+                         spec.count, static_cast<unsigned long long>(spec.seed), spec.categories, vault,
+                         options.threads, result.benchmark.c_str(), result.operations, result.items,
+                         result.median(), result.runs.front(), result.runs.back(), perOperation(result),
+                         perSecond(result));
+        }
+    } else {
+        std::fprintf(out, "records: %zu, categories: %zu, seed: %llu, vault: %s, runs: %zu\n", spec.count,
+                     spec.categories, static_cast<unsigned long long>(spec.seed), vault, options.repeat);
+        std::fprintf(out, "%-10s %10s %12s %12s %12s %12s %14s %10s\n", "benchmark", "ops", "median ms",
+                     "min ms", "max ms", "us/op", "ops/s", "items");
+        for (const SuiteResult& result : results) {
+            std::fprintf(out, "%-10s %10zu %12.3f %12.3f %12.3f %12.4f %14.1f %10zu\n", result.benchmark.c_str(),
+                         result.operations, result.median(), result.runs.front(), result.runs.back(),
+                         perOperation(result), perSecond(result), result.items);
+        }
+    }
+}
+
+
+/**
+ * \brief Runs the benchmark suite on a generated vault and writes machine-readable results.
+ *
+ * Every benchmark runs options.repeat times:
+ *
+ * - generate: writing the synthetic vault (run once only);
+ * - load: opening the vault with PasswordManager, loader and index rebuild included, with the file in
+ *   the page cache;
+ * - search: exact name lookups of random existing names;
+ * - category: listing the ids of every category once;
+ * - sort: walking all password sets in alphabetic order, checking the order on the way;
+ * - add: adding new password sets one by one, under the chosen flush policy, flush included;
+ * - delete: deleting random existing names one by one, likewise.
+ *
+ * The queries are drawn from a generator seeded with the spec's seed, so two runs of the same options
+ * do the same work and their numbers can be compared.
+ *
+ * \return The exit code of the program.
+ */
+int runBenchmarkSuite(const SuiteOptions& options) {
+
+    const SyntheticSpec& spec = options.spec;
+    const std::string fileName = spec.format == VaultFormat::Text ? "bench_suite.txt" : "bench_suite.pmv";
+    std::vector<SuiteResult> results;
+
+    auto measure = [&results](const std::string& benchmark, std::size_t runs, const auto& run) {
+        SuiteResult result;
+        result.benchmark = benchmark;
+        for (std::size_t i = 0; i < runs; i++) {
+            auto start = std::chrono::steady_clock::now();
+            std::tie(result.operations, result.items) = run(i);
+            result.runs.push_back(
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(result.runs.begin(), result.runs.end());
+        results.push_back(result);
+    };
+
+    bool written = true;
+    measure("generate", 1, [&](std::size_t) {
+        written = writeGeneratedVault(fileName, spec);
+        return std::make_pair(spec.count, spec.count);
+    });
+    if (!written) {
+        std::cerr << "Can't write " << fileName << std::endl;
+        return 1;
+    }
+
+    measure("load", options.repeat, [&](std::size_t) {
+        PasswordManager manager(fileName, mainPassword, options.threads, IndexSidecar::Ignore);
+        return std::make_pair(spec.count, manager.passwordCount());
+    });
+
+    {
+        PasswordManager manager(fileName, mainPassword, options.threads, IndexSidecar::Ignore);
+        manager.setFlushPolicy(options.flush);
+        std::mt19937_64 random(spec.seed);
+
+        auto randomNames = [&](std::size_t count) {
+            std::vector<std::string> names;
+            for (std::size_t i = 0; i < count; i++) {
+                names.push_back(syntheticRecord(spec, random() % spec.count).name);
+            }
+            return names;
+        };
+
+        std::vector<std::vector<std::string>> queries;
+        for (std::size_t i = 0; i < options.repeat; i++) {
+            queries.push_back(randomNames(options.reads));
+        }
+        measure("search", options.repeat, [&](std::size_t run) {
+            std::size_t hits = 0;
+            for (const std::string& name : queries[run]) {
+                hits += manager.findByName(name).size();
+            }
+            return std::make_pair(options.reads, hits);
+        });
+
+        measure("category", options.repeat, [&](std::size_t) {
+            std::size_t members = 0;
+            for (std::size_t i = 0; i < spec.categories; i++) {
+                members += manager.findByCategory("category" + std::to_string(i)).size();
+            }
+            return std::make_pair(spec.categories, members);
+        });
+
+        measure("sort", options.repeat, [&](std::size_t) {
+            std::size_t visited = 0;
+            std::size_t ordered = 0;
+            const std::string* previous = nullptr;
+            manager.forEachAlphabetic([&](RecordStore::Id, const std::string& name) {
+                visited++;
+                ordered += previous == nullptr || *previous <= name;
+                previous = &name;
+            });
+            return std::make_pair(visited, ordered);
+        });
+
+        std::vector<std::vector<PasswordData>> additions(options.repeat);
+        for (std::size_t run = 0; run < options.repeat; run++) {
+            for (std::size_t i = 0; i < options.writes; i++) {
+                additions[run].push_back(syntheticRecord(spec, spec.count + run * options.writes + i));
+            }
+        }
+        measure("add", options.repeat, [&](std::size_t run) {
+            std::size_t added = 0;
+            for (const PasswordData& plain : additions[run]) {
+                added += manager.insertPassword(plain);
+            }
+            manager.flushWrites();
+            return std::make_pair(options.writes, added);
+        });
+
+        for (std::size_t i = 0; i < options.repeat; i++) {
+            queries[i] = randomNames(options.writes);
+        }
+        measure("delete", options.repeat, [&](std::size_t run) {
+            std::size_t deleted = 0;
+            for (const std::string& name : queries[run]) {
+                deleted += manager.removeByName(name);
+            }
+            manager.flushWrites();
+            return std::make_pair(options.writes, deleted);
+        });
+    }
+
+    std::remove(fileName.c_str());
+    std::remove(journal::fileOf(fileName).c_str());
+
+    std::FILE* out = options.output.empty() ? stdout : std::fopen(options.output.c_str(), "w");
+    if (out == nullptr) {
+        std::cerr << "Can't write " << options.output << std::endl;
+        return 1;
+    }
+    writeSuiteResults(out, options, results);
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return 0;
+}
+
+
+/**
+ * \brief Compares the shift kernels with the byte loop encryptData() and decryptData() used to run.
+ *
+ * Prints the throughput of every kernel the CPU supports on one large buffer, and of per-field and
+ * whole-column decryption on a million short fields, followed by the same numbers for ChaCha20-Poly1305.
+ */
+void benchmarkCipher() {
+
+    auto legacyDecrypt = [](const std::string& encryptedData) {
+        std::string decryptedData = encryptedData;
+        for (char& c : decryptedData) {
+            c -= shift;
+        }
+        return decryptedData;
+    };
+
+    auto megabytesPerSecond = [](std::size_t bytes, std::chrono::steady_clock::time_point start) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return bytes / seconds / 1e6;
+    };
+
+    const std::size_t bufferSize = 64 << 20;
+    std::string buffer(bufferSize, 'x');
+    std::string out(bufferSize, '\0');
+    volatile char sink = 0;
+
+    std::vector<std::pair<const char*, ShiftKernel>> kernels = {{"scalar", shiftBytesScalar}};
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.emplace_back("sse2", shiftBytesSse2);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.emplace_back("avx2", shiftBytesAvx2);
+    }
+#endif
+
+    auto start = std::chrono::steady_clock::now();
+    std::string legacy = legacyDecrypt(buffer);
+    std::printf("%-24s %10.0f MB/s\n", "byte loop (64 MB)", megabytesPerSecond(bufferSize, start));
+    sink = sink + legacy[bufferSize / 2];
+
+    for (const auto& kernel : kernels) {
+        start = std::chrono::steady_clock::now();
+        kernel.second(out.data(), buffer.data(), bufferSize, -shift);
+        std::printf("%-24s %10.0f MB/s\n", (std::string(kernel.first) + " kernel (64 MB)").c_str(),
+                    megabytesPerSecond(bufferSize, start));
+        sink = sink + out[bufferSize / 2];
+    }
+
+    std::vector<std::string> fields;
+    std::vector<std::string_view> views;
+    std::size_t fieldBytes = 0;
+    for (std::size_t i = 0; i < 1000000; i++) {
+        fields.push_back(PasswordManager::encryptData("account" + std::to_string(i)));
+        fieldBytes += fields.back().size();
+    }
+    for (const auto& field : fields) {
+        views.push_back(field);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (const auto& field : fields) {
+        sink = sink + legacyDecrypt(field)[0];
+    }
+    std::printf("%-24s %10.0f MB/s\n", "byte loop per field", megabytesPerSecond(fieldBytes, start));
+
+    start = std::chrono::steady_clock::now();
+    for (const auto& field : fields) {
+        sink = sink + PasswordManager::decryptData(field)[0];
+    }
+    std::printf("%-24s %10.0f MB/s\n", "decryptData per field", megabytesPerSecond(fieldBytes, start));
+
+    std::string column;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::string_view> noNonces(views.size());
+    start = std::chrono::steady_clock::now();
+    ShiftCipher().openColumn(views, noNonces, Field::Name, column, offsets);
+    std::printf("%-24s %10.0f MB/s\n", "shift openColumn", megabytesPerSecond(fieldBytes, start));
+    sink = sink + column[0];
+
+    // The same column sealed with ChaCha20-Poly1305, one nonce per record as in a vault.
+    ChaCha20Poly1305Cipher aead(Sha256::hash(mainPassword));
+    std::vector<std::string> sealed;
+    std::vector<std::string> nonces;
+    sealed.reserve(fields.size());
+    nonces.reserve(fields.size());
+    std::size_t sealedBytes = 0;
+
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < fields.size(); i++) {
+        nonces.push_back(aead.makeNonce());
+        sealed.push_back(aead.seal("account" + std::to_string(i), nonces.back(), Field::Name));
+        sealedBytes += sealed.back().size();
+    }
+    std::printf("%-24s %10.0f MB/s\n", "aead seal per field", megabytesPerSecond(fieldBytes, start));
+
+    std::vector<std::string_view> sealedViews(sealed.begin(), sealed.end());
+    std::vector<std::string_view> nonceViews(nonces.begin(), nonces.end());
+    start = std::chrono::steady_clock::now();
+    aead.openColumn(sealedViews, nonceViews, Field::Name, column, offsets);
+    std::printf("%-24s %10.0f MB/s (%zu sealed bytes)\n", "aead openColumn", megabytesPerSecond(fieldBytes, start),
+                sealedBytes);
+    sink = sink + column[0];
+
+    std::string bulkNonce = aead.makeNonce();
+    start = std::chrono::steady_clock::now();
+    std::string bulk = aead.seal(std::string_view(buffer).substr(0, 16 << 20), bulkNonce, Field::Name);
+    std::printf("%-24s %10.0f MB/s\n", "aead seal (16 MB)", megabytesPerSecond(16 << 20, start));
+    start = std::chrono::steady_clock::now();
+    long opened = aead.openInto(bulk, bulkNonce, Field::Name, out.data());
+    std::printf("%-24s %10.0f MB/s\n", "aead open (16 MB)", megabytesPerSecond(16 << 20, start));
+    sink = sink + static_cast<char>(opened);
+}
+
+
+/**
+ * \struct LoadTestOptions
+ * \brief What --load-test and --bench-daemon are told on the command line.
+ *
+ * The spec (and the other options of SuiteOptions, e.g. --threads) describes the vault the daemon
+ * serves, so the load generator can ask for names that exist.
+ */
+struct LoadTestOptions {
+    SuiteOptions suite;
+
+    /// Client connections, each on its own thread with one request in flight.
+    std::size_t clients = 4;
+
+    /// Requests per client.
+    std::size_t requests = 20000;
+
+    /// Share of requests, in percent, that add a password set or delete the one added before.
+    std::size_t writePercent = 0;
+
+    /// Worker threads of the daemon --bench-daemon starts; 0 means one per core.
+    std::size_t workers = 0;
+};
+
+
+/// \brief Parses one --key=value option of --load-test and --bench-daemon; see parseSuiteOption().
+bool parseLoadTestOption(const std::string& argument, LoadTestOptions& options) {
+
+    std::size_t equals = argument.find('=');
+    std::string key = equals == std::string::npos ? std::string() : argument.substr(0, equals);
+    std::size_t* target = key == "--clients" ? &options.clients
+                        : key == "--requests" ? &options.requests
+                        : key == "--writes" ? &options.writePercent
+                        : key == "--workers" ? &options.workers
+                        : nullptr;
+    if (target == nullptr) {
+        return parseSuiteOption(argument, options.suite);
+    }
+
+    std::string value = argument.substr(equals + 1);
+    char* end = nullptr;
+    unsigned long long parsed = std::strtoull(value.c_str(), &end, 10);
+    bool least = key == "--workers" || parsed >= 1;
+    if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])) || *end != '\0' || !least
+        || (key == "--writes" && parsed > 100)) {
+        return false;
+    }
+    *target = static_cast<std::size_t>(parsed);
+    return true;
+}
+
+
+/**
+ * \brief Drives a running daemon from several client connections and reports latency and throughput.
+ *
+ * Every client sends a request, waits for the whole answer and sends the next, and times each round
+ * trip. Reads are exact name searches for random names of the synthetic vault the options describe;
+ * the given share of requests are writes instead, which alternate between adding a new password set
+ * and deleting it again, so the vault keeps its size. Prints the requests per second over all clients
+ * and the latency percentiles over all requests.
+ *
+ * \return The exit code of the program.
+ */
+int runLoadTest(const std::string& socketPath, const LoadTestOptions& options) {
+
+    std::signal(SIGPIPE, SIG_IGN);
+    const SyntheticSpec& spec = options.suite.spec;
+
+    std::vector<std::vector<std::uint32_t>> latencies(options.clients);
+    std::vector<std::size_t> errors(options.clients, 0);
+    std::vector<std::size_t> hits(options.clients, 0);
+    std::atomic<std::size_t> failedClients{0};
+
+    auto client = [&](std::size_t number) {
+        int fd = connectToDaemon(socketPath);
+        if (fd < 0) {
+            failedClients++;
+            return;
+        }
+
+        std::mt19937_64 random(spec.seed + number);
+        std::string answer;
+        std::string pendingDelete;
+        char buffer[65536];
+        latencies[number].reserve(options.requests);
+
+        for (std::size_t i = 0; i < options.requests; i++) {
+            std::string request;
+            if (random() % 100 < options.writePercent) {
+                if (pendingDelete.empty()) {
+                    pendingDelete = "load" + std::to_string(number) + "x" + std::to_string(i);
+                    request = "add " + pendingDelete + " user p4ss category0 www.load.com\n";
+                } else {
+                    request = "delete " + pendingDelete + "\n";
+                    pendingDelete.clear();
+                }
+            } else {
+                request = "search " + syntheticRecord(spec, random() % spec.count).name + "\n";
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            if (!writeAll(fd, request)) {
+                break;
+            }
+            answer.clear();
+            while (answer != "\n" && (answer.size() < 2 || answer.compare(answer.size() - 2, 2, "\n\n") != 0)) {
+                ssize_t received = ::read(fd, buffer, sizeof(buffer));
+                if (received <= 0) {
+                    break;
+                }
+                answer.append(buffer, static_cast<std::size_t>(received));
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            latencies[number].push_back(static_cast<std::uint32_t>(std::min<long long>(elapsed.count(), UINT32_MAX)));
+
+            if (answer.compare(0, 6, "error:") == 0) {
+                errors[number]++;
+            } else {
+                hits[number] += static_cast<std::size_t>(std::count(answer.begin(), answer.end(), '\n')) - 1;
+            }
+        }
+        ::close(fd);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < options.clients; i++) {
+        threads.emplace_back(client, i);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (failedClients > 0) {
+        std::cerr << "Can't connect to " << socketPath << std::endl;
+        return 1;
+    }
+
+    std::vector<std::uint32_t> all;
+    for (const auto& perClient : latencies) {
+        all.insert(all.end(), perClient.begin(), perClient.end());
+    }
+    if (all.empty()) {
+        std::cerr << "No request was answered" << std::endl;
+        return 1;
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double share) {
+        return all[std::min(all.size() - 1, static_cast<std::size_t>(share * all.size()))] / 1e3;
+    };
+
+    std::size_t totalErrors = 0;
+    std::size_t totalHits = 0;
+    for (std::size_t i = 0; i < options.clients; i++) {
+        totalErrors += errors[i];
+        totalHits += hits[i];
+    }
+
+    std::printf("%zu clients, %zu requests, %zu%% writes: %.0f requests/s\n", options.clients, all.size(),
+                options.writePercent, all.size() / seconds);
+    std::printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", percentile(0.5),
+                percentile(0.9), percentile(0.99), percentile(0.999), all.back() / 1e3);
+    std::printf("%zu answer lines, %zu errors\n", totalHits, totalErrors);
+    return totalErrors == 0 ? 0 : 1;
+}
+
+
+/**
+ * \brief Starts a daemon on a generated vault in a child process and runs the load generator against it.
+ *
+ * \return The exit code of the program.
+ */
+int benchmarkDaemon(const LoadTestOptions& options) {
+
+    const SyntheticSpec& spec = options.suite.spec;
+    const std::string fileName = spec.format == VaultFormat::Text ? "bench_daemon.txt" : "bench_daemon.pmv";
+    const std::string socketPath = "bench_daemon.sock";
+    if (!writeGeneratedVault(fileName, spec)) {
+        std::cerr << "Can't write " << fileName << std::endl;
+        return 1;
+    }
+
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        std::cout.setstate(std::ios::failbit);
+        ::_exit(runDaemon(fileName, socketPath, mainPassword, options.workers, options.suite.flush));
+    }
+
+    // The daemon is ready once it listens, which is after it has loaded the vault.
+    auto start = std::chrono::steady_clock::now();
+    int probe = -1;
+    while ((probe = connectToDaemon(socketPath)) < 0 && ::waitpid(pid, nullptr, WNOHANG) == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    int result = 1;
+    if (probe >= 0) {
+        ::close(probe);
+        std::printf("daemon ready after %.0f ms with %zu password sets\n", loadMs, spec.count);
+        result = runLoadTest(socketPath, options);
+        ::kill(pid, SIGTERM);
+    } else {
+        std::cerr << "The daemon did not start" << std::endl;
+    }
+    ::waitpid(pid, nullptr, 0);
+
+    std::remove(fileName.c_str());
+    std::remove(journal::fileOf(fileName).c_str());
+    std::remove(sidecar::fileOf(fileName).c_str());
+    return result;
+}
+
+
+/**
+ * \brief Checks snapshot isolation by reading snapshots on several threads while one thread changes the vault.
+ *
+ * The writer adds, edits and deletes password sets in waves that grow and shrink the vault, so the
+ * record store is compacted now and then and the snapshot rebuilt. Every password it writes is the
+ * name prefixed with "pw-", and every category is the name's first letter. The readers take snapshot
+ * after snapshot and check that each is consistent in itself: the alphabetic order is sorted and holds
+ * exactly the live records, every record is found by its name and in its category, and every password
+ * opens to what the writer wrote for that name. A version mixing two changes, or one freed too early,
+ * fails these checks or crashes, which an address or thread sanitizer build reports.
+ *
+ * \param seconds How long to run.
+ * \return The exit code of the program: 0 if no reader found an inconsistent snapshot.
+ */
+int runSnapshotStress(double seconds) {
+
+    const std::string fileName = "stress_snapshots.pmv";
+    std::remove(fileName.c_str());
+    std::remove(journal::fileOf(fileName).c_str());
+
+    std::size_t failures = 0;
+    std::size_t reads = 0;
+    std::size_t writes = 0;
+    std::size_t maxRetained = 0;
+    std::uint64_t published = 0;
+    {
+        PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+        manager.setFlushPolicy({FlushPolicy::Explicit, 0});
+        manager.setCompactionRatio(1);
+        manager.enableSnapshots();
+
+        std::atomic<bool> stopping{false};
+        std::atomic<std::size_t> failed{0};
+        std::atomic<std::size_t> checked{0};
+
+        auto reader = [&]() {
+            std::size_t local = 0;
+            while (!stopping) {
+                Versioned<VaultSnapshot>::Snapshot snapshot = manager.snapshot();
+                std::size_t visited = 0;
+                std::size_t categorized = 0;
+                RecordStore::Id previous = 0;
+                bool ok = true;
+
+                snapshot->forEachAlphabetic([&](RecordStore::Id id) {
+                    const VaultSnapshot::Entry& entry = snapshot->entry(id);
+                    if (visited > 0) {
+                        const std::string& before = snapshot->entry(previous).name;
+                        ok = ok && (before < entry.name || (before == entry.name && previous < id));
+                    }
+                    previous = id;
+                    visited++;
+
+                    ok = ok && entry.live && entry.category == entry.name.substr(0, 1);
+                    std::vector<RecordStore::Id> named = snapshot->findByName(entry.name);
+                    ok = ok && std::binary_search(named.begin(), named.end(), id);
+                    const std::vector<RecordStore::Id>* members = snapshot->findByCategory(entry.category);
+                    ok = ok && members != nullptr && std::binary_search(members->begin(), members->end(), id);
+                });
+                for (char letter = 'a'; letter <= 'z'; letter++) {
+                    const std::vector<RecordStore::Id>* members = snapshot->findByCategory(std::string(1, letter));
+                    categorized += members != nullptr ? members->size() : 0;
+                }
+                ok = ok && visited == snapshot->size() && categorized == visited;
+
+                // Passwords are opened through the public path, a few per snapshot, to keep the readers fast.
+                std::string output;
+                std::string first = visited > 0 ? snapshot->entry(previous).name : std::string();
+                if (!first.empty() && manager.runSnapshotCommand("search " + first, output)) {
+                    std::istringstream lines(output);
+                    for (std::string line; std::getline(lines, line);) {
+                        ok = ok && line.size() > first.size() + 3
+                             && line.compare(line.size() - first.size() - 3, std::string::npos, "pw-" + first) == 0;
+                    }
+                }
+
+                if (!ok) {
+                    failed++;
+                }
+                local++;
+            }
+            checked += local;
+        };
+
+        std::vector<std::thread> readers;
+        for (unsigned i = 0; i < std::max(3u, std::thread::hardware_concurrency()); i++) {
+            readers.emplace_back(reader);
+        }
+
+        std::mt19937 random(11);
+        std::vector<std::string> names;
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&start]() {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        for (std::size_t wave = 0; elapsed() < seconds; wave++) {
+            bool growing = wave % 2 == 0;
+            for (int step = 0; step < 3000 && elapsed() < seconds; step++) {
+                std::size_t choice = random() % 10;
+                if (names.empty() || (growing ? choice < 7 : choice < 2)) {
+                    std::string name(1, static_cast<char>('a' + random() % 26));
+                    name += std::to_string(random() % 100000);
+                    PasswordData plain;
+                    plain.name = name;
+                    plain.password = "pw-" + name;
+                    plain.category = name.substr(0, 1);
+                    plain.website = "www." + name + ".com";
+                    plain.login = "user";
+                    manager.insertPassword(plain);
+                    names.push_back(name);
+                } else if (choice < 8) {
+                    std::size_t victim = random() % names.size();
+                    manager.removeByName(names[victim]);
+                    names[victim] = names.back();
+                    names.pop_back();
+                } else {
+                    std::string& edited = names[random() % names.size()];
+                    std::string name = edited.substr(0, 1) + std::to_string(random() % 100000);
+                    PasswordData plain;
+                    plain.name = name;
+                    plain.password = "pw-" + name;
+                    plain.category = name.substr(0, 1);
+                    plain.website = "www." + name + ".com";
+                    plain.login = "user";
+                    manager.editByName(edited, plain);
+                    // Other sets sharing the old name stay, so the old name is kept around for deletion.
+                    names.push_back(name);
+                }
+                writes++;
+                maxRetained = std::max(maxRetained, manager.snapshotVersions().second);
+            }
+        }
+
+        stopping = true;
+        for (std::thread& thread : readers) {
+            thread.join();
+        }
+        failures = failed;
+        reads = checked;
+        published = manager.snapshotVersions().first;
+        manager.flushWrites();
+    }
+
+    std::remove(fileName.c_str());
+    std::remove(journal::fileOf(fileName).c_str());
+
+    std::printf("%zu changes, %llu versions published, %zu snapshots checked, at most %zu old versions held\n",
+                writes, static_cast<unsigned long long>(published), reads, maxRetained);
+    std::printf("%zu inconsistent snapshots\n", failures);
+    return failures == 0 ? 0 : 1;
+}
+
+
+/**
+ * \brief Compares read throughput under concurrent writes with a reader-writer lock and with snapshots.
+ *
+ * Reader threads run exact name searches for random existing names as fast as they can while one writer
+ * adds and deletes password sets, under the default Immediate flush policy, so each write holds on to
+ * the vault for an fsync. With the lock, readers take it shared and the writer takes it alone, the way
+ * the daemon guarded all reads before snapshots. With snapshots, readers take no lock at all. Both runs
+ * are also timed without the writer.
+ *
+ * \param count The number of password sets in the synthetic vault.
+ */
+void benchmarkSnapshots(std::size_t count) {
+
+    SyntheticSpec spec;
+    spec.count = count;
+    const std::string fileName = "bench_snapshots.txt";
+    writeGeneratedVault(fileName, spec);
+
+    {
+        PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+        manager.enableSnapshots();
+        std::shared_mutex managerLock;
+        std::size_t readers = std::max(2u, std::thread::hardware_concurrency());
+        std::printf("records: %zu, %zu readers, cores: %u\n", count, readers, std::thread::hardware_concurrency());
+
+        for (bool snapshots : {false, true}) {
+            for (bool writing : {false, true}) {
+                std::atomic<bool> stopping{false};
+                std::atomic<std::size_t> totalReads{0};
+                std::size_t totalWrites = 0;
+                std::vector<std::vector<std::uint32_t>> latencies(readers);
+
+                auto read = [&](std::size_t number) {
+                    std::mt19937_64 random(number);
+                    std::size_t local = 0;
+                    std::string output;
+                    while (!stopping) {
+                        std::string line = "search " + syntheticRecord(spec, random() % count).name;
+                        output.clear();
+                        auto start = std::chrono::steady_clock::now();
+                        if (snapshots) {
+                            manager.runSnapshotCommand(line, output);
+                        } else {
+                            std::shared_lock<std::shared_mutex> lock(managerLock);
+                            manager.runCommand(line, output);
+                        }
+                        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start);
+                        latencies[number].push_back(static_cast<std::uint32_t>(
+                            std::min<long long>(elapsed.count(), UINT32_MAX)));
+                        local++;
+                    }
+                    totalReads += local;
+                };
+
+                std::vector<std::thread> threads;
+                for (std::size_t i = 0; i < readers; i++) {
+                    threads.emplace_back(read, i);
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                const auto duration = std::chrono::seconds(2);
+                for (std::size_t i = 0; std::chrono::steady_clock::now() - start < duration; i++) {
+                    if (!writing) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                        continue;
+                    }
+                    std::unique_lock<std::shared_mutex> lock(managerLock);
+                    if (i % 2 == 0) {
+                        manager.insertPassword(syntheticRecord(spec, count + i / 2));
+                    } else {
+                        manager.removeByName(syntheticRecord(spec, count + i / 2).name);
+                    }
+                    totalWrites++;
+                }
+                stopping = true;
+                for (std::thread& thread : threads) {
+                    thread.join();
+                }
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                std::vector<std::uint32_t> all;
+                for (const auto& perReader : latencies) {
+                    all.insert(all.end(), perReader.begin(), perReader.end());
+                }
+                std::sort(all.begin(), all.end());
+                auto percentile = [&all](double share) {
+                    return all.empty() ? 0.0 : all[std::min(all.size() - 1, std::size_t(share * all.size()))] / 1e3;
+                };
+
+                std::printf("%-9s %-14s %12.0f reads/s  p50 %8.1f us  p99 %9.1f us  %8.0f writes/s\n",
+                            snapshots ? "snapshot" : "rw-lock", writing ? "with writer" : "read only",
+                            totalReads / elapsed, percentile(0.5), percentile(0.99), totalWrites / elapsed);
+            }
+        }
+    }
+
+    std::remove(fileName.c_str());
+    std::remove(journal::fileOf(fileName).c_str());
+}
+
+
+/**
+ * \brief Times streaming exports and imports in both layouts and shows their memory use does not grow.
+ *
+ * A sealed vault of count password sets, and one of a tenth of that, are generated. Each is exported to
+ * CSV and to JSON, and each export is imported into a new vault. Every step runs in a child process of
+ * its own, so its peak resident set size belongs to that step alone; the process baseline is printed
+ * for reference. The imported vaults are opened again to check every password set arrived.
+ *
+ * \param count The number of password sets in the larger vault.
+ */
+void benchmarkInterchange(std::size_t count) {
+
+    const std::string vaultFile = "bench_vault.pmv";
+    const std::string importFile = "bench_import.pmv";
+    const std::string exportFiles[] = {"bench_export.csv", "bench_export.json"};
+
+    auto inChild = [](const std::function<InterchangeResult()>& step, long& peakKilobytes) {
+        InterchangeResult result;
+        int channel[2];
+        if (::pipe(channel) != 0) {
+            return result;
+        }
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            ::close(channel[0]);
+            InterchangeResult done = step();
+            std::size_t numbers[] = {done.ok, done.records, done.rejected, done.bytesRead, done.bytesWritten};
+            ::write(channel[1], numbers, sizeof(numbers));
+            ::write(channel[1], &done.milliseconds, sizeof(done.milliseconds));
+            ::_exit(0);
+        }
+        ::close(channel[1]);
+        std::size_t numbers[5] = {};
+        ::read(channel[0], numbers, sizeof(numbers));
+        ::read(channel[0], &result.milliseconds, sizeof(result.milliseconds));
+        ::close(channel[0]);
+        result.ok = numbers[0] != 0;
+        result.records = numbers[1];
+        result.rejected = numbers[2];
+        result.bytesRead = numbers[3];
+        result.bytesWritten = numbers[4];
+
+        int status = 0;
+        struct rusage usage{};
+        ::wait4(pid, &status, 0, &usage);
+#ifdef __APPLE__
+        peakKilobytes = usage.ru_maxrss / 1024;
+#else
+        peakKilobytes = usage.ru_maxrss;
+#endif
+        return result;
+    };
+
+    long baseline = 0;
+    inChild([]() { return InterchangeResult(); }, baseline);
+    std::printf("threads: %u, process baseline: %ld KB peak RSS\n", std::max(1u, std::thread::hardware_concurrency()), baseline);
+
+    for (std::size_t size : {count / 10, count}) {
+
+        SyntheticSpec spec;
+        spec.count = size;
+        spec.format = VaultFormat::Binary;
+        writeGeneratedVault(vaultFile, spec);
+
+        for (InterchangeFormat format : {InterchangeFormat::Csv, InterchangeFormat::Json}) {
+            const std::string& exportFile = exportFiles[format == InterchangeFormat::Json];
+            InterchangeOptions options;
+            options.format = format;
+
+            long exportPeak = 0;
+            InterchangeResult exported = inChild([&]() {
+                return exportVault(vaultFile, exportFile, mainPassword, options);
+            }, exportPeak);
+
+            // The target vault gets the cheap KDF of the generated ones rather than a calibrated one.
+            SyntheticSpec empty = spec;
+            empty.count = 0;
+            writeGeneratedVault(importFile, empty);
+            long importPeak = 0;
+            InterchangeResult imported = inChild([&]() {
+                return importVault(importFile, exportFile, mainPassword, options);
+            }, importPeak);
+
+            // Opened in a child as well, so the parent stays small for the children forked after it.
+            long reopenPeak = 0;
+            std::size_t reopened = inChild([&]() {
+                InterchangeResult opened;
+                PasswordManager manager(importFile, mainPassword, 0, IndexSidecar::Ignore);
+                opened.records = manager.passwordCount();
+                return opened;
+            }, reopenPeak).records;
+
+            const char* name = format == InterchangeFormat::Csv ? "csv " : "json";
+            std::printf("%8zu %s export %10.0f entries/s %8.1f MB/s %8ld KB peak RSS\n", size, name,
+                        exported.records / (exported.milliseconds / 1000), exported.bytesWritten / exported.milliseconds / 1000, exportPeak);
+            std::printf("%8zu %s import %10.0f entries/s %8.1f MB/s %8ld KB peak RSS %8zu password sets after reopening\n",
+                        size, name, imported.records / (imported.milliseconds / 1000), imported.bytesRead / imported.milliseconds / 1000,
+                        importPeak, reopened);
+        }
+    }
+
+    for (const std::string& fileName : {vaultFile, importFile, exportFiles[0], exportFiles[1]}) {
+        std::remove(fileName.c_str());
+    }
+}
+
+
+/**
+ * \brief Times opening a vault with and without its index sidecar.
+ *
+ * A text and a binary synthetic vault are each opened without the sidecar, which loads every block and
+ * rebuilds the indexes, then closed with the sidecar written, and opened again from it. The open times
+ * include the key derivation, which is cheap for generated vaults. The first substring search is timed
+ * as well, since the trigram index it needs is no longer built on open.
+ *
+ * Both opens have to list the same password sets in the same order and find the same ones by category
+ * and by substring. The check is repeated after a few adds, edits and deletes, which rewrite the sidecar.
+ *
+ * \param count The number of password sets per vault.
+ */
+void benchmarkStartup(std::size_t count) {
+
+    const std::string fileName = "bench_vault.pmv";
+    const char* const queries[] = {"list", "category category3", "contains ab1", "search account"};
+    const char* const changes[] = {"add zz-added login secret category3 www.added.com",
+                                   "add zz-added login2 secret2 category5 www.added.org", "flush",
+                                   "edit zz-added zz-edited login3 secret3 category1 www.edited.com",
+                                   "deletecategory category6", "flush"};
+
+    auto milliseconds = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    auto answers = [&queries](PasswordManager& manager) {
+        std::string output;
+        for (const char* query : queries) {
+            manager.runCommand(query, output);
+        }
+        return output;
+    };
+
+    std::printf("records: %zu, threads: %u\n", count, std::max(1u, std::thread::hardware_concurrency()));
+    for (VaultFormat format : {VaultFormat::Text, VaultFormat::Binary}) {
+
+        SyntheticSpec spec;
+        spec.count = count;
+        spec.format = format;
+        writeGeneratedVault(fileName, spec);
+        std::remove(sidecar::fileOf(fileName).c_str());
+
+        std::string expected;
+        auto start = std::chrono::steady_clock::now();
+        double rebuildMs = 0;
+        {
+            PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+            rebuildMs = milliseconds(start);
+            expected = answers(manager);
+        }
+
+        auto writer = std::make_unique<PasswordManager>(fileName, mainPassword);
+        start = std::chrono::steady_clock::now();
+        writer.reset();
+        double closeMs = milliseconds(start);
+        struct stat info{};
+        double sidecarMb = ::stat(sidecar::fileOf(fileName).c_str(), &info) == 0 ? info.st_size / 1e6 : 0;
+
+        start = std::chrono::steady_clock::now();
+        double sidecarMs = 0;
+        double searchMs = 0;
+        bool identical = false;
+        {
+            PasswordManager manager(fileName, mainPassword);
+            sidecarMs = milliseconds(start);
+            start = std::chrono::steady_clock::now();
+            manager.findContaining("ab1", false);
+            searchMs = milliseconds(start);
+            identical = answers(manager) == expected;
+
+            std::string ignored;
+            for (const char* change : changes) {
+                manager.runCommand(change, ignored);
+            }
+        }
+
+        {
+            PasswordManager rebuilt(fileName, mainPassword, 0, IndexSidecar::Ignore);
+            PasswordManager restored(fileName, mainPassword);
+            identical = identical && answers(restored) == answers(rebuilt);
+        }
+
+        const char* name = format == VaultFormat::Text ? "text" : "binary";
+        std::printf("%-6s open with rebuild %10.1f ms\n", name, rebuildMs);
+        std::printf("%-6s close and write sidecar %4.1f ms  (%.1f MB)\n", name, closeMs, sidecarMb);
+        std::printf("%-6s open from sidecar %10.1f ms  speedup %5.1fx\n", name, sidecarMs, rebuildMs / sidecarMs);
+        std::printf("%-6s first substring search %5.1f ms\n", name, searchMs);
+        std::printf("%-6s same results, also after changes: %s\n", name, identical ? "yes" : "NO");
+    }
+
+    std::remove(fileName.c_str());
+    std::remove(journal::fileOf(fileName).c_str());
+    std::remove(sidecar::fileOf(fileName).c_str());
+}
+
+
+/**
+ * \brief Times a batch script of adds against a new vault.
+ *
+ * The script is generated in memory and run through PasswordManager::runBatch(), followed by a handful
+ * of searches, so the timing covers sealing, indexing and the grouped writes. The vault is then opened
+ * again to check every password set made it to the file.
+ *
+ * \param count The number of adds in the script.
+ */
+void benchmarkBatch(std::size_t count) {
+
+    static const char* const categories[] = {"work", "private", "bank", "social", "shopping", "games", "mail", "other"};
+    const std::string fileName = "bench_vault.pmv";
+    std::remove(fileName.c_str());
+
+    std::string script;
+    for (std::size_t i = 0; i < count; i++) {
+        std::string id = std::to_string(i);
+        script += "add account" + id + " user" + id + " p4ss!" + id + "word " + categories[i % 8] + " www.site" + id + ".com\n";
+    }
+    script += "search account7\ncontains site12345.\nsearch acount7\n";
+
+    double runMs = 0;
+    std::size_t reopened = 0;
+    {
+        PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+        std::istringstream input(script);
+        std::ostringstream output;
+
+        auto start = std::chrono::steady_clock::now();
+        manager.runBatch(input, output);
+        runMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    {
+        PasswordManager manager(fileName, mainPassword, 0, IndexSidecar::Ignore);
+        reopened = manager.passwordCount();
+    }
+
+    std::printf("%zu scripted adds: %.1f ms, %.0f adds/s, %zu password sets after reopening\n",
+                count, runMs, count / (runMs / 1000), reopened);
+    std::remove(fileName.c_str());
+}
+
+
+/**
+ * \brief Measures adds per second under each flush policy and what survives a crash right after them.
+ *
+ * For every policy a child process opens a new vault, adds the password sets one by one and reports the
+ * time taken over a pipe. It then ends with _exit(), skipping the destructor and its final flush, the
+ * same way a crash would. The parent opens the vault again and counts the password sets that made it to
+ * the disk, which is what the policy promises: all of them under immediate, all but the last group
+ * under count, bytes and time, and none under explicit.
+ *
+ * \param count The number of adds per policy.
+ */
+void benchmarkJournal(std::size_t count) {
+
+    static const char* const policies[] = {"immediate", "count=64", "bytes=65536", "time=20", "explicit"};
+    const std::string fileName = "bench_vault.pmv";
+
+    for (const char* name : policies) {
+
+        FlushPolicy policy;
+        parseFlushPolicy(name, policy);
+        std::remove(fileName.c_str());
+
+        int channel[2];
+        if (::pipe(channel) != 0) {
+            return;
+        }
+
+        pid_t child = ::fork();
+        if (child == 0) {
+            ::close(channel[0]);
+            PasswordManager manager(fileName, mainPassword, 1, IndexSidecar::Ignore);
+            manager.setFlushPolicy(policy);
+
+            PasswordData plain;
+            plain.category = "work";
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < count; i++) {
+                std::string id = std::to_string(i);
+                plain.name = "account" + id;
+                plain.login = "user" + id;
+                plain.password = "p4ss!" + id + "word";
+                plain.website = "www.site" + id + ".com";
+                manager.insertPassword(plain);
+            }
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            writeAll(channel[1], std::string_view(reinterpret_cast<const char*>(&elapsed), sizeof(elapsed)));
+            ::_exit(0);
+        }
+
+        ::close(channel[1]);
+        double elapsed = 0;
+        bool reported = child > 0 && ::read(channel[0], &elapsed, sizeof(elapsed)) == sizeof(elapsed);
+        ::close(channel[0]);
+        if (child > 0) {
+            ::waitpid(child, nullptr, 0);
+        }
+        if (!reported) {
+            std::printf("%-12s failed\n", name);
+            continue;
+        }
+
+        PasswordManager reopened(fileName, mainPassword, 1, IndexSidecar::Ignore);
+        std::printf("%-12s %10.0f adds/s  %zu of %zu survived the crash\n",
+                    name, count / (elapsed / 1000), reopened.passwordCount(), count);
+    }
+    std::remove(fileName.c_str());
+}
+
+
+/**
+ * \brief Checks the in-tree cryptography against published test vectors.
+ *
+ * Every check prints one line, so a regression names the primitive it is in. SHA-256 is checked with
+ * the examples of FIPS 180, the million 'a's fed in pieces, and PBKDF2-HMAC-SHA256 with the published
+ * vectors for it, among them the one of RFC 7914, section 11. The AEAD is checked with the example of
+ * RFC 8439, section 2.8.2, and a sealed field must no longer open once a single bit of it is flipped.
+ *
+ * \return The exit code: 0 if every vector matched, 1 otherwise.
+ */
+int runSelfTest() {
+
+    auto fromHex = [](std::string_view hex) {
+        std::string bytes;
+        for (std::size_t i = 0; i + 1 < hex.size(); i += 2) {
+            bytes.push_back(static_cast<char>(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16)));
+        }
+        return bytes;
+    };
+    int failures = 0;
+    auto check = [&failures](const char* name, bool passed) {
+        std::printf("%-36s %s\n", name, passed ? "ok" : "FAILED");
+        failures += passed ? 0 : 1;
+    };
+
+    check("SHA-256 \"abc\"", Sha256::hash("abc")
+          == fromHex("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    check("SHA-256 empty message", Sha256::hash("")
+          == fromHex("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+    check("SHA-256 448-bit message", Sha256::hash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")
+          == fromHex("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+    Sha256 million;
+    std::string thousand(1000, 'a');
+    for (int i = 0; i < 1000; i++) {
+        million.update(thousand);
+    }
+    check("SHA-256 one million 'a'", million.digest()
+          == fromHex("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"));
+
+    check("PBKDF2-HMAC-SHA256 c=1", pbkdf2HmacSha256("password", "salt", 1)
+          == fromHex("120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b"));
+    check("PBKDF2-HMAC-SHA256 c=2", pbkdf2HmacSha256("password", "salt", 2)
+          == fromHex("ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43"));
+    check("PBKDF2-HMAC-SHA256 c=4096", pbkdf2HmacSha256("password", "salt", 4096)
+          == fromHex("c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a"));
+    check("PBKDF2-HMAC-SHA256 dkLen=40", pbkdf2HmacSha256("passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096, 40)
+          == fromHex("348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1c635518c7dac47e9"));
+    check("PBKDF2-HMAC-SHA256 RFC 7914 11", pbkdf2HmacSha256("passwd", "salt", 1, 64)
+          == fromHex("55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+                     "49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783"));
+
+    std::string key;
+    for (int i = 0; i < 32; i++) {
+        key.push_back(static_cast<char>(0x80 + i));
+    }
+    ChaCha20Poly1305Cipher aead(key);
+    std::string plain = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, "
+                        "sunscreen would be it.";
+    std::string expected = fromHex("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+                                   "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+                                   "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+                                   "3ff4def08e4b7a9de576d26586cec64b6116"
+                                   "1ae10b594f09e26a7e902ecbd0600691");
+    check("ChaCha20-Poly1305 RFC 8439 2.8.2",
+          aead.sealWithAad(plain, fromHex("070000004041424344454647"), fromHex("50515253c0c1c2c3c4c5c6c7")) == expected);
+
+    std::string nonce = aead.makeNonce();
+    std::string sealed = aead.seal(plain, nonce, Field::Login);
+    check("ChaCha20-Poly1305 round trip", aead.open(sealed, nonce, Field::Login) == plain);
+    std::string opened(sealed.size(), '\0');
+    sealed[sealed.size() / 2] = static_cast<char>(sealed[sealed.size() / 2] ^ 1);
+    check("ChaCha20-Poly1305 rejects tampering", aead.openInto(sealed, nonce, Field::Login, opened.data()) < 0);
+
+    return failures == 0 ? 0 : 1;
+}
+
+
+/**
+ * \brief Kills a process at every write point of a run of vault updates and checks what it leaves behind.
+ *
+ * A deterministic run of adds, edits, deletes and category deletions is applied to a new vault. Compaction
+ * kicks in early, so its writes and rename get hit as well. The run is made once to count its write
+ * points, see crashPoint(). It is then made again in a child process for every write point, dying at
+ * that point. After each crash the vault is opened, which recovers it, and the password sets found must
+ * be the state after some prefix of the run:
+ *
+ * - either the state when the dead process last had nothing waiting to be written,
+ * - or the state after the operation it was in the middle of.
+ *
+ * Opening the vault a second time must give the same state. Edits, and under a count policy any group
+ * of several blocks, reach the disk together through the journal.
+ *
+ * \param operations The length of the run.
+ * \return The exit code: 0 if every crash left a consistent vault, 1 otherwise.
+ */
+int runCrashTest(std::size_t operations) {
+
+    static const char* const categories[] = {"work", "bank", "mail"};
+    const std::string fileName = "crash_vault.pmv";
+
+    // The run, and the state after each of its prefixes, as the sorted lines of a batch 'list'.
+    struct Step {
+        char kind;
+        std::string argument;
+        std::string password;
+    };
+    auto lineOf = [](const std::string& id, const std::string& password) {
+        return "account" + id + "\t" + categories[std::stoul(id) % 3] + "\twww.site" + id + ".com\tuser" + id + "\t"
+               + password + "\n";
+    };
+    std::vector<Step> steps;
+    std::vector<std::string> states(1);
+    {
+        std::mt19937 random(7);
+        std::vector<std::string> live;
+        std::vector<std::string> lines;
+        for (std::size_t i = 0; i < operations; i++) {
+            std::string id = std::to_string(i);
+            if (i % 11 == 10) {
+                std::string category = categories[random() % 3];
+                steps.push_back({'c', category, ""});
+                std::string suffix = "\t" + category + "\t";
+                for (std::size_t j = 0; j < lines.size(); j++) {
+                    if (lines[j].find(suffix) != std::string::npos) {
+                        live.erase(live.begin() + j);
+                        lines.erase(lines.begin() + j--);
+                    }
+                }
+            } else if (i % 3 == 2 && !live.empty()) {
+                std::size_t victim = random() % live.size();
+                steps.push_back({'d', live[victim], ""});
+                live.erase(live.begin() + victim);
+                lines.erase(lines.begin() + victim);
+            } else if (i % 5 == 4 && !live.empty()) {
+                std::size_t victim = random() % live.size();
+                steps.push_back({'e', live[victim], "edited" + id});
+                lines[victim] = lineOf(live[victim].substr(7), "edited" + id);
+            } else {
+                steps.push_back({'a', "account" + id, "p4ss!" + id});
+                live.push_back("account" + id);
+                lines.push_back(lineOf(id, "p4ss!" + id));
+            }
+            std::vector<std::string> sorted = lines;
+            std::sort(sorted.begin(), sorted.end());
+            std::string state;
+            for (const auto& line : sorted) {
+                state += line;
+            }
+            states.push_back(state);
+        }
+    }
+
+    std::string vaultKey;
+    const std::string emptyVault = encodeHeader(makeVaultHeader(mainPassword, minimumKdfIterations, vaultKey));
+    auto resetVault = [&]() {
+        std::remove(journal::fileOf(fileName).c_str());
+        std::ofstream file(fileName, std::ios::trunc | std::ios::binary);
+        file << emptyVault;
+    };
+
+    // Applies the run, reporting after every operation whether anything is still waiting to be written.
+    auto applySteps = [&](FlushPolicy policy, int progress) {
+        PasswordManager manager(fileName, mainPassword, 1, IndexSidecar::Ignore);
+        manager.setCompactionRatio(0.3);
+        manager.setFlushPolicy(policy);
+        for (const Step& step : steps) {
+            if (step.kind == 'a' || step.kind == 'e') {
+                std::string id = step.argument.substr(7);
+                PasswordData plain;
+                plain.name = step.argument;
+                plain.category = categories[std::stoul(id) % 3];
+                plain.website = "www.site" + id + ".com";
+                plain.login = "user" + id;
+                plain.password = step.password;
+                step.kind == 'a' ? manager.insertPassword(plain) : manager.editByName(step.argument, plain);
+            } else if (step.kind == 'd') {
+                manager.removeByName(step.argument);
+            } else {
+                manager.removeCategory(step.argument);
+            }
+            if (progress >= 0) {
+                writeAll(progress, manager.pendingBlocks() == 0 ? "D" : "Q");
+            }
+        }
+    };
+
+    auto recoveredState = [&]() {
+        PasswordManager manager(fileName, mainPassword, 1, IndexSidecar::Ignore);
+        std::istringstream script("list\n");
+        std::ostringstream listing;
+        manager.runBatch(script, listing);
+
+        std::vector<std::string> lines;
+        std::istringstream input(listing.str());
+        for (std::string line; std::getline(input, line);) {
+            lines.push_back(line + "\n");
+        }
+        std::sort(lines.begin(), lines.end());
+        std::string state;
+        for (const auto& line : lines) {
+            state += line;
+        }
+        return state;
+    };
+
+    static const char* const policies[] = {"immediate", "count=4"};
+    std::size_t failures = 0;
+
+    for (const char* name : policies) {
+
+        FlushPolicy policy;
+        parseFlushPolicy(name, policy);
+
+        const long unlimited = 1L << 40;
+        resetVault();
+        crashCountdown = unlimited;
+        applySteps(policy, -1);
+        long writePoints = unlimited - crashCountdown;
+        crashCountdown = -1;
+
+        if (recoveredState() != states.back()) {
+            std::printf("%-10s the run without a crash ends in the wrong state\n", name);
+            failures++;
+            continue;
+        }
+
+        std::size_t consistent = 0;
+        for (long point = 0; point < writePoints; point++) {
+
+            resetVault();
+            int channel[2];
+            if (::pipe(channel) != 0) {
+                return 1;
+            }
+            pid_t child = ::fork();
+            if (child == 0) {
+                ::close(channel[0]);
+                crashCountdown = point;
+                applySteps(policy, channel[1]);
+                ::_exit(0);
+            }
+            ::close(channel[1]);
+
+            std::string progress;
+            char buffer[256];
+            for (ssize_t got; (got = ::read(channel[0], buffer, sizeof(buffer))) > 0;) {
+                progress.append(buffer, static_cast<std::size_t>(got));
+            }
+            ::close(channel[0]);
+            int status = 0;
+            ::waitpid(child, &status, 0);
+
+            std::size_t done = progress.size();
+            std::size_t durable = progress.rfind('D') == std::string::npos ? 0 : progress.rfind('D') + 1;
+            std::string state = recoveredState();
+            bool valid = state == states[durable] || (done < steps.size() && state == states[done + 1])
+                         || (done == steps.size() && state == states[done]);
+
+            if (valid && state == recoveredState()) {
+                consistent++;
+            } else if (failures++ < 5) {
+                std::printf("%-10s crash at write point %ld after %zu operations left an inconsistent vault\n",
+                            name, point, done);
+            }
+        }
+        std::printf("%-10s %ld write points, %zu crashes left a consistent vault\n", name, writePoints, consistent);
+    }
+
+    std::remove(fileName.c_str());
+    std::remove(journal::fileOf(fileName).c_str());
+    return failures == 0 ? 0 : 1;
+}
+
+
+int main(int argc, char* argv[]) {
+
+#ifdef PM_ENABLE_STATS
+    std::atexit(stats::reportAtExit);
+#endif
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-load") {
+        benchmarkLoad(argc >= 3 ? std::stoul(argv[2]) : 200000);
+        return 0;
+    }
+    if (argc >= 2 && (std::string(argv[1]) == "--load-test" || std::string(argv[1]) == "--bench-daemon")) {
+        bool external = std::string(argv[1]) == "--load-test";
+        if (external && argc < 3) {
+            std::cerr << "Usage: --load-test <socket> [--clients=n] [--requests=n] [--writes=percent] "
+                         "[--count=n] [--seed=n]" << std::endl;
+            return 1;
+        }
+        LoadTestOptions options;
+        for (int i = external ? 3 : 2; i < argc; i++) {
+            if (!parseLoadTestOption(argv[i], options)) {
+                std::cerr << "Invalid option " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        return external ? runLoadTest(argv[2], options) : benchmarkDaemon(options);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--stress-snapshots") {
+        return runSnapshotStress(argc >= 3 ? std::stod(argv[2]) : 10);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-snapshots") {
+        benchmarkSnapshots(argc >= 3 ? std::stoul(argv[2]) : 100000);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-interchange") {
+        benchmarkInterchange(argc >= 3 ? std::stoul(argv[2]) : 500000);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-startup") {
+        benchmarkStartup(argc >= 3 ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--crash-test") {
+        return runCrashTest(argc >= 3 ? std::stoul(argv[2]) : 60);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--self-test") {
+        return runSelfTest();
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-journal") {
+        benchmarkJournal(argc >= 3 ? std::stoul(argv[2]) : 2000);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-batch") {
+        benchmarkBatch(argc >= 3 ? std::stoul(argv[2]) : 100000);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-cipher") {
+        benchmarkCipher();
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-threads") {
+        benchmarkThreads(argc >= 3 ? std::stoul(argv[2]) : 2000000, argc >= 4 ? std::stoul(argv[3]) : 0);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-search") {
+        benchmarkSearch(argc >= 3 ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-fuzzy") {
+        benchmarkFuzzy(argc >= 3 ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-memory") {
+        benchmarkMemory(argc >= 3 ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-scan") {
+        benchmarkScan(argc >= 3 ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && (std::string(argv[1]) == "--bench-suite" || std::string(argv[1]) == "--generate")) {
+        bool generate = std::string(argv[1]) == "--generate";
+        if (generate && argc < 3) {
+            std::cerr << "Usage: --generate <vault> [--count=n] [--seed=n] [--categories=n] [--vault=text|binary] "
+                         "[--name=min:max] [--password=min:max] [--website=min:max] [--login=min:max]" << std::endl;
+            return 1;
+        }
+        SuiteOptions options;
+        for (int i = generate ? 3 : 2; i < argc; i++) {
+            if (!parseSuiteOption(argv[i], options)) {
+                std::cerr << "Invalid option " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        if (!generate) {
+            return runBenchmarkSuite(options);
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (!writeGeneratedVault(argv[2], options.spec)) {
+            std::cerr << "Can't write " << argv[2] << std::endl;
+            return 1;
+        }
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("Generated %zu password sets into %s in %.1f ms\n", options.spec.count, argv[2], elapsed);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-lookup") {
+        benchmarkLookup();
+        return 0;
+    }
+
+    std::cerr << "Usage: " << argv[0] << " --generate <vault> [options] | --bench-suite [options] | --bench-<name> [n] | "
+                 "--load-test <socket> [options] | --stress-snapshots [s] | --crash-test [n] | --self-test" << std::endl;
+    return 1;
+}
@@ -0,0 +1,9178 @@
+/**
+ * \file password_manager.h
+ * \brief The vault, its formats and ciphers, the menu, the batch mode and the daemon.
+ *
+ * Shared by the password manager (main.cpp) and its benchmarks (benchmarks.cpp). Each of them is built
+ * from a single translation unit that includes this file once.
+ */
+
+#ifndef PASSWORD_MANAGER_H
+#define PASSWORD_MANAGER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <array>
+#include <tuple>
+#include <sstream>
+#include <cerrno>
+#include <csignal>
+#include <shared_mutex>
+#include <ctime>
+#include <cctype>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__) && !defined(PM_USE_STAT_POLL)
+#include <sys/inotify.h>
+#define PM_HAVE_INOTIFY
+#endif
+
+#if defined(__linux__) && !defined(PM_USE_POLL)
+#include <sys/epoll.h>
+#define PM_HAVE_EPOLL
+#endif
+
+/// \brief A constant to define the shift for the password encryption.
+const int shift = 3;
+
+/// \brief The largest number of typos in a name for which a search still offers the closest names.
+const std::size_t maxTypos = 2;
+
+/// \brief The main password to access text vaults, which carry no key of their own to check a password against.
+const std::string mainPassword = "pas";
+
+/// \brief First line of a tombstone that deletes every earlier password set with the name on the next line.
+const std::string nameTombstone = "#del";
+
+/// \brief First line of a tombstone that deletes every earlier password set in the category on the next line.
+const std::string categoryTombstone = "#delcategory";
+
+
+
+/**
+ * \brief Clears the console output.
+ *
+ * Function to clear the console by printing out 50 empty lines.
+ */
+void clearConsole() {
+    for (int i = 0; i < 50; i++) {
+        std::cout << std::endl;
+    }
+}
+
+
+void tryAgain();
+
+
+
+
+
+
+
+/**
+ * \namespace stats
+ * \brief Scoped timers, latency histograms and counters for the hot paths.
+ *
+ * All of it is only compiled with -DPM_ENABLE_STATS. Without that flag PM_TIME_SCOPE and PM_COUNT
+ * expand to nothing and their arguments are never evaluated, so the instrumented code is exactly what
+ * it would be without them. With it, every timed scope adds its duration to the histogram of its
+ * operation. Everything is a relaxed atomic, so the loader threads record without taking a lock.
+ */
+#ifdef PM_ENABLE_STATS
+namespace stats {
+
+enum class Operation : std::uint8_t {
+    Load,
+    RebuildIndexes,
+    Search,
+    TextSearch,
+    FuzzySearch,
+    CategoryList,
+    AlphabeticList,
+    Insert,
+    Edit,
+    Delete,
+    Append,
+    Journal,
+    Compaction,
+    Encrypt,
+    Decrypt,
+    DecryptColumn,
+    Count
+};
+
+enum class Counter : std::uint8_t {
+    BytesRead,
+    BytesWritten,
+    EncryptCalls,
+    EncryptBytes,
+    DecryptCalls,
+    DecryptBytes,
+    Count
+};
+
+const char* const operationNames[] = {
+    "load", "rebuild indexes", "search", "text search", "fuzzy search", "category list", "alphabetic list",
+    "insert", "edit", "delete", "append", "journal", "compaction", "encrypt", "decrypt", "decrypt column"};
+
+const char* const counterNames[] = {
+    "bytes read", "bytes written", "encrypt calls", "encrypt bytes", "decrypt calls", "decrypt bytes"};
+
+
+/**
+ * \class Histogram
+ * \brief A lock-free histogram of durations in nanoseconds, with HDR-style log-linear buckets.
+ *
+ * Values below 16 get a bucket each. Above that every power of two is split into 16 equal buckets, so
+ * a percentile is known to within 1/32 of its value, from nanoseconds to centuries, in 976 counters.
+ */
+class Histogram {
+
+public:
+    static constexpr int subBits = 4;
+    static constexpr std::size_t subBuckets = std::size_t(1) << subBits;
+    static constexpr std::size_t bucketCount = (64 - subBits + 1) * subBuckets;
+
+    static std::size_t bucketOf(std::uint64_t value) {
+        if (value < subBuckets) {
+            return static_cast<std::size_t>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        return (exponent - subBits + 1) * subBuckets + ((value >> (exponent - subBits)) & (subBuckets - 1));
+    }
+
+    /// \brief The middle of the values that fall into a bucket.
+    static std::uint64_t middleOf(std::size_t bucket) {
+        if (bucket < subBuckets) {
+            return bucket;
+        }
+        int exponent = static_cast<int>(bucket / subBuckets) + subBits - 1;
+        std::uint64_t width = std::uint64_t(1) << (exponent - subBits);
+        return (subBuckets + bucket % subBuckets) * width + width / 2;
+    }
+
+    void record(std::uint64_t value) {
+        buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(value, std::memory_order_relaxed);
+        std::uint64_t seen = maximum.load(std::memory_order_relaxed);
+        while (value > seen && !maximum.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * \brief The value below which the given share of the recorded values lies.
+     *
+     * Values recorded while this runs may or may not be counted, which only matters for a report taken
+     * in the middle of a burst.
+     */
+    std::uint64_t percentile(double share) const {
+        std::uint64_t recorded = count.load(std::memory_order_relaxed);
+        std::uint64_t wanted = static_cast<std::uint64_t>(share * recorded + 0.5);
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < bucketCount; bucket++) {
+            seen += buckets[bucket].load(std::memory_order_relaxed);
+            if (seen >= wanted && seen > 0) {
+                return std::min(middleOf(bucket), maximum.load(std::memory_order_relaxed));
+            }
+        }
+        return maximum.load(std::memory_order_relaxed);
+    }
+
+    void clear() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+        maximum.store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<std::uint64_t> buckets[bucketCount] = {};
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> maximum{0};
+};
+
+
+Histogram histograms[static_cast<std::size_t>(Operation::Count)];
+std::atomic<std::uint64_t> counters[static_cast<std::size_t>(Counter::Count)] = {};
+
+
+inline void add(Counter counter, std::uint64_t amount) {
+    counters[static_cast<std::size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+
+/**
+ * \class ScopedTimer
+ * \brief Records the time from its construction to the end of its scope in the histogram of an operation.
+ */
+class ScopedTimer {
+
+private:
+    Operation operation;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(Operation operation) : operation(operation), start(std::chrono::steady_clock::now()) {
+    }
+
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        histograms[static_cast<std::size_t>(operation)].record(static_cast<std::uint64_t>(elapsed.count()));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+
+/**
+ * \brief Prints a line per operation that has been timed at least once, then all counters.
+ *
+ * Latencies are in microseconds; the total is the time spent in the operation altogether.
+ */
+void report(std::ostream& out) {
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-16s %10s %10s %10s %10s %10s %10s %12s\n", "operation", "count",
+                  "mean us", "p50 us", "p90 us", "p99 us", "max us", "total ms");
+    out << line;
+
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Operation::Count); i++) {
+        const Histogram& histogram = histograms[i];
+        std::uint64_t count = histogram.count.load(std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        double total = static_cast<double>(histogram.total.load(std::memory_order_relaxed));
+        std::snprintf(line, sizeof(line), "%-16s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f %12.3f\n",
+                      operationNames[i], static_cast<unsigned long long>(count), total / count / 1e3,
+                      histogram.percentile(0.5) / 1e3, histogram.percentile(0.9) / 1e3,
+                      histogram.percentile(0.99) / 1e3,
+                      histogram.maximum.load(std::memory_order_relaxed) / 1e3, total / 1e6);
+        out << line;
+    }
+
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Counter::Count); i++) {
+        std::snprintf(line, sizeof(line), "%-16s %10llu\n", counterNames[i],
+                      static_cast<unsigned long long>(counters[i].load(std::memory_order_relaxed)));
+        out << line;
+    }
+}
+
+
+/// \brief Forgets everything recorded so far.
+void reset() {
+    for (Histogram& histogram : histograms) {
+        histogram.clear();
+    }
+    for (auto& counter : counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+/**
+ * \brief Prints the report when the program exits, registered with std::atexit() by main().
+ *
+ * The report goes to the file named by the PM_STATS_FILE environment variable, or to standard error.
+ */
+void reportAtExit() {
+    const char* fileName = std::getenv("PM_STATS_FILE");
+    if (fileName != nullptr && *fileName != '\0') {
+        std::ofstream file(fileName, std::ios::app);
+        report(file);
+    } else {
+        report(std::cerr);
+    }
+}
+
+}
+
+#define PM_STATS_CONCAT_(a, b) a##b
+#define PM_STATS_CONCAT(a, b) PM_STATS_CONCAT_(a, b)
+
+/// \brief Times the rest of the enclosing scope as one run of a stats::Operation.
+#define PM_TIME_SCOPE(operation) \
+    stats::ScopedTimer PM_STATS_CONCAT(statsTimer, __LINE__)(stats::Operation::operation)
+
+/// \brief Adds an amount to a stats::Counter.
+#define PM_COUNT(counter, amount) stats::add(stats::Counter::counter, (amount))
+
+#else
+
+#define PM_TIME_SCOPE(operation) static_cast<void>(0)
+#define PM_COUNT(counter, amount) static_cast<void>(0)
+
+#endif
+
+
+
+/**
+ * \brief The five fields of a password set, in the order they are stored.
+ *
+ * A field's number is part of the nonce it is sealed under, so fields can't be swapped around
+ * inside a record without failing authentication.
+ */
+enum class Field : std::uint8_t {
+    Name,
+    Password,
+    Category,
+    Website,
+    Login
+};
+
+
+
+/**
+ * \struct PasswordData
+ * \brief A structure to store password data.
+ *
+ * This structure is used to hold all details about a password,
+ * including its name, the password, the category, the website, and the login.
+ */
+struct PasswordData {
+
+    std::string name;
+    std::string password;
+    std::string category;
+    std::string website;
+    std::string login;
+
+    /// The record nonce the fields are sealed under; empty for ciphers that don't use one.
+    std::string nonce;
+
+
+    /// \brief One of the five fields, selected by its number.
+    const std::string& field(Field which) const {
+        switch (which) {
+            case Field::Name: return name;
+            case Field::Password: return password;
+            case Field::Category: return category;
+            case Field::Website: return website;
+            default: return login;
+        }
+    }
+
+    std::string& field(Field which) {
+        return const_cast<std::string&>(static_cast<const PasswordData&>(*this).field(which));
+    }
+
+
+    /**
+     * \brief Converts password data to a string.
+     *
+     * This method is used to convert all password data to a single string.
+     * Each piece of data is separated by a newline character. This is the text vault layout,
+     * which has no room for a nonce.
+     *
+     * \return A string containing all password data.
+     */
+    std::string toString() const {
+        std::string result;
+        result += name + "\n";
+        result += password + "\n";
+        result += category + "\n";
+        result += website + "\n";
+        result += login + "\n" + "\n";
+        return result;
+    }
+
+};
+
+
+
+/**
+ * \brief Adds delta to every byte of a buffer, one byte at a time.
+ *
+ * This is the reference kernel behind encryptData() and decryptData(), used wherever no vector
+ * kernel is available and for the tail of a buffer the vector kernels leave over. in and out may be
+ * the same buffer.
+ */
+void shiftBytesScalar(char* out, const char* in, std::size_t length, char delta) {
+    for (std::size_t i = 0; i < length; i++) {
+        out[i] = static_cast<char>(in[i] + delta);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/// \brief SSE2 version of shiftBytesScalar(), 16 bytes per step.
+__attribute__((target("sse2")))
+void shiftBytesSse2(char* out, const char* in, std::size_t length, char delta) {
+    const __m128i add = _mm_set1_epi8(delta);
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi8(block, add));
+    }
+    shiftBytesScalar(out + i, in + i, length - i, delta);
+}
+
+/// \brief AVX2 version of shiftBytesScalar(), 32 bytes per step.
+__attribute__((target("avx2")))
+void shiftBytesAvx2(char* out, const char* in, std::size_t length, char delta) {
+    const __m256i add = _mm256_set1_epi8(delta);
+    std::size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi8(block, add));
+    }
+    if (i + 16 <= length) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi8(block, _mm256_castsi256_si128(add)));
+        i += 16;
+    }
+    shiftBytesScalar(out + i, in + i, length - i, delta);
+}
+
+#endif
+
+using ShiftKernel = void (*)(char*, const char*, std::size_t, char);
+
+/**
+ * \brief Picks the fastest shift kernel the CPU supports.
+ *
+ * The choice is made once, from CPUID, the first time a buffer is transformed.
+ */
+ShiftKernel shiftKernel() {
+    static const ShiftKernel kernel = []() -> ShiftKernel {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return shiftBytesAvx2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return shiftBytesSse2;
+        }
+#endif
+        return shiftBytesScalar;
+    }();
+    return kernel;
+}
+
+/**
+ * \brief Adds delta to every byte of a buffer with the best available kernel.
+ *
+ * Buffers shorter than one vector step are handled inline, where the indirect call would cost more
+ * than the work itself.
+ */
+inline void shiftBytes(char* out, const char* in, std::size_t length, char delta) {
+    if (length < 16) {
+        shiftBytesScalar(out, in, length, delta);
+        return;
+    }
+    shiftKernel()(out, in, length, delta);
+}
+
+
+
+/**
+ * \class Sha256
+ * \brief SHA-256 as specified in FIPS 180-4.
+ */
+class Sha256 {
+
+private:
+    std::uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                              0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned char block[64] = {};
+    std::size_t blockLength = 0;
+    std::uint64_t totalLength = 0;
+
+    static std::uint32_t rotr(std::uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void compress(const unsigned char* data) {
+
+        static const std::uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        std::uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (static_cast<std::uint32_t>(data[4 * i]) << 24) | (static_cast<std::uint32_t>(data[4 * i + 1]) << 16)
+                   | (static_cast<std::uint32_t>(data[4 * i + 2]) << 8) | data[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            std::uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            std::uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++) {
+            std::uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+public:
+    static constexpr std::size_t digestSize = 32;
+    static constexpr std::size_t blockSize = 64;
+
+    Sha256& update(std::string_view data) {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+        std::size_t length = data.size();
+        totalLength += length;
+
+        if (blockLength > 0) {
+            std::size_t take = std::min(length, 64 - blockLength);
+            std::memcpy(block + blockLength, bytes, take);
+            blockLength += take;
+            bytes += take;
+            length -= take;
+            if (blockLength == 64) {
+                compress(block);
+                blockLength = 0;
+            }
+        }
+        for (; length >= 64; bytes += 64, length -= 64) {
+            compress(bytes);
+        }
+        std::memcpy(block, bytes, length);
+        blockLength += length;
+        return *this;
+    }
+
+    /// \brief Finishes the hash and returns the 32-byte digest.
+    std::string digest() {
+        std::uint64_t bits = totalLength * 8;
+        unsigned char padding[72] = {0x80};
+        std::size_t padLength = blockLength < 56 ? 56 - blockLength : 120 - blockLength;
+        for (int i = 0; i < 8; i++) {
+            padding[padLength + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        }
+        update(std::string_view(reinterpret_cast<const char*>(padding), padLength + 8));
+
+        std::string out(digestSize, '\0');
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 4; j++) {
+                out[4 * i + j] = static_cast<char>(state[i] >> (24 - 8 * j));
+            }
+        }
+        return out;
+    }
+
+    static std::string hash(std::string_view data) {
+        return Sha256().update(data).digest();
+    }
+};
+
+
+
+/**
+ * \class HmacSha256
+ * \brief HMAC-SHA256 as specified in RFC 2104.
+ *
+ * The key is absorbed once, so the same object can authenticate any number of messages; that is what
+ * keeps an iteration of pbkdf2HmacSha256() down to two SHA-256 compressions.
+ */
+class HmacSha256 {
+
+private:
+    Sha256 inner;
+    Sha256 outer;
+
+public:
+    explicit HmacSha256(std::string_view key) {
+        std::string block = key.size() > Sha256::blockSize ? Sha256::hash(key) : std::string(key);
+        block.resize(Sha256::blockSize, '\0');
+
+        std::string pad(Sha256::blockSize, '\0');
+        for (std::size_t i = 0; i < Sha256::blockSize; i++) {
+            pad[i] = static_cast<char>(block[i] ^ 0x36);
+        }
+        inner.update(pad);
+        for (std::size_t i = 0; i < Sha256::blockSize; i++) {
+            pad[i] = static_cast<char>(block[i] ^ 0x5c);
+        }
+        outer.update(pad);
+    }
+
+    std::string mac(std::string_view message) const {
+        std::string innerDigest = Sha256(inner).update(message).digest();
+        return Sha256(outer).update(innerDigest).digest();
+    }
+};
+
+
+/**
+ * \brief Derives a key with PBKDF2-HMAC-SHA256 (RFC 8018).
+ *
+ * \param password The password.
+ * \param salt The salt.
+ * \param iterations The iteration count, i.e. the cost of the derivation.
+ * \param length The length of the key to derive.
+ */
+std::string pbkdf2HmacSha256(std::string_view password, std::string_view salt, std::uint32_t iterations,
+                             std::size_t length = Sha256::digestSize) {
+
+    HmacSha256 prf(password);
+    std::string key;
+
+    for (std::uint32_t blockIndex = 1; key.size() < length; blockIndex++) {
+        std::string first(salt);
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            first.push_back(static_cast<char>((blockIndex >> shift) & 0xff));
+        }
+
+        std::string u = prf.mac(first);
+        std::string t = u;
+        for (std::uint32_t i = 1; i < iterations; i++) {
+            u = prf.mac(u);
+            for (std::size_t j = 0; j < t.size(); j++) {
+                t[j] = static_cast<char>(t[j] ^ u[j]);
+            }
+        }
+        key += t;
+    }
+
+    key.resize(length);
+    return key;
+}
+
+
+/// \brief Compares two byte strings in time that depends only on their length.
+bool equalSecrets(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        difference |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return difference == 0;
+}
+
+
+/// \brief Reads the given number of bytes from /dev/urandom, falling back to a seeded PRNG.
+std::string randomBytes(std::size_t count) {
+    static thread_local std::mt19937_64 fallback(std::random_device{}());
+    std::string bytes(count, '\0');
+    int fd = ::open("/dev/urandom", O_RDONLY);
+    std::size_t filled = 0;
+    if (fd >= 0) {
+        ssize_t got = ::read(fd, bytes.data(), bytes.size());
+        filled = got > 0 ? static_cast<std::size_t>(got) : 0;
+        ::close(fd);
+    }
+    for (; filled < bytes.size(); filled++) {
+        bytes[filled] = static_cast<char>(fallback());
+    }
+    return bytes;
+}
+
+
+
+/**
+ * \class FieldCipher
+ * \brief The interface every vault cipher implements.
+ *
+ * A cipher seals one field at a time. Every record carries its own nonce (of nonceSize() bytes, possibly
+ * none), and the field number is mixed into it, so no two fields are ever sealed under the same nonce.
+ * The id is what a binary vault stores in its header to say which cipher its fields are sealed with.
+ */
+class FieldCipher {
+
+public:
+    virtual ~FieldCipher() = default;
+
+    virtual std::uint8_t id() const = 0;
+
+    /// \brief The size of a record nonce.
+    virtual std::size_t nonceSize() const = 0;
+
+    /// \brief Seals a field, returning ciphertext and, for authenticated ciphers, the tag.
+    virtual std::string seal(std::string_view plain, std::string_view nonce, Field field) const = 0;
+
+    /**
+     * \brief Opens a sealed field.
+     *
+     * \param out Receives the plaintext; it needs room for sealed.size() bytes.
+     * \return The length of the plaintext, or -1 if the field does not authenticate.
+     */
+    virtual long openInto(std::string_view sealed, std::string_view nonce, Field field, char* out) const = 0;
+
+    /// \brief Opens a sealed field into a new string, which stays empty if it does not authenticate.
+    std::string open(std::string_view sealed, std::string_view nonce, Field field) const {
+        std::string plain(sealed.size(), '\0');
+        long length = openInto(sealed, nonce, field, plain.data());
+        plain.resize(length < 0 ? 0 : static_cast<std::size_t>(length));
+        return plain;
+    }
+
+    /**
+     * \brief Opens a whole column of the same field of many records in one call.
+     *
+     * The plaintexts are written back to back into one buffer. Fields that fail to authenticate come
+     * back empty.
+     *
+     * \param sealed The sealed fields.
+     * \param nonces The record nonces, one per sealed field.
+     * \param field Which field the column holds.
+     * \param plain Receives all plaintexts back to back.
+     * \param offsets Receives sealed.size() + 1 offsets; field i is [offsets[i], offsets[i + 1]).
+     */
+    virtual void openColumn(const std::vector<std::string_view>& sealed, const std::vector<std::string_view>& nonces,
+                            Field field, std::string& plain, std::vector<std::uint32_t>& offsets) const {
+
+        PM_TIME_SCOPE(DecryptColumn);
+        std::size_t capacity = 0;
+        for (std::string_view value : sealed) {
+            capacity += value.size();
+        }
+        plain.resize(capacity);
+        offsets.resize(sealed.size() + 1);
+
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < sealed.size(); i++) {
+            offsets[i] = static_cast<std::uint32_t>(total);
+            long length = openInto(sealed[i], nonces[i], field, plain.data() + total);
+            total += length < 0 ? 0 : static_cast<std::size_t>(length);
+        }
+        offsets[sealed.size()] = static_cast<std::uint32_t>(total);
+        plain.resize(total);
+    }
+
+    /// \brief A fresh random record nonce.
+    std::string makeNonce() const {
+        return randomBytes(nonceSize());
+    }
+};
+
+
+
+/**
+ * \class ShiftCipher
+ * \brief The original Caesar shift by the 'shift' constant, kept to read and write text vaults.
+ *
+ * It neither needs nonces nor authenticates anything.
+ */
+class ShiftCipher : public FieldCipher {
+
+public:
+    std::uint8_t id() const override {
+        return 0;
+    }
+
+    std::size_t nonceSize() const override {
+        return 0;
+    }
+
+    std::string seal(std::string_view plain, std::string_view, Field) const override {
+        PM_TIME_SCOPE(Encrypt);
+        PM_COUNT(EncryptCalls, 1);
+        PM_COUNT(EncryptBytes, plain.size());
+        std::string sealed(plain);
+        shiftBytes(sealed.data(), sealed.data(), sealed.size(), shift);
+        return sealed;
+    }
+
+    long openInto(std::string_view sealed, std::string_view, Field, char* out) const override {
+        PM_TIME_SCOPE(Decrypt);
+        PM_COUNT(DecryptCalls, 1);
+        PM_COUNT(DecryptBytes, sealed.size());
+        shiftBytes(out, sealed.data(), sealed.size(), -shift);
+        return static_cast<long>(sealed.size());
+    }
+
+    /// \brief Packs the whole column first and shifts it with a single kernel call.
+    void openColumn(const std::vector<std::string_view>& sealed, const std::vector<std::string_view>&,
+                    Field, std::string& plain, std::vector<std::uint32_t>& offsets) const override {
+
+        PM_TIME_SCOPE(DecryptColumn);
+        offsets.resize(sealed.size() + 1);
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < sealed.size(); i++) {
+            offsets[i] = static_cast<std::uint32_t>(total);
+            total += sealed[i].size();
+        }
+        offsets[sealed.size()] = static_cast<std::uint32_t>(total);
+
+        plain.resize(total);
+        for (std::size_t i = 0; i < sealed.size(); i++) {
+            std::memcpy(plain.data() + offsets[i], sealed[i].data(), sealed[i].size());
+        }
+        shiftBytes(plain.data(), plain.data(), total, -shift);
+        PM_COUNT(DecryptCalls, sealed.size());
+        PM_COUNT(DecryptBytes, total);
+    }
+};
+
+
+
+/**
+ * \class ChaCha20Poly1305Cipher
+ * \brief The ChaCha20-Poly1305 AEAD construction of RFC 8439.
+ *
+ * A sealed field is the ciphertext followed by the 16-byte Poly1305 tag. Record nonces are 12 random
+ * bytes; field n is sealed under the record nonce with n xor-ed into its first byte. The key part of
+ * the ChaCha20 state is laid out once in the constructor and copied for every field, which is all
+ * the key schedule this cipher has.
+ */
+class ChaCha20Poly1305Cipher : public FieldCipher {
+
+private:
+    std::uint32_t keyState[16] = {};
+
+    static std::uint32_t load32(const unsigned char* bytes) {
+        return static_cast<std::uint32_t>(bytes[0]) | (static_cast<std::uint32_t>(bytes[1]) << 8)
+               | (static_cast<std::uint32_t>(bytes[2]) << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+    }
+
+    static void store32(unsigned char* bytes, std::uint32_t value) {
+        bytes[0] = static_cast<unsigned char>(value);
+        bytes[1] = static_cast<unsigned char>(value >> 8);
+        bytes[2] = static_cast<unsigned char>(value >> 16);
+        bytes[3] = static_cast<unsigned char>(value >> 24);
+    }
+
+    static std::uint32_t rotl(std::uint32_t x, int n) {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    static void quarterRound(std::uint32_t* x, int a, int b, int c, int d) {
+        x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 16);
+        x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 12);
+        x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 8);
+        x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 7);
+    }
+
+    static void block(const std::uint32_t* input, unsigned char* out) {
+        std::uint32_t x[16];
+        std::memcpy(x, input, sizeof(x));
+        for (int round = 0; round < 10; round++) {
+            quarterRound(x, 0, 4, 8, 12);
+            quarterRound(x, 1, 5, 9, 13);
+            quarterRound(x, 2, 6, 10, 14);
+            quarterRound(x, 3, 7, 11, 15);
+            quarterRound(x, 0, 5, 10, 15);
+            quarterRound(x, 1, 6, 11, 12);
+            quarterRound(x, 2, 7, 8, 13);
+            quarterRound(x, 3, 4, 9, 14);
+        }
+        for (int i = 0; i < 16; i++) {
+            store32(out + 4 * i, x[i] + input[i]);
+        }
+    }
+
+    /// \brief Fills in the nonce words of a copy of the key state.
+    void prepare(std::uint32_t* state, std::string_view nonce, Field field) const {
+        unsigned char fieldNonce[12] = {};
+        std::memcpy(fieldNonce, nonce.data(), std::min<std::size_t>(nonce.size(), 12));
+        fieldNonce[0] ^= static_cast<unsigned char>(field);
+
+        std::memcpy(state, keyState, sizeof(keyState));
+        state[12] = 0;
+        state[13] = load32(fieldNonce);
+        state[14] = load32(fieldNonce + 4);
+        state[15] = load32(fieldNonce + 8);
+    }
+
+    /// \brief XORs the keystream, starting at block 1, into a buffer.
+    static void applyKeystream(std::uint32_t* state, const char* in, char* out, std::size_t length) {
+        unsigned char stream[64];
+        for (std::size_t offset = 0; offset < length; offset += 64) {
+            state[12]++;
+            block(state, stream);
+            std::size_t take = std::min<std::size_t>(64, length - offset);
+            for (std::size_t i = 0; i < take; i++) {
+                out[offset + i] = static_cast<char>(in[offset + i] ^ stream[i]);
+            }
+        }
+    }
+
+    /**
+     * \brief Poly1305 over aad and ciphertext as RFC 8439 lays them out for the AEAD.
+     *
+     * Both parts are zero-padded to 16 bytes and followed by their lengths, so every block that goes
+     * into the MAC is a full one.
+     */
+    static void poly1305(const unsigned char* key, std::string_view aad, std::string_view ciphertext,
+                         unsigned char* tag) {
+
+        const std::uint32_t mask = 0x3ffffff;
+        std::uint32_t r0 = load32(key) & 0x3ffffff;
+        std::uint32_t r1 = (load32(key + 3) >> 2) & 0x3ffff03;
+        std::uint32_t r2 = (load32(key + 6) >> 4) & 0x3ffc0ff;
+        std::uint32_t r3 = (load32(key + 9) >> 6) & 0x3f03fff;
+        std::uint32_t r4 = (load32(key + 12) >> 8) & 0x00fffff;
+        std::uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+        std::uint32_t h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
+
+        auto absorb = [&](const unsigned char* m) {
+            h0 += load32(m) & mask;
+            h1 += (load32(m + 3) >> 2) & mask;
+            h2 += (load32(m + 6) >> 4) & mask;
+            h3 += (load32(m + 9) >> 6) & mask;
+            h4 += (load32(m + 12) >> 8) | (1u << 24);
+
+            std::uint64_t d0 = static_cast<std::uint64_t>(h0) * r0 + static_cast<std::uint64_t>(h1) * s4
+                               + static_cast<std::uint64_t>(h2) * s3 + static_cast<std::uint64_t>(h3) * s2
+                               + static_cast<std::uint64_t>(h4) * s1;
+            std::uint64_t d1 = static_cast<std::uint64_t>(h0) * r1 + static_cast<std::uint64_t>(h1) * r0
+                               + static_cast<std::uint64_t>(h2) * s4 + static_cast<std::uint64_t>(h3) * s3
+                               + static_cast<std::uint64_t>(h4) * s2;
+            std::uint64_t d2 = static_cast<std::uint64_t>(h0) * r2 + static_cast<std::uint64_t>(h1) * r1
+                               + static_cast<std::uint64_t>(h2) * r0 + static_cast<std::uint64_t>(h3) * s4
+                               + static_cast<std::uint64_t>(h4) * s3;
+            std::uint64_t d3 = static_cast<std::uint64_t>(h0) * r3 + static_cast<std::uint64_t>(h1) * r2
+                               + static_cast<std::uint64_t>(h2) * r1 + static_cast<std::uint64_t>(h3) * r0
+                               + static_cast<std::uint64_t>(h4) * s4;
+            std::uint64_t d4 = static_cast<std::uint64_t>(h0) * r4 + static_cast<std::uint64_t>(h1) * r3
+                               + static_cast<std::uint64_t>(h2) * r2 + static_cast<std::uint64_t>(h3) * r1
+                               + static_cast<std::uint64_t>(h4) * r0;
+
+            std::uint64_t c = d0 >> 26; h0 = static_cast<std::uint32_t>(d0) & mask;
+            d1 += c; c = d1 >> 26; h1 = static_cast<std::uint32_t>(d1) & mask;
+            d2 += c; c = d2 >> 26; h2 = static_cast<std::uint32_t>(d2) & mask;
+            d3 += c; c = d3 >> 26; h3 = static_cast<std::uint32_t>(d3) & mask;
+            d4 += c; c = d4 >> 26; h4 = static_cast<std::uint32_t>(d4) & mask;
+            h0 += static_cast<std::uint32_t>(c) * 5; h1 += h0 >> 26; h0 &= mask;
+        };
+
+        auto absorbPadded = [&](std::string_view data) {
+            const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+            std::size_t full = data.size() / 16 * 16;
+            for (std::size_t i = 0; i < full; i += 16) {
+                absorb(bytes + i);
+            }
+            if (full < data.size()) {
+                unsigned char last[16] = {};
+                std::memcpy(last, bytes + full, data.size() - full);
+                absorb(last);
+            }
+        };
+
+        absorbPadded(aad);
+        absorbPadded(ciphertext);
+        unsigned char lengths[16];
+        store32(lengths, static_cast<std::uint32_t>(aad.size()));
+        store32(lengths + 4, static_cast<std::uint32_t>(static_cast<std::uint64_t>(aad.size()) >> 32));
+        store32(lengths + 8, static_cast<std::uint32_t>(ciphertext.size()));
+        store32(lengths + 12, static_cast<std::uint32_t>(static_cast<std::uint64_t>(ciphertext.size()) >> 32));
+        absorb(lengths);
+
+        std::uint32_t c;
+        c = h1 >> 26; h1 &= mask; h2 += c;
+        c = h2 >> 26; h2 &= mask; h3 += c;
+        c = h3 >> 26; h3 &= mask; h4 += c;
+        c = h4 >> 26; h4 &= mask; h0 += c * 5;
+        c = h0 >> 26; h0 &= mask; h1 += c;
+
+        std::uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= mask;
+        std::uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= mask;
+        std::uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= mask;
+        std::uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= mask;
+        std::uint32_t g4 = h4 + c - (1u << 26);
+
+        std::uint32_t select = (g4 >> 31) - 1;
+        h0 = (h0 & ~select) | (g0 & select);
+        h1 = (h1 & ~select) | (g1 & select);
+        h2 = (h2 & ~select) | (g2 & select);
+        h3 = (h3 & ~select) | (g3 & select);
+        h4 = (h4 & ~select) | (g4 & select);
+
+        std::uint64_t f;
+        f = static_cast<std::uint64_t>(h0 | (h1 << 26)) + load32(key + 16);
+        store32(tag, static_cast<std::uint32_t>(f));
+        f = static_cast<std::uint64_t>((h1 >> 6) | (h2 << 20)) + load32(key + 20) + (f >> 32);
+        store32(tag + 4, static_cast<std::uint32_t>(f));
+        f = static_cast<std::uint64_t>((h2 >> 12) | (h3 << 14)) + load32(key + 24) + (f >> 32);
+        store32(tag + 8, static_cast<std::uint32_t>(f));
+        f = static_cast<std::uint64_t>((h3 >> 18) | (h4 << 8)) + load32(key + 28) + (f >> 32);
+        store32(tag + 12, static_cast<std::uint32_t>(f));
+    }
+
+public:
+    static constexpr std::size_t tagSize = 16;
+
+    /// \param key The 32-byte key.
+    explicit ChaCha20Poly1305Cipher(std::string_view key) {
+        keyState[0] = 0x61707865;
+        keyState[1] = 0x3320646e;
+        keyState[2] = 0x79622d32;
+        keyState[3] = 0x6b206574;
+        unsigned char bytes[32] = {};
+        std::memcpy(bytes, key.data(), std::min<std::size_t>(key.size(), 32));
+        for (int i = 0; i < 8; i++) {
+            keyState[4 + i] = load32(bytes + 4 * i);
+        }
+    }
+
+    std::uint8_t id() const override {
+        return 1;
+    }
+
+    std::size_t nonceSize() const override {
+        return 12;
+    }
+
+    /**
+     * \brief The RFC 8439 AEAD encryption with additional data.
+     *
+     * \param nonce The full 12-byte nonce; no field number is mixed in.
+     */
+    std::string sealWithAad(std::string_view plain, std::string_view nonce, std::string_view aad) const {
+        std::uint32_t state[16];
+        prepare(state, nonce, Field::Name);
+
+        unsigned char polyKey[64];
+        block(state, polyKey);
+
+        std::string sealed(plain.size() + tagSize, '\0');
+        applyKeystream(state, plain.data(), sealed.data(), plain.size());
+        poly1305(polyKey, aad, std::string_view(sealed.data(), plain.size()),
+                 reinterpret_cast<unsigned char*>(sealed.data() + plain.size()));
+        return sealed;
+    }
+
+    std::string seal(std::string_view plain, std::string_view nonce, Field field) const override {
+        PM_TIME_SCOPE(Encrypt);
+        PM_COUNT(EncryptCalls, 1);
+        PM_COUNT(EncryptBytes, plain.size());
+        std::uint32_t state[16];
+        prepare(state, nonce, field);
+
+        unsigned char polyKey[64];
+        block(state, polyKey);
+
+        std::string sealed(plain.size() + tagSize, '\0');
+        applyKeystream(state, plain.data(), sealed.data(), plain.size());
+        poly1305(polyKey, std::string_view(), std::string_view(sealed.data(), plain.size()),
+                 reinterpret_cast<unsigned char*>(sealed.data() + plain.size()));
+        return sealed;
+    }
+
+    long openInto(std::string_view sealed, std::string_view nonce, Field field, char* out) const override {
+        PM_TIME_SCOPE(Decrypt);
+        PM_COUNT(DecryptCalls, 1);
+        PM_COUNT(DecryptBytes, sealed.size());
+        if (sealed.size() < tagSize) {
+            return -1;
+        }
+        std::string_view ciphertext = sealed.substr(0, sealed.size() - tagSize);
+
+        std::uint32_t state[16];
+        prepare(state, nonce, field);
+
+        unsigned char polyKey[64];
+        block(state, polyKey);
+
+        unsigned char tag[tagSize];
+        poly1305(polyKey, std::string_view(), ciphertext, tag);
+
+        unsigned char difference = 0;
+        for (std::size_t i = 0; i < tagSize; i++) {
+            difference |= tag[i] ^ static_cast<unsigned char>(sealed[ciphertext.size() + i]);
+        }
+        if (difference != 0) {
+            return -1;
+        }
+
+        applyKeystream(state, ciphertext.data(), out, ciphertext.size());
+        return static_cast<long>(ciphertext.size());
+    }
+};
+
+
+
+/**
+ * \brief Creates the cipher with the given id.
+ *
+ * \param id The id stored in a vault header, see FieldCipher::id().
+ * \param key The vault key, ignored by ciphers that don't use one.
+ * \return The cipher, or nullptr if the id is unknown, as in a corrupt header or one written by a later
+ * version; such a vault must not be opened.
+ */
+std::unique_ptr<FieldCipher> makeCipher(std::uint8_t id, const std::string& key) {
+    if (id == 0) {
+        return std::make_unique<ShiftCipher>();
+    }
+    if (id == 1) {
+        return std::make_unique<ChaCha20Poly1305Cipher>(key);
+    }
+    return nullptr;
+}
+
+
+
+/**
+ * \class MappedFile
+ * \brief A read-only memory mapping of a whole file.
+ *
+ * The mapping is created in the constructor and released in the destructor. A missing or empty
+ * file results in an empty mapping, so callers can treat both cases the same way as an empty vault.
+ */
+class MappedFile {
+
+private:
+    void* mapping = nullptr;
+    std::size_t length = 0;
+
+public:
+    explicit MappedFile(const std::string& fileName) {
+
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat info{};
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* result = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (result != MAP_FAILED) {
+                mapping = result;
+                length = static_cast<std::size_t>(info.st_size);
+                ::madvise(mapping, length, MADV_SEQUENTIAL);
+                PM_COUNT(BytesRead, length);
+            }
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (mapping != nullptr) {
+            ::munmap(mapping, length);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// \brief The mapped bytes, or an empty view if nothing could be mapped.
+    std::string_view view() const {
+        return {static_cast<const char*>(mapping), length};
+    }
+};
+
+
+
+/**
+ * \brief The kinds of blocks a vault file is made of.
+ *
+ * The vault is an append-only log: deleting never rewrites the file but appends a tombstone, which
+ * cancels every password set written before it that has the given name or category.
+ */
+enum class RecordKind {
+    Entry,
+    NameTombstone,
+    CategoryTombstone
+};
+
+
+
+/**
+ * \struct RecordView
+ * \brief A non-owning view of one block inside a vault buffer.
+ *
+ * Every field points straight into the buffer the record was indexed from (usually a MappedFile),
+ * so building a RecordView never allocates or copies. The fields are still encrypted. A name tombstone
+ * only fills in the name, a category tombstone only the category; both may carry a nonce.
+ */
+struct RecordView {
+
+    RecordKind kind = RecordKind::Entry;
+
+    std::string_view name;
+    std::string_view password;
+    std::string_view category;
+    std::string_view website;
+    std::string_view login;
+    std::string_view nonce;
+
+};
+
+
+/// \brief A RecordView of a password set held in memory.
+RecordView viewOf(const PasswordData& data) {
+    RecordView record;
+    record.name = data.name;
+    record.password = data.password;
+    record.category = data.category;
+    record.website = data.website;
+    record.login = data.login;
+    record.nonce = data.nonce;
+    return record;
+}
+
+
+
+/**
+ * \brief Walks over all blocks stored in a text vault buffer.
+ *
+ * The buffer is scanned line by line with memchr. The first non-empty line of a block is the name
+ * and the next four lines are the password, category, website and login, exactly as written by
+ * PasswordData::toString(). A block cut short by the end of the buffer is treated the same way as
+ * std::getline() treats it in the old loader, i.e. the missing fields are empty.
+ *
+ * A block whose first line is one of the tombstone markers has a single line after it. Encrypted
+ * names never start with '#', because the character it is shifted from is a space.
+ *
+ * \param buffer The raw vault contents.
+ * \param visit Called with a RecordView for every block, in file order.
+ */
+template <typename Visitor>
+void forEachTextRecord(std::string_view buffer, Visitor&& visit) {
+
+    const char* cursor = buffer.data();
+    const char* end = buffer.data() + buffer.size();
+
+    auto nextLine = [&cursor, end]() {
+        if (cursor >= end) {
+            return std::string_view();
+        }
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        const char* lineEnd = newline != nullptr ? newline : end;
+        std::string_view line(cursor, lineEnd - cursor);
+        cursor = newline != nullptr ? newline + 1 : end;
+        return line;
+    };
+
+    while (cursor < end) {
+
+        std::string_view line = nextLine();
+        if (line.empty()) {
+            continue;
+        }
+
+        RecordView record;
+
+        if (line == nameTombstone) {
+            record.kind = RecordKind::NameTombstone;
+            record.name = nextLine();
+            visit(record);
+            continue;
+        }
+        if (line == categoryTombstone) {
+            record.kind = RecordKind::CategoryTombstone;
+            record.category = nextLine();
+            visit(record);
+            continue;
+        }
+
+        record.name = line;
+        record.password = nextLine();
+        record.category = nextLine();
+        record.website = nextLine();
+        record.login = nextLine();
+
+        visit(record);
+    }
+}
+
+
+/**
+ * \brief The two on-disk layouts of a vault.
+ *
+ * Text is the original layout of newline-terminated fields. Binary starts with a header and stores
+ * every block length-prefixed with a checksum, so fields may contain any byte and a torn write at the
+ * end of the file is detected instead of being read as garbage.
+ */
+enum class VaultFormat {
+    Text,
+    Binary
+};
+
+
+/// \brief The first four bytes of a binary vault.
+const char vaultMagic[4] = {'P', 'M', 'V', 'B'};
+
+/// \brief The binary layout version written by this program.
+const std::uint16_t vaultVersion = 2;
+
+/// \brief The size of the header written by this program; readers honour the size stored in the header.
+const std::uint16_t vaultHeaderSize = 64;
+
+/// \brief The unlock time new vaults are calibrated to, in milliseconds.
+const double defaultUnlockMilliseconds = 250;
+
+/// \brief The lowest iteration count calibration will ever pick, however slow the machine is.
+const std::uint32_t minimumKdfIterations = 10000;
+
+/// \brief The highest iteration count calibration picks and a vault header may name, so that a damaged
+/// header can't keep the key derivation busy for hours.
+const std::uint32_t maximumKdfIterations = 100000000;
+
+
+void putU16(std::string& out, std::uint16_t value) {
+    out.push_back(static_cast<char>(value & 0xff));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+void putU32(std::string& out, std::uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+std::uint16_t getU16(const char* data) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<std::uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+std::uint32_t getU32(const char* data) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<std::uint32_t>(bytes[0]) | (static_cast<std::uint32_t>(bytes[1]) << 8)
+           | (static_cast<std::uint32_t>(bytes[2]) << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+}
+
+
+/**
+ * \brief Computes the CRC-32 (IEEE 802.3) of a byte range.
+ *
+ * \param data The bytes to checksum.
+ * \param crc The checksum of the preceding bytes, to continue a running checksum.
+ * \return The updated checksum.
+ */
+std::uint32_t crc32(std::string_view data, std::uint32_t crc = 0) {
+
+    static const auto table = []() {
+        std::vector<std::uint32_t> entries(256);
+        for (std::uint32_t i = 0; i < 256; i++) {
+            std::uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) != 0 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+
+    crc = ~crc;
+    for (unsigned char c : data) {
+        crc = table[(crc ^ c) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+/// \brief Tells a binary vault from a text one by its magic bytes.
+VaultFormat detectFormat(std::string_view buffer) {
+    if (buffer.size() >= 8 && std::memcmp(buffer.data(), vaultMagic, 4) == 0) {
+        return VaultFormat::Binary;
+    }
+    return VaultFormat::Text;
+}
+
+
+/**
+ * \struct VaultHeader
+ * \brief The settings stored in the header of a binary vault.
+ *
+ * Version 1 headers only hold the cipher id; their key is the plain SHA-256 of the master password and
+ * they have no verifier. Version 2 headers add the PBKDF2 salt and iteration count and a verifier, which
+ * lets a wrong master password be rejected before a single record is touched.
+ */
+struct VaultHeader {
+
+    /// \brief The key derivation functions a header can name.
+    enum Kdf : std::uint8_t {Sha256Only = 0, Pbkdf2HmacSha256 = 1};
+
+    std::uint8_t cipherId = 0;
+    std::uint8_t kdf = Sha256Only;
+    std::uint32_t iterations = 0;
+    std::string salt;
+    std::string verifier;
+};
+
+
+/**
+ * \brief Serializes the header of a binary vault.
+ *
+ * Layout: magic (4 bytes), version (u16), header size (u16), cipher id (u8, see FieldCipher::id()),
+ * KDF id (u8), 2 reserved bytes, iteration count (u32), salt (16 bytes), verifier (32 bytes).
+ * All integers are little-endian.
+ */
+std::string encodeHeader(const VaultHeader& vaultHeader) {
+    std::string header(vaultMagic, 4);
+    putU16(header, vaultVersion);
+    putU16(header, vaultHeaderSize);
+    header.push_back(static_cast<char>(vaultHeader.cipherId));
+    header.push_back(static_cast<char>(vaultHeader.kdf));
+    putU16(header, 0);
+    putU32(header, vaultHeader.iterations);
+    header += vaultHeader.salt.substr(0, 16);
+    header.resize(32, '\0');
+    header += vaultHeader.verifier.substr(0, 32);
+    header.resize(vaultHeaderSize, '\0');
+    return header;
+}
+
+
+/**
+ * \brief Parses the header of a binary vault buffer.
+ *
+ * Version 1 headers hold no KDF settings, so their KDF byte must be Sha256Only. A header of a version
+ * newer than vaultVersion, one that names an unknown KDF, or one whose iteration count is 0 or above
+ * maximumKdfIterations is refused rather than read as something it is not.
+ *
+ * \param buffer The raw vault contents.
+ * \param header Receives the header.
+ * \return False if the header can't be read.
+ */
+bool decodeHeader(std::string_view buffer, VaultHeader& header) {
+
+    header = VaultHeader();
+    if (buffer.size() < 8) {
+        return false;
+    }
+    std::uint16_t version = getU16(buffer.data() + 4);
+    std::size_t size = getU16(buffer.data() + 6);
+    if (version < 1 || version > vaultVersion || size > buffer.size()) {
+        return false;
+    }
+
+    header.cipherId = size > 8 ? static_cast<std::uint8_t>(buffer[8]) : 0;
+    std::uint8_t kdf = size > 9 ? static_cast<std::uint8_t>(buffer[9]) : std::uint8_t(VaultHeader::Sha256Only);
+    if (kdf == VaultHeader::Sha256Only) {
+        return true;
+    }
+    if (kdf != VaultHeader::Pbkdf2HmacSha256 || version < 2 || size < 64) {
+        return false;
+    }
+    header.kdf = VaultHeader::Pbkdf2HmacSha256;
+    header.iterations = getU32(buffer.data() + 12);
+    header.salt = std::string(buffer.substr(16, 16));
+    header.verifier = std::string(buffer.substr(32, 32));
+    return header.iterations >= 1 && header.iterations <= maximumKdfIterations;
+}
+
+
+/**
+ * \brief Derives the vault key from the master password.
+ *
+ * This is the expensive step of opening a vault, so it is done once per session and the key is kept
+ * by PasswordManager.
+ *
+ * \param masterPassword The password typed in at start-up.
+ * \param header The header naming the KDF and its settings.
+ * \return A 32-byte key.
+ */
+std::string deriveVaultKey(const std::string& masterPassword, const VaultHeader& header) {
+    if (header.kdf == VaultHeader::Pbkdf2HmacSha256) {
+        return pbkdf2HmacSha256(masterPassword, header.salt, header.iterations);
+    }
+    return Sha256::hash(masterPassword);
+}
+
+
+/// \brief The value stored in a header to check a derived key against, without revealing the key.
+std::string keyVerifier(const std::string& vaultKey) {
+    return HmacSha256(vaultKey).mac("password manager key check");
+}
+
+
+/**
+ * \brief Finds the PBKDF2 iteration count that takes about the given time on this machine.
+ *
+ * The iteration count of a probe derivation is doubled until it runs long enough to be timed
+ * reliably, and the count is then scaled to the target.
+ *
+ * \param targetMilliseconds The unlock time to aim for.
+ * \return The iteration count, never below minimumKdfIterations nor above maximumKdfIterations.
+ */
+std::uint32_t calibrateKdfIterations(double targetMilliseconds) {
+
+    std::string salt = randomBytes(16);
+    std::uint32_t probe = 1000;
+    double elapsed = 0;
+
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        pbkdf2HmacSha256("calibration", salt, probe);
+        elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= 20 || probe >= (1u << 30)) {
+            break;
+        }
+        probe *= 2;
+    }
+
+    double iterations = targetMilliseconds / elapsed * probe;
+    iterations = std::min(std::max(iterations, double(minimumKdfIterations)), double(maximumKdfIterations));
+    return static_cast<std::uint32_t>(iterations);
+}
+
+
+/**
+ * \brief Sets up the header of a new binary vault and derives its key.
+ *
+ * \param masterPassword The master password of the new vault.
+ * \param iterations The PBKDF2 iteration count, see calibrateKdfIterations().
+ * \param vaultKey Receives the derived key.
+ */
+VaultHeader makeVaultHeader(const std::string& masterPassword, std::uint32_t iterations, std::string& vaultKey) {
+    VaultHeader header;
+    header.cipherId = 1;
+    header.kdf = VaultHeader::Pbkdf2HmacSha256;
+    header.iterations = iterations;
+    header.salt = randomBytes(16);
+    vaultKey = deriveVaultKey(masterPassword, header);
+    header.verifier = keyVerifier(vaultKey);
+    return header;
+}
+
+
+/**
+ * \brief Serializes one block in the binary layout.
+ *
+ * Layout: kind (u8), body length (u32), body, CRC-32 of everything before it (u32). The body is the list
+ * of fields, each a u32 length followed by the bytes: name, password, category, website and login for
+ * a password set, the name or the category alone for a tombstone. If the record has a nonce, it follows
+ * as one more field.
+ *
+ * \param out The buffer to append to.
+ * \param record The block to serialize.
+ */
+void encodeBinaryRecord(std::string& out, const RecordView& record) {
+
+    std::size_t start = out.size();
+    out.push_back(static_cast<char>(record.kind));
+    putU32(out, 0);
+
+    auto putField = [&out](std::string_view field) {
+        putU32(out, static_cast<std::uint32_t>(field.size()));
+        out.append(field.data(), field.size());
+    };
+
+    if (record.kind == RecordKind::Entry) {
+        putField(record.name);
+        putField(record.password);
+        putField(record.category);
+        putField(record.website);
+        putField(record.login);
+    } else if (record.kind == RecordKind::NameTombstone) {
+        putField(record.name);
+    } else {
+        putField(record.category);
+    }
+    if (!record.nonce.empty()) {
+        putField(record.nonce);
+    }
+
+    std::uint32_t bodyLength = static_cast<std::uint32_t>(out.size() - start - 5);
+    for (int i = 0; i < 4; i++) {
+        out[start + 1 + i] = static_cast<char>((bodyLength >> (8 * i)) & 0xff);
+    }
+    putU32(out, crc32(std::string_view(out).substr(start)));
+}
+
+
+/**
+ * \brief Walks over the blocks of a binary vault, header excluded.
+ *
+ * Parsing is a bounded walk over length prefixes; no field is ever searched for. The walk stops at the
+ * first block that is cut short, has an unknown kind, has fields that do not add up to its body length
+ * or fails its checksum. Everything from there on is treated as a torn write and ignored.
+ *
+ * \param records The bytes following the header.
+ * \param visit Called with a RecordView for every valid block, in file order.
+ * \param verifyChecksums Whether to check the CRC of every block; only skip it for bytes already verified.
+ * \return The number of bytes that hold valid blocks.
+ */
+template <typename Visitor>
+std::size_t forEachBinaryRecord(std::string_view records, Visitor&& visit, bool verifyChecksums = true) {
+
+    std::size_t offset = 0;
+
+    while (records.size() - offset >= 9) {
+
+        const char* block = records.data() + offset;
+        auto kind = static_cast<unsigned char>(block[0]);
+        std::uint32_t bodyLength = getU32(block + 1);
+
+        if (kind > static_cast<unsigned char>(RecordKind::CategoryTombstone)
+            || bodyLength > records.size() - offset - 9) {
+            break;
+        }
+        if (verifyChecksums && crc32(std::string_view(block, 5 + bodyLength)) != getU32(block + 5 + bodyLength)) {
+            break;
+        }
+
+        std::string_view body(block + 5, bodyLength);
+        std::string_view fields[6];
+        std::size_t wanted = kind == static_cast<unsigned char>(RecordKind::Entry) ? 5 : 1;
+        std::size_t count = 0;
+
+        while (count <= wanted && body.size() >= 4) {
+            std::uint32_t length = getU32(body.data());
+            if (length > body.size() - 4) {
+                break;
+            }
+            fields[count++] = body.substr(4, length);
+            body.remove_prefix(4 + length);
+        }
+        if (count < wanted || !body.empty()) {
+            break;
+        }
+
+        RecordView record;
+        record.kind = static_cast<RecordKind>(kind);
+        if (record.kind == RecordKind::Entry) {
+            record.name = fields[0];
+            record.password = fields[1];
+            record.category = fields[2];
+            record.website = fields[3];
+            record.login = fields[4];
+        } else if (record.kind == RecordKind::NameTombstone) {
+            record.name = fields[0];
+        } else {
+            record.category = fields[0];
+        }
+        if (count > wanted) {
+            record.nonce = fields[wanted];
+        }
+
+        visit(record);
+        offset += 9 + bodyLength;
+    }
+
+    return offset;
+}
+
+
+/// \brief The size of the header of a binary vault buffer, as stored in the header itself.
+std::size_t headerSize(std::string_view buffer) {
+    std::size_t size = getU16(buffer.data() + 6);
+    return std::min(std::max<std::size_t>(size, 8), buffer.size());
+}
+
+
+/**
+ * \brief Walks over all blocks stored in a vault buffer of either format.
+ *
+ * \param buffer The raw vault contents.
+ * \param visit Called with a RecordView for every block, in file order.
+ *
+ * \see forEachTextRecord()
+ * \see forEachBinaryRecord()
+ */
+template <typename Visitor>
+void forEachRecord(std::string_view buffer, Visitor&& visit) {
+    if (detectFormat(buffer) == VaultFormat::Binary) {
+        forEachBinaryRecord(buffer.substr(headerSize(buffer)), visit);
+    } else {
+        forEachTextRecord(buffer, visit);
+    }
+}
+
+
+/**
+ * \brief Builds an index of all blocks stored in a vault buffer, tombstones included.
+ *
+ * \param buffer The raw vault contents.
+ * \return A vector of RecordView objects pointing into the buffer.
+ *
+ * \see forEachRecord()
+ */
+std::vector<RecordView> indexRecords(std::string_view buffer) {
+
+    std::vector<RecordView> records;
+    forEachRecord(buffer, [&records](const RecordView& record) {
+        records.push_back(record);
+    });
+    return records;
+}
+
+
+/**
+ * \brief Checks a master password against an existing vault and derives the vault key.
+ *
+ * Text vaults have no key, so for them the password is checked against mainPassword and the key stays
+ * empty. Version 2 headers carry a verifier of the key. Version 1 headers have none: with the shift
+ * cipher, which has no key either, the password is checked against mainPassword as for text vaults;
+ * with an authenticated cipher the first sealed name must open under the key, so a version 1 vault
+ * without password sets is refused, since nothing could tell a wrong password apart.
+ *
+ * \param buffer The raw vault contents; must not be empty.
+ * \param masterPassword The password typed in at start-up.
+ * \param header Receives the header of a binary vault.
+ * \param vaultKey Receives the derived key of a binary vault.
+ * \return True if the vault may be opened with the password.
+ */
+bool checkMasterPassword(std::string_view buffer, const std::string& masterPassword, VaultHeader& header,
+                         std::string& vaultKey) {
+
+    if (detectFormat(buffer) == VaultFormat::Text) {
+        return masterPassword == mainPassword;
+    }
+
+    if (!decodeHeader(buffer, header) || makeCipher(header.cipherId, {}) == nullptr) {
+        return false;
+    }
+    vaultKey = deriveVaultKey(masterPassword, header);
+    if (header.kdf != VaultHeader::Sha256Only) {
+        return equalSecrets(keyVerifier(vaultKey), header.verifier);
+    }
+
+    if (header.cipherId == 0) {
+        return masterPassword == mainPassword;
+    }
+    std::unique_ptr<FieldCipher> candidate = makeCipher(header.cipherId, vaultKey);
+    std::string plain;
+    bool checked = false;
+    bool unlocked = false;
+    forEachBinaryRecord(buffer.substr(headerSize(buffer)), [&](const RecordView& record) {
+        if (!checked && !record.name.empty()) {
+            plain.resize(record.name.size());
+            unlocked = candidate->openInto(record.name, record.nonce, Field::Name, plain.data()) >= 0;
+            checked = true;
+        }
+    });
+    return unlocked;
+}
+
+
+
+
+/// Write points still to pass before runCrashTest() kills the process, or -1 outside of a crash test.
+std::atomic<long> crashCountdown{-1};
+
+/// Exit code of a process killed by crashPoint().
+constexpr int crashExitCode = 86;
+
+/**
+ * \brief Marks a point between two steps of a file update where a crash test may kill the process.
+ *
+ * Every step that reaches the disk, a write, an fsync, a truncation or a rename, is followed by one.
+ * Outside of a crash test this is a single atomic load.
+ */
+void crashPoint() {
+    if (crashCountdown.load(std::memory_order_relaxed) >= 0 && crashCountdown.fetch_sub(1) == 0) {
+        ::_exit(crashExitCode);
+    }
+}
+
+
+/**
+ * \brief Writes a whole buffer to a file descriptor, retrying short and interrupted writes.
+ *
+ * During a crash test the buffer goes out in two halves with a crash point between them, so torn writes
+ * get tested too.
+ *
+ * \return True if every byte was written.
+ */
+bool writeAll(int fd, std::string_view bytes) {
+
+    std::size_t tear = crashCountdown.load(std::memory_order_relaxed) >= 0 ? bytes.size() / 2 : 0;
+
+    while (!bytes.empty()) {
+        std::size_t chunk = tear > 0 ? tear : bytes.size();
+        ssize_t written = ::write(fd, bytes.data(), chunk);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes.remove_prefix(static_cast<std::size_t>(written));
+        PM_COUNT(BytesWritten, written);
+        if (tear > 0) {
+            tear -= static_cast<std::size_t>(written);
+            if (tear == 0) {
+                crashPoint();
+            }
+        }
+    }
+    return true;
+}
+
+
+/**
+ * \brief Makes a rename or a newly created file in the directory of a file survive a power loss.
+ *
+ * \param fileName A file in the directory to sync.
+ */
+bool syncDirectoryOf(const std::string& fileName) {
+
+    std::size_t slash = fileName.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : fileName.substr(0, slash);
+
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+
+/**
+ * \brief Replaces a file so that a crash leaves either the old contents or the new ones, never a mix.
+ *
+ * The new contents go to fileName.new, which is synced and then renamed over the file. The rename is
+ * atomic, and syncing the directory afterwards makes it durable.
+ *
+ * \param fileName The file to replace or create.
+ * \param write Writes the new contents to the file descriptor it is given; returns false on failure.
+ * \return True if the file now holds the new contents.
+ */
+bool replaceFile(const std::string& fileName, const std::function<bool(int)>& write) {
+
+    std::string replacement = fileName + ".new";
+    int fd = ::open(replacement.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = write(fd) && ::fsync(fd) == 0;
+    ::close(fd);
+    crashPoint();
+
+    if (!written || ::rename(replacement.c_str(), fileName.c_str()) != 0) {
+        std::remove(replacement.c_str());
+        return false;
+    }
+    crashPoint();
+    return syncDirectoryOf(fileName);
+}
+
+
+/**
+ * \class VaultLock
+ * \brief An advisory lock on a vault file, so processes sharing a vault never write it at the same time.
+ *
+ * The lock is taken with flock() on the vault file itself: exclusive while the vault or its journal is
+ * written, cut back or replaced, shared while it is read. A compacted file renamed over the vault is a
+ * different file, so after every wait the lock checks that it still holds the file the name refers to,
+ * and starts over on the new one if not. Locks are released when the object goes away.
+ *
+ * Two locks of the same process conflict like those of two processes, so locks must not be nested.
+ */
+class VaultLock {
+
+private:
+    std::string fileName;
+    int operation;
+    int fd = -1;
+
+public:
+    /**
+     * \param fileName The vault file. If it does not exist yet, no lock is held; see acquire().
+     * \param operation LOCK_EX or LOCK_SH.
+     */
+    VaultLock(std::string fileName, int operation) : fileName(std::move(fileName)), operation(operation) {
+        acquire();
+    }
+
+    ~VaultLock() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    VaultLock(const VaultLock&) = delete;
+    VaultLock& operator=(const VaultLock&) = delete;
+
+    /// \brief Takes the lock, waiting for other holders; call it again once a missing vault was created.
+    void acquire() {
+        while (fd < 0) {
+            fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            struct stat locked{};
+            struct stat current{};
+            int result;
+            while ((result = ::flock(fd, operation)) != 0 && errno == EINTR) {
+            }
+            if (result != 0 || (::fstat(fd, &locked) == 0 && ::stat(fileName.c_str(), &current) == 0
+                                && (locked.st_ino != current.st_ino || locked.st_dev != current.st_dev))) {
+                ::close(fd);
+                fd = -1;
+                if (result != 0) {
+                    return;
+                }
+            }
+        }
+    }
+
+    /// \brief Whether the lock is held.
+    bool held() const {
+        return fd >= 0;
+    }
+};
+
+
+/**
+ * \class VaultWatcher
+ * \brief Tells when a vault file may have been changed, by this process or another one.
+ *
+ * On Linux the directory of the vault is watched with inotify, which reports appends to the vault as
+ * well as a compacted file renamed over it. Where inotify is missing, or with -DPM_USE_STAT_POLL, every
+ * check reports a possible change, and the caller's comparison with the file as it was loaded becomes a
+ * stat() poll. Either way the watcher only says when to look; what changed is up to the caller.
+ */
+class VaultWatcher {
+
+private:
+    int fd = -1;
+    std::string name;
+    bool pending = true;
+
+public:
+    explicit VaultWatcher(const std::string& fileName) {
+
+        std::size_t slash = fileName.rfind('/');
+        name = slash == std::string::npos ? fileName : fileName.substr(slash + 1);
+#ifdef PM_HAVE_INOTIFY
+        std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : fileName.substr(0, slash);
+        fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0 && ::inotify_add_watch(fd, directory.c_str(),
+                                           IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_DELETE) < 0) {
+            ::close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+    ~VaultWatcher() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    VaultWatcher(const VaultWatcher&) = delete;
+    VaultWatcher& operator=(const VaultWatcher&) = delete;
+
+    /// \brief The descriptor that turns readable on a change, for an event loop; -1 when polling.
+    int descriptor() const {
+        return fd;
+    }
+
+    /// \brief Whether the vault may have changed since the last call to settle().
+    bool mayHaveChanged() {
+#ifdef PM_HAVE_INOTIFY
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while (fd >= 0 && (length = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t at = 0; at < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + at);
+                pending = pending || (event->mask & IN_Q_OVERFLOW) != 0
+                          || (event->len > 0 && name == event->name);
+                at += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+        }
+#endif
+        return pending || fd < 0;
+    }
+
+    /// \brief Forgets the changes seen so far, once the caller has caught up with them.
+    void settle() {
+        pending = false;
+    }
+};
+
+
+/**
+ * \brief The write-ahead journal of a vault, a file next to it that makes a group of appended blocks
+ * all-or-nothing.
+ *
+ * Before a group of blocks is appended to the vault it is written here and synced, together with the
+ * length the vault had before the append. Only then is it appended to the vault. Once the vault is synced
+ * the journal is emptied again. If a crash cuts in, recoverJournal() finds one of two things on the next
+ * start:
+ *
+ * - an incomplete journal, which means the vault hasn't been touched yet, so the journal is dropped;
+ * - a complete one, which means the group may be partly in the vault, so the vault is cut back to its old
+ *   length and the whole group is appended again.
+ *
+ * Emptying the journal is not synced: a journal that survives a crash after its group reached the vault
+ * is simply applied again, which changes nothing. A journal is never applied to a vault that has grown
+ * past the end of its group, and it is emptied and synced before a compacted vault is renamed in.
+ *
+ * A journal with an empty group marks a bulk append too large to be journaled, see importVault(). Its
+ * group ends wherever the vault does, so applying it cuts the vault back to its old length and undoes
+ * the whole append.
+ *
+ * Layout: "PMWAL001", the old vault length (u64), the group length (u64), the group and the CRC-32 of
+ * everything before it (u32).
+ */
+namespace journal {
+
+constexpr std::string_view magic = "PMWAL001";
+constexpr std::size_t headerSize = 24;
+
+/// \brief The journal file of a vault.
+std::string fileOf(const std::string& vaultFile) {
+    return vaultFile + ".wal";
+}
+
+std::string encode(std::uint64_t vaultLength, std::string_view group) {
+
+    std::string record(magic);
+    for (std::uint64_t value : {vaultLength, static_cast<std::uint64_t>(group.size())}) {
+        for (int i = 0; i < 8; i++) {
+            record.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+    record.append(group.data(), group.size());
+    putU32(record, crc32(record));
+    return record;
+}
+
+/**
+ * \brief Reads a complete journal.
+ *
+ * \return False if the journal is empty, torn or not a journal.
+ */
+bool decode(std::string_view buffer, std::uint64_t& vaultLength, std::string_view& group) {
+
+    if (buffer.size() < headerSize + 4 || buffer.substr(0, magic.size()) != magic) {
+        return false;
+    }
+    auto getU64 = [&buffer](std::size_t at) {
+        std::uint64_t value = 0;
+        for (int i = 0; i < 8; i++) {
+            value |= static_cast<std::uint64_t>(static_cast<unsigned char>(buffer[at + i])) << (8 * i);
+        }
+        return value;
+    };
+    vaultLength = getU64(8);
+    std::uint64_t length = getU64(16);
+    if (length > buffer.size() - headerSize - 4) {
+        return false;
+    }
+    std::size_t end = headerSize + static_cast<std::size_t>(length);
+    if (crc32(buffer.substr(0, end)) != getU32(buffer.data() + end)) {
+        return false;
+    }
+    group = buffer.substr(headerSize, end - headerSize);
+    return true;
+}
+
+} // namespace journal
+
+
+/**
+ * \brief The index sidecar of a vault, a file next to it that lets the next start skip the index rebuild.
+ *
+ * It holds the name hashes, the category posting lists and the alphabetic order, numbered the way the
+ * next load numbers the password sets: live ones in file order. It also lists the block position of
+ * every live password set, so that load needs neither the tombstone pass nor any decryption.
+ *
+ * The sidecar is only a cache. It is written when a vault is closed, and it is trusted only while the
+ * vault still has the identity recorded in it: the same file, length and modification time, and the same
+ * last few kilobytes. Any change to the vault therefore means a full load and rebuild, and a new sidecar
+ * once the vault is closed again. The indexes hold decrypted names and categories, so they are sealed
+ * with the vault cipher under a nonce of their own.
+ *
+ * Layout: "PMIDX001", the vault identity (device, inode, length and modification time in nanoseconds as
+ * u64, the CRC-32 of the vault tail as u32), the nonce length (u8) and the nonce, the sealed length (u64)
+ * and the sealed indexes, and the CRC-32 of everything before it (u32).
+ */
+namespace sidecar {
+
+constexpr std::string_view magic = "PMIDX001";
+constexpr std::size_t tailSize = 4096;
+
+/// \brief The sidecar file of a vault.
+std::string fileOf(const std::string& vaultFile) {
+    return vaultFile + ".idx";
+}
+
+void putU64(std::string& out, std::uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+std::uint64_t getU64(const char* data) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+/// \brief What tells one state of a vault file from any other.
+struct Identity {
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t length = 0;
+    std::uint64_t modified = 0;
+    std::uint32_t tail = 0;
+
+    bool operator==(const Identity& other) const {
+        return device == other.device && inode == other.inode && length == other.length
+               && modified == other.modified && tail == other.tail;
+    }
+};
+
+/**
+ * \brief Reads the identity of a vault file as it is now.
+ *
+ * A rename of a compacted file changes the inode and an append changes the length. The checksum of the
+ * tail catches a vault cut back and grown again to the same length within one tick of the clock.
+ *
+ * \return False if the file can't be read.
+ */
+bool identify(const std::string& vaultFile, Identity& identity) {
+
+    int fd = ::open(vaultFile.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info{};
+    bool read = ::fstat(fd, &info) == 0;
+    std::string tail(read ? std::min<std::size_t>(tailSize, static_cast<std::size_t>(info.st_size)) : 0, '\0');
+    read = read && ::pread(fd, tail.data(), tail.size(), info.st_size - static_cast<off_t>(tail.size()))
+                       == static_cast<ssize_t>(tail.size());
+    ::close(fd);
+    if (!read) {
+        return false;
+    }
+
+    identity.device = static_cast<std::uint64_t>(info.st_dev);
+    identity.inode = static_cast<std::uint64_t>(info.st_ino);
+    identity.length = static_cast<std::uint64_t>(info.st_size);
+    identity.modified = static_cast<std::uint64_t>(info.st_mtim.tv_sec) * 1000000000ULL
+                        + static_cast<std::uint64_t>(info.st_mtim.tv_nsec);
+    identity.tail = crc32(tail);
+    return true;
+}
+
+/**
+ * \struct Indexes
+ * \brief The indexes of a vault as kept in its sidecar.
+ *
+ * Record i is the i-th live password set in file order, which is the id the next load gives it.
+ */
+struct Indexes {
+    std::uint64_t validBytes = 0;
+    std::uint64_t fileBlocks = 0;
+    /// The block position of every record in the vault, ascending.
+    std::vector<std::uint32_t> blocks;
+    /// NameIndex::hashName() of every name.
+    std::vector<std::uint64_t> hashes;
+    /// Name i is names[nameOffsets[i], nameOffsets[i + 1]).
+    std::vector<std::uint32_t> nameOffsets;
+    std::string names;
+    /// The records sorted by name, ties by record.
+    std::vector<std::uint32_t> order;
+    std::vector<std::string> categories;
+    /// The records of every category, ascending.
+    std::vector<std::vector<std::uint32_t>> postings;
+    /// The category of every record; not stored, but filled in by decodeIndexes().
+    std::vector<std::uint32_t> categoryOf;
+
+    std::string_view name(std::size_t record) const {
+        return std::string_view(names).substr(nameOffsets[record], nameOffsets[record + 1] - nameOffsets[record]);
+    }
+};
+
+/**
+ * \brief Serializes the indexes, before they are sealed.
+ *
+ * Layout: validBytes and fileBlocks (u64), the record and category counts (u32), then per record the
+ * block position (u32), the name hash (u64) and the name offset (u32), one more offset, the names, the
+ * order (u32 per record) and per category the length of its name (u32), the name, the length of its
+ * posting list (u32) and the list.
+ */
+std::string encodeIndexes(const Indexes& indexes) {
+
+    std::size_t records = indexes.blocks.size();
+    std::string payload;
+    payload.reserve(24 + records * 24 + indexes.names.size() + indexes.categories.size() * 16);
+    putU64(payload, indexes.validBytes);
+    putU64(payload, indexes.fileBlocks);
+    putU32(payload, static_cast<std::uint32_t>(records));
+    putU32(payload, static_cast<std::uint32_t>(indexes.categories.size()));
+    for (std::uint32_t block : indexes.blocks) {
+        putU32(payload, block);
+    }
+    for (std::uint64_t hash : indexes.hashes) {
+        putU64(payload, hash);
+    }
+    for (std::uint32_t offset : indexes.nameOffsets) {
+        putU32(payload, offset);
+    }
+    payload += indexes.names;
+    for (std::uint32_t record : indexes.order) {
+        putU32(payload, record);
+    }
+    for (std::size_t c = 0; c < indexes.categories.size(); c++) {
+        putU32(payload, static_cast<std::uint32_t>(indexes.categories[c].size()));
+        payload += indexes.categories[c];
+        putU32(payload, static_cast<std::uint32_t>(indexes.postings[c].size()));
+        for (std::uint32_t record : indexes.postings[c]) {
+            putU32(payload, record);
+        }
+    }
+    return payload;
+}
+
+/**
+ * \brief Reads indexes written by encodeIndexes().
+ *
+ * Everything the loader and the indexes rely on is checked: positions ascending, offsets and records in
+ * range, the order a permutation and every record in exactly one category.
+ *
+ * \return False if the indexes are malformed.
+ */
+bool decodeIndexes(std::string_view payload, Indexes& indexes) {
+
+    std::size_t at = 0;
+    bool intact = true;
+    auto take = [&](std::size_t length) {
+        if (!intact || payload.size() - at < length) {
+            intact = false;
+            return std::string_view();
+        }
+        at += length;
+        return payload.substr(at - length, length);
+    };
+    auto takeU32 = [&]() {
+        std::string_view bytes = take(4);
+        return intact ? getU32(bytes.data()) : 0;
+    };
+    auto takeU64 = [&]() {
+        std::string_view bytes = take(8);
+        return intact ? getU64(bytes.data()) : 0;
+    };
+
+    indexes.validBytes = takeU64();
+    indexes.fileBlocks = takeU64();
+    std::size_t records = takeU32();
+    std::size_t categories = takeU32();
+    // Every record takes at least 20 bytes and every category 8, so nothing below allocates more than
+    // the payload justifies.
+    if (!intact || records > payload.size() / 20 || categories > payload.size() / 8) {
+        return false;
+    }
+
+    indexes.blocks.resize(records);
+    indexes.hashes.resize(records);
+    indexes.nameOffsets.resize(records + 1);
+    indexes.order.resize(records);
+    for (std::uint32_t& block : indexes.blocks) {
+        block = takeU32();
+    }
+    for (std::uint64_t& hash : indexes.hashes) {
+        hash = takeU64();
+    }
+    for (std::uint32_t& offset : indexes.nameOffsets) {
+        offset = takeU32();
+    }
+    indexes.names = std::string(take(indexes.nameOffsets.back()));
+    for (std::uint32_t& record : indexes.order) {
+        record = takeU32();
+    }
+    if (!intact || indexes.nameOffsets[0] != 0) {
+        return false;
+    }
+
+    std::vector<bool> seen(records);
+    for (std::size_t i = 0; i < records; i++) {
+        if ((i > 0 && indexes.blocks[i] <= indexes.blocks[i - 1]) || indexes.blocks[i] >= indexes.fileBlocks
+            || indexes.nameOffsets[i + 1] < indexes.nameOffsets[i] || indexes.order[i] >= records
+            || seen[indexes.order[i]]) {
+            return false;
+        }
+        seen[indexes.order[i]] = true;
+    }
+
+    indexes.categories.resize(categories);
+    indexes.postings.resize(categories);
+    indexes.categoryOf.assign(records, UINT32_MAX);
+    for (std::size_t c = 0; c < categories && intact; c++) {
+        indexes.categories[c] = std::string(take(takeU32()));
+        std::size_t members = takeU32();
+        if (!intact || members > (payload.size() - at) / 4) {
+            return false;
+        }
+        indexes.postings[c].resize(members);
+        for (std::uint32_t& record : indexes.postings[c]) {
+            record = takeU32();
+            if (record >= records || indexes.categoryOf[record] != UINT32_MAX) {
+                return false;
+            }
+            indexes.categoryOf[record] = static_cast<std::uint32_t>(c);
+        }
+    }
+    return intact && at == payload.size()
+           && std::find(indexes.categoryOf.begin(), indexes.categoryOf.end(), UINT32_MAX) == indexes.categoryOf.end();
+}
+
+std::string encode(const Identity& identity, std::string_view nonce, std::string_view sealed) {
+
+    std::string file(magic);
+    for (std::uint64_t value : {identity.device, identity.inode, identity.length, identity.modified}) {
+        putU64(file, value);
+    }
+    putU32(file, identity.tail);
+    file.push_back(static_cast<char>(nonce.size()));
+    file.append(nonce.data(), nonce.size());
+    putU64(file, sealed.size());
+    file.append(sealed.data(), sealed.size());
+    putU32(file, crc32(file));
+    return file;
+}
+
+/**
+ * \brief Reads a complete sidecar file.
+ *
+ * \return False if the file is empty, torn or not a sidecar.
+ */
+bool decode(std::string_view buffer, Identity& identity, std::string_view& nonce, std::string_view& sealed) {
+
+    constexpr std::size_t fixed = 8 + 4 * 8 + 4 + 1;
+    if (buffer.size() < fixed + 8 + 4 || buffer.substr(0, magic.size()) != magic
+        || crc32(buffer.substr(0, buffer.size() - 4)) != getU32(buffer.data() + buffer.size() - 4)) {
+        return false;
+    }
+    identity.device = getU64(buffer.data() + 8);
+    identity.inode = getU64(buffer.data() + 16);
+    identity.length = getU64(buffer.data() + 24);
+    identity.modified = getU64(buffer.data() + 32);
+    identity.tail = getU32(buffer.data() + 40);
+
+    std::size_t nonceLength = static_cast<unsigned char>(buffer[44]);
+    if (buffer.size() < fixed + nonceLength + 8 + 4) {
+        return false;
+    }
+    nonce = buffer.substr(fixed, nonceLength);
+    std::uint64_t length = getU64(buffer.data() + fixed + nonceLength);
+    std::size_t start = fixed + nonceLength + 8;
+    if (length != buffer.size() - start - 4) {
+        return false;
+    }
+    sealed = buffer.substr(start, static_cast<std::size_t>(length));
+    return true;
+}
+
+} // namespace sidecar
+
+
+/// What recoverJournal() found next to a vault.
+enum class Recovery : std::uint8_t {Clean, Discarded, Replayed, Failed};
+
+/**
+ * \brief Applies or drops the journal of a vault left by a crash, see the journal namespace.
+ *
+ * The caller holds the exclusive VaultLock. Writers empty the journal before they let go of the lock,
+ * so a journal found under it was always left by a crash, whichever process it came from.
+ *
+ * \param vaultFile The vault file.
+ * \return What was done.
+ */
+Recovery replayJournal(const std::string& vaultFile) {
+
+    std::string journalFile = journal::fileOf(vaultFile);
+    std::string contents;
+    {
+        MappedFile mapped(journalFile);
+        contents = std::string(mapped.view());
+    }
+    if (contents.empty()) {
+        return Recovery::Clean;
+    }
+
+    std::uint64_t vaultLength = 0;
+    std::string_view group;
+    struct stat info{};
+    bool replay = journal::decode(contents, vaultLength, group) && ::stat(vaultFile.c_str(), &info) == 0
+                  && static_cast<std::uint64_t>(info.st_size) >= vaultLength
+                  && (group.empty() || static_cast<std::uint64_t>(info.st_size) <= vaultLength + group.size());
+
+    if (replay) {
+        int fd = ::open(vaultFile.c_str(), O_WRONLY);
+        bool replayed = fd >= 0 && ::ftruncate(fd, static_cast<off_t>(vaultLength)) == 0
+                        && ::lseek(fd, 0, SEEK_END) >= 0 && writeAll(fd, group) && ::fsync(fd) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!replayed) {
+            return Recovery::Failed;
+        }
+        crashPoint();
+    }
+
+    int fd = ::open(journalFile.c_str(), O_WRONLY | O_TRUNC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+    crashPoint();
+    return replay ? Recovery::Replayed : Recovery::Discarded;
+}
+
+/**
+ * \brief Brings a vault back to a consistent state after a crash, see replayJournal().
+ *
+ * Leftovers of a replacement, a compaction or a sidecar that never got renamed in are removed as well;
+ * the files they were meant to replace are still intact.
+ *
+ * \param vaultFile The vault file.
+ * \return What was done.
+ */
+Recovery recoverJournal(const std::string& vaultFile) {
+
+    std::remove((vaultFile + ".new").c_str());
+    std::remove((vaultFile + ".compact").c_str());
+    std::remove((sidecar::fileOf(vaultFile) + ".new").c_str());
+    return replayJournal(vaultFile);
+}
+
+
+
+/**
+ * \brief Converts a text vault into a binary one.
+ *
+ * Every block, tombstones included, is carried over one to one, so the converted vault holds exactly the
+ * same password sets. Each field is decrypted with the shift cipher of the text vault and sealed again
+ * with ChaCha20-Poly1305 under a fresh record nonce.
+ *
+ * \param legacyFile The text vault to read.
+ * \param binaryFile The binary vault to write. It is replaced atomically, see replaceFile().
+ * \param masterPassword The master password the binary vault will be opened with.
+ * \param iterations The PBKDF2 iteration count of the binary vault.
+ * \return The number of blocks converted, or -1 if the source is not a text vault or the target can't be written.
+ */
+long convertVault(const std::string& legacyFile, const std::string& binaryFile, const std::string& masterPassword,
+                  std::uint32_t iterations) {
+
+    MappedFile source(legacyFile);
+    if (detectFormat(source.view()) != VaultFormat::Text) {
+        return -1;
+    }
+
+    ShiftCipher legacyCipher;
+    std::string vaultKey;
+    VaultHeader header = makeVaultHeader(masterPassword, iterations, vaultKey);
+    ChaCha20Poly1305Cipher cipher(vaultKey);
+
+    long blocks = 0;
+    bool converted = replaceFile(binaryFile, [&](int target) {
+
+        std::string buffer = encodeHeader(header);
+        bool written = true;
+
+        forEachTextRecord(source.view(), [&](const RecordView& record) {
+
+            PasswordData sealed;
+            sealed.nonce = cipher.makeNonce();
+            auto reseal = [&](std::string_view field, Field which) {
+                sealed.field(which) = cipher.seal(legacyCipher.open(field, {}, which), sealed.nonce, which);
+            };
+
+            if (record.kind == RecordKind::Entry) {
+                reseal(record.name, Field::Name);
+                reseal(record.password, Field::Password);
+                reseal(record.category, Field::Category);
+                reseal(record.website, Field::Website);
+                reseal(record.login, Field::Login);
+            } else if (record.kind == RecordKind::NameTombstone) {
+                reseal(record.name, Field::Name);
+            } else {
+                reseal(record.category, Field::Category);
+            }
+
+            RecordView view = viewOf(sealed);
+            view.kind = record.kind;
+            encodeBinaryRecord(buffer, view);
+            blocks++;
+
+            if (buffer.size() >= (1 << 20)) {
+                written = written && writeAll(target, buffer);
+                buffer.clear();
+            }
+        });
+        return written && writeAll(target, buffer);
+    });
+
+    return converted ? blocks : -1;
+}
+
+
+
+
+/**
+ * \class ThreadPool
+ * \brief A fixed set of worker threads for splitting a loop over many cores.
+ *
+ * The pool is sized in threads, the calling thread included, so a pool of one thread starts no workers
+ * at all and runs everything inline. The workers are started once and sleep between jobs.
+ */
+class ThreadPool {
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    /// \param threads The number of threads to run on, the calling one included; 0 means one per core.
+    explicit ThreadPool(std::size_t threads = 0) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (std::size_t i = 1; i < threads; i++) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// \brief The number of threads a job runs on, the calling one included.
+    std::size_t size() const {
+        return workers.size() + 1;
+    }
+
+    /**
+     * \brief Queues a task for the next free worker thread and returns right away.
+     *
+     * Unlike parallelFor() the calling thread does not help, so a pool of one thread never runs the task.
+     */
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * \brief Runs task(i) for every i in [0, count) and returns once all of them have finished.
+     *
+     * The indexes are handed out one by one to whichever thread is free, so the tasks should be coarse,
+     * e.g. one chunk of a vault each. The calling thread works along.
+     */
+    template <typename Task>
+    void parallelFor(std::size_t count, Task&& task) {
+
+        std::size_t helpers = std::min(workers.size(), count > 0 ? count - 1 : 0);
+        if (helpers == 0) {
+            for (std::size_t i = 0; i < count; i++) {
+                task(i);
+            }
+            return;
+        }
+
+        std::atomic<std::size_t> next{0};
+        std::size_t finished = 0;
+        std::condition_variable done;
+
+        auto drain = [&]() {
+            for (std::size_t i = next++; i < count; i = next++) {
+                task(i);
+            }
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::size_t i = 0; i < helpers; i++) {
+                tasks.emplace_back([&]() {
+                    drain();
+                    std::lock_guard<std::mutex> finishLock(mutex);
+                    finished++;
+                    done.notify_one();
+                });
+            }
+        }
+        wake.notify_all();
+
+        drain();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return finished == helpers; });
+    }
+};
+
+
+/**
+ * \struct RecordChunk
+ * \brief A run of whole blocks of a vault buffer that can be parsed independently of the others.
+ */
+struct RecordChunk {
+    std::string_view bytes;
+
+    /// Position of the first block of the chunk in the whole file, counting from 0.
+    std::size_t firstBlock = 0;
+};
+
+
+/**
+ * \brief Cuts the blocks of a vault into chunks of roughly equal size at block boundaries.
+ *
+ * Only the block boundaries are looked at: a binary vault is walked by its length prefixes alone, with no
+ * checksum or field parsing, and a text vault by its lines. Either walk is much cheaper than parsing the
+ * blocks, which is left to whoever processes the chunks. A binary chunk may still hold a broken block,
+ * and then its parser has to stop there, as forEachBinaryRecord() does.
+ *
+ * \param records The bytes following the header.
+ * \param format The layout of the vault.
+ * \param count The number of chunks wanted; fewer come back if the vault is small.
+ */
+std::vector<RecordChunk> splitRecords(std::string_view records, VaultFormat format, std::size_t count) {
+
+    std::vector<RecordChunk> chunks;
+    std::size_t target = std::max<std::size_t>(records.size() / std::max<std::size_t>(count, 1), 1);
+    std::size_t chunkStart = 0;
+    std::size_t firstBlock = 0;
+    std::size_t blocks = 0;
+
+    auto cutAfter = [&](std::size_t blockEnd) {
+        blocks++;
+        if (blockEnd - chunkStart >= target) {
+            chunks.push_back({records.substr(chunkStart, blockEnd - chunkStart), firstBlock});
+            chunkStart = blockEnd;
+            firstBlock = blocks;
+        }
+    };
+
+    if (format == VaultFormat::Binary) {
+        std::size_t offset = 0;
+        while (records.size() - offset >= 9) {
+            std::uint32_t bodyLength = getU32(records.data() + offset + 1);
+            if (bodyLength > records.size() - offset - 9) {
+                break;
+            }
+            offset += 9 + bodyLength;
+            cutAfter(offset);
+        }
+    } else {
+        forEachTextRecord(records, [&](const RecordView& record) {
+            std::string_view last = record.kind == RecordKind::Entry ? record.login
+                                    : record.kind == RecordKind::NameTombstone ? record.name : record.category;
+            // A block cut short by the end of the buffer is the last one anyway.
+            if (last.data() != nullptr) {
+                cutAfter(std::min<std::size_t>(last.data() + last.size() + 1 - records.data(), records.size()));
+            }
+        });
+    }
+
+    if (chunkStart < records.size()) {
+        chunks.push_back({records.substr(chunkStart), firstBlock});
+    }
+    return chunks;
+}
+
+
+
+/**
+ * \brief Appends base + i to out for every values[i] equal to wanted, one value at a time.
+ *
+ * This is the reference kernel behind the column scans of RecordStore, used wherever no vector kernel
+ * is available and for the tail the vector kernels leave over.
+ */
+void matchU32Scalar(const std::uint32_t* values, std::size_t count, std::uint32_t wanted, std::uint32_t base,
+                    std::vector<std::uint32_t>& out) {
+    for (std::size_t i = 0; i < count; i++) {
+        if (values[i] == wanted) {
+            out.push_back(base + static_cast<std::uint32_t>(i));
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/// \brief SSE2 version of matchU32Scalar(), 4 values per step.
+__attribute__((target("sse2")))
+void matchU32Sse2(const std::uint32_t* values, std::size_t count, std::uint32_t wanted, std::uint32_t base,
+                  std::vector<std::uint32_t>& out) {
+    const __m128i key = _mm_set1_epi32(static_cast<int>(wanted));
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block, key)));
+        for (; mask != 0; mask &= mask - 1) {
+            out.push_back(base + static_cast<std::uint32_t>(i + __builtin_ctz(mask)));
+        }
+    }
+    matchU32Scalar(values + i, count - i, wanted, base + static_cast<std::uint32_t>(i), out);
+}
+
+/// \brief AVX2 version of matchU32Scalar(), 8 values per step.
+__attribute__((target("avx2")))
+void matchU32Avx2(const std::uint32_t* values, std::size_t count, std::uint32_t wanted, std::uint32_t base,
+                  std::vector<std::uint32_t>& out) {
+    const __m256i key = _mm256_set1_epi32(static_cast<int>(wanted));
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block, key)));
+        for (; mask != 0; mask &= mask - 1) {
+            out.push_back(base + static_cast<std::uint32_t>(i + __builtin_ctz(mask)));
+        }
+    }
+    matchU32Scalar(values + i, count - i, wanted, base + static_cast<std::uint32_t>(i), out);
+}
+
+#endif
+
+using MatchKernel = void (*)(const std::uint32_t*, std::size_t, std::uint32_t, std::uint32_t,
+                             std::vector<std::uint32_t>&);
+
+/**
+ * \brief Picks the fastest 32-bit match kernel the CPU supports, the same way as shiftKernel().
+ */
+MatchKernel matchKernel() {
+    static const MatchKernel kernel = []() -> MatchKernel {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return matchU32Avx2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return matchU32Sse2;
+        }
+#endif
+        return matchU32Scalar;
+    }();
+    return kernel;
+}
+
+
+
+/**
+ * \class RecordStore
+ * \brief Holds the password sets of a vault under stable record ids.
+ *
+ * A record keeps its id for as long as it lives, which lets the search indexes refer to records by id.
+ * Erasing a record only clears its slot; the slots are squeezed out by compact(), which renumbers the
+ * remaining records in their original order.
+ *
+ * The records are stored column by column. Each sealed field, name, password, website, login and the
+ * nonce, is a Column of its own: the bytes of all records back to back, plus an array of starts and an
+ * array of lengths indexed by record id. A scan that needs one field only walks that field's memory,
+ * and a scan on lengths or category ids walks a plain array of 32-bit values, which matchKernel()
+ * compares several at a time. Storing a record allocates nothing of its own.
+ *
+ * Categories are few and repeat a lot, so they are not stored per record at all: each distinct
+ * category is interned once, in plaintext, and the category column only holds its small integer id.
+ * The category index keeps the same plaintext anyway, and it saves decrypting a category every time one
+ * is shown. Bytes of erased or replaced records stay in their columns until compact().
+ */
+class RecordStore {
+
+public:
+    using Id = std::uint32_t;
+    using CategoryId = std::uint32_t;
+
+private:
+    /// The sealed fields of a record, in the order name, password, website, login, nonce.
+    static constexpr std::size_t storedFields = 5;
+
+    struct Column {
+        std::string bytes;
+        std::vector<std::uint64_t> starts;
+        std::vector<std::uint32_t> lengths;
+
+        std::string_view at(Id id) const {
+            return std::string_view(bytes).substr(starts[id], lengths[id]);
+        }
+
+        void push(std::string_view field) {
+            starts.push_back(bytes.size());
+            lengths.push_back(static_cast<std::uint32_t>(field.size()));
+            bytes.append(field.data(), field.size());
+        }
+
+        void set(Id id, std::string_view field) {
+            starts[id] = bytes.size();
+            lengths[id] = static_cast<std::uint32_t>(field.size());
+            bytes.append(field.data(), field.size());
+        }
+    };
+
+    Column columns[storedFields];
+    std::vector<CategoryId> categories;
+    std::vector<bool> alive;
+    std::size_t liveCount = 0;
+    std::size_t deadBytes = 0;
+
+    /// A deque, so the views the lookup table keys on stay valid as categories are added.
+    std::deque<std::string> categoryNames;
+    std::unordered_map<std::string_view, CategoryId> categoryIds;
+
+    static std::size_t position(Field field) {
+        switch (field) {
+            case Field::Name: return 0;
+            case Field::Password: return 1;
+            case Field::Website: return 2;
+            default: return 3;
+        }
+    }
+
+    static std::array<std::string_view, storedFields> fieldsOf(const RecordView& sealed) {
+        return {sealed.name, sealed.password, sealed.website, sealed.login, sealed.nonce};
+    }
+
+    std::size_t sizeOf(Id id) const {
+        std::size_t size = 0;
+        for (const Column& column : columns) {
+            size += column.lengths[id];
+        }
+        return size;
+    }
+
+    /// \brief Keeps only the ids of live records.
+    std::vector<Id> live(std::vector<Id> ids) const {
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [this](Id id) { return !alive[id]; }), ids.end());
+        return ids;
+    }
+
+public:
+    RecordStore() = default;
+
+    /// \brief Makes room for the records of all the given stores, ahead of appending them.
+    void reserveFor(const std::vector<RecordStore>& parts) {
+        std::size_t records = endId();
+        std::size_t bytes[storedFields] = {};
+        for (std::size_t i = 0; i < storedFields; i++) {
+            bytes[i] = columns[i].bytes.size();
+        }
+        for (const auto& part : parts) {
+            records += part.endId();
+            for (std::size_t i = 0; i < storedFields; i++) {
+                bytes[i] += part.columns[i].bytes.size();
+            }
+        }
+        for (std::size_t i = 0; i < storedFields; i++) {
+            columns[i].bytes.reserve(bytes[i]);
+            columns[i].starts.reserve(records);
+            columns[i].lengths.reserve(records);
+        }
+        categories.reserve(records);
+        alive.reserve(records);
+    }
+
+    /// \brief Gives back reserved room that is not used.
+    void shrinkToFit() {
+        for (Column& column : columns) {
+            column.bytes.shrink_to_fit();
+            column.starts.shrink_to_fit();
+            column.lengths.shrink_to_fit();
+        }
+        categories.shrink_to_fit();
+        alive.shrink_to_fit();
+    }
+
+    /// \brief The id of a category, interning it on first use.
+    CategoryId intern(std::string_view category) {
+        auto found = categoryIds.find(category);
+        if (found != categoryIds.end()) {
+            return found->second;
+        }
+        CategoryId id = static_cast<CategoryId>(categoryNames.size());
+        categoryNames.emplace_back(category);
+        categoryIds.emplace(categoryNames.back(), id);
+        return id;
+    }
+
+    /// \brief The id of a category that is already interned; false if it is not.
+    bool findCategoryId(std::string_view category, CategoryId& id) const {
+        auto found = categoryIds.find(category);
+        if (found == categoryIds.end()) {
+            return false;
+        }
+        id = found->second;
+        return true;
+    }
+
+    /**
+     * \brief Stores a new record and returns its id.
+     *
+     * \param sealed The sealed fields; its category is ignored.
+     * \param category The category in plaintext.
+     */
+    Id add(const RecordView& sealed, std::string_view category) {
+        auto fields = fieldsOf(sealed);
+        for (std::size_t i = 0; i < storedFields; i++) {
+            columns[i].push(fields[i]);
+        }
+        categories.push_back(intern(category));
+        alive.push_back(true);
+        liveCount++;
+        return endId() - 1;
+    }
+
+    /// \brief Replaces a live record in place; its id stays the same.
+    void replace(Id id, const RecordView& sealed, std::string_view category) {
+        deadBytes += sizeOf(id);
+        auto fields = fieldsOf(sealed);
+        for (std::size_t i = 0; i < storedFields; i++) {
+            columns[i].set(id, fields[i]);
+        }
+        categories[id] = intern(category);
+    }
+
+    /// \brief Erases a live record. Its bytes stay in the columns until compact().
+    void erase(Id id) {
+        deadBytes += sizeOf(id);
+        alive[id] = false;
+        liveCount--;
+    }
+
+    /**
+     * \brief Moves all records of another store behind the records of this one, keeping their order.
+     *
+     * The ids of the moved records are shifted by the number of slots this store had before.
+     */
+    void append(RecordStore&& other) {
+        for (std::size_t i = 0; i < storedFields; i++) {
+            Column& column = columns[i];
+            Column& moved = other.columns[i];
+            std::uint64_t shift = column.bytes.size();
+            column.bytes += moved.bytes;
+            for (std::uint64_t start : moved.starts) {
+                column.starts.push_back(start + shift);
+            }
+            column.lengths.insert(column.lengths.end(), moved.lengths.begin(), moved.lengths.end());
+        }
+        std::vector<CategoryId> remap(other.categoryNames.size());
+        for (std::size_t i = 0; i < remap.size(); i++) {
+            remap[i] = intern(other.categoryNames[i]);
+        }
+        for (CategoryId category : other.categories) {
+            categories.push_back(remap[category]);
+        }
+        alive.insert(alive.end(), other.alive.begin(), other.alive.end());
+        liveCount += other.liveCount;
+        deadBytes += other.deadBytes;
+        other = RecordStore();
+    }
+
+    /// \brief Drops all erased slots, their bytes and unused categories. Ids of the remaining records change.
+    void compact() {
+
+        for (Column& column : columns) {
+            Column packed;
+            for (Id id = 0; id < endId(); id++) {
+                if (alive[id]) {
+                    packed.push(column.at(id));
+                }
+            }
+            column = std::move(packed);
+        }
+
+        std::deque<std::string> names;
+        std::unordered_map<CategoryId, CategoryId> remap;
+        std::size_t next = 0;
+        for (Id id = 0; id < categories.size(); id++) {
+            if (!alive[id]) {
+                continue;
+            }
+            auto mapped = remap.emplace(categories[id], static_cast<CategoryId>(names.size()));
+            if (mapped.second) {
+                names.push_back(std::move(categoryNames[categories[id]]));
+            }
+            categories[next++] = mapped.first->second;
+        }
+
+        categories.resize(next);
+        alive.assign(next, true);
+        deadBytes = 0;
+        categoryNames = std::move(names);
+        categoryIds.clear();
+        for (std::size_t i = 0; i < categoryNames.size(); i++) {
+            categoryIds.emplace(categoryNames[i], static_cast<CategoryId>(i));
+        }
+    }
+
+    /// \brief A sealed field of a record; not for Field::Category, which is kept in plaintext.
+    std::string_view sealedField(Id id, Field field) const {
+        return columns[position(field)].at(id);
+    }
+
+    /// \brief The record nonce the fields of a record are sealed under.
+    std::string_view nonce(Id id) const {
+        return columns[storedFields - 1].at(id);
+    }
+
+    /// \brief The category of a record, in plaintext.
+    const std::string& category(Id id) const {
+        return categoryNames[categories[id]];
+    }
+
+    /**
+     * \brief Scans the category column for the live records of a category.
+     *
+     * The ids are compared with matchKernel(), several per instruction; no field bytes are touched.
+     *
+     * \return The matching ids in id order.
+     */
+    std::vector<Id> scanCategory(std::string_view category) const {
+        std::vector<Id> found;
+        CategoryId wanted = 0;
+        if (findCategoryId(category, wanted)) {
+            matchKernel()(categories.data(), categories.size(), wanted, 0, found);
+        }
+        return live(std::move(found));
+    }
+
+    /**
+     * \brief Scans one sealed column for the live records whose field holds exactly the given bytes.
+     *
+     * Only a cipher that seals equal plaintexts to equal bytes, like the shift cipher of text vaults, makes
+     * this a plaintext match. The lengths are compared first with matchKernel(), and only the records of
+     * the right length have their bytes compared.
+     *
+     * \return The matching ids in id order.
+     */
+    std::vector<Id> scanSealed(Field field, std::string_view sealed) const {
+        const Column& column = columns[position(field)];
+        MatchKernel match = matchKernel();
+        std::vector<Id> candidates;
+        std::vector<Id> found;
+
+        // A block at a time, so the candidates stay in the cache between the two passes.
+        const std::size_t block = 1024;
+        for (std::size_t begin = 0; begin < column.lengths.size(); begin += block) {
+            candidates.clear();
+            match(column.lengths.data() + begin, std::min(block, column.lengths.size() - begin),
+                  static_cast<std::uint32_t>(sealed.size()), static_cast<Id>(begin), candidates);
+            for (Id id : candidates) {
+                if (std::memcmp(column.bytes.data() + column.starts[id], sealed.data(), sealed.size()) == 0) {
+                    found.push_back(id);
+                }
+            }
+        }
+        return live(std::move(found));
+    }
+
+    bool isLive(Id id) const {
+        return alive[id];
+    }
+
+    /// \brief One past the largest id in use, live or erased.
+    Id endId() const {
+        return static_cast<Id>(categories.size());
+    }
+
+    /// \brief The number of live records.
+    std::size_t size() const {
+        return liveCount;
+    }
+
+    /// \brief The number of erased slots still waiting for compact().
+    std::size_t garbage() const {
+        return endId() - liveCount;
+    }
+
+    /// \brief The number of distinct categories interned so far.
+    std::size_t categoryCount() const {
+        return categoryNames.size();
+    }
+
+    /**
+     * \brief The heap memory the store holds, counting reserved but unused capacity.
+     *
+     * The interned categories are estimated at their string plus the hash table node that points at it.
+     */
+    std::size_t memoryBytes() const {
+        std::size_t bytes = categories.capacity() * sizeof(CategoryId) + alive.capacity() / 8
+                            + categoryIds.bucket_count() * sizeof(void*);
+        for (const Column& column : columns) {
+            bytes += column.bytes.capacity() + column.starts.capacity() * sizeof(std::uint64_t)
+                     + column.lengths.capacity() * sizeof(std::uint32_t);
+        }
+        for (const auto& name : categoryNames) {
+            bytes += sizeof(std::string) + (name.capacity() > 15 ? name.capacity() + 1 : 0)
+                     + sizeof(void*) + sizeof(std::string_view) + sizeof(CategoryId);
+        }
+        return bytes;
+    }
+
+    /// \brief Calls visit(id) for every live record in id order.
+    template <typename Visitor>
+    void forEachLive(Visitor&& visit) const {
+        for (Id id = 0; id < endId(); id++) {
+            if (alive[id]) {
+                visit(id);
+            }
+        }
+    }
+};
+
+
+
+/**
+ * \class NameIndex
+ * \brief An open-addressing hash table from decrypted names to record ids.
+ *
+ * Only a 64-bit hash of each name is kept, never the name itself, so a lookup returns candidates that
+ * the caller confirms by decrypting them. Several records may share a name; each one gets its own
+ * slot. The table uses linear probing with backward-shift deletion, so it never needs tombstones.
+ */
+class NameIndex {
+
+private:
+    struct Slot {
+        std::uint64_t hash;
+        RecordStore::Id id;
+    };
+
+    static constexpr RecordStore::Id emptySlot = UINT32_MAX;
+
+    std::vector<Slot> slots = std::vector<Slot>(16, Slot{0, emptySlot});
+    std::size_t used = 0;
+
+    std::size_t home(std::uint64_t hash) const {
+        return static_cast<std::size_t>(hash) & (slots.size() - 1);
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2, Slot{0, emptySlot});
+        old.swap(slots);
+        used = 0;
+        for (const auto& slot : old) {
+            if (slot.id != emptySlot) {
+                insert(slot.hash, slot.id);
+            }
+        }
+    }
+
+public:
+    /// \brief FNV-1a over the name, finished with a mixer so the low bits are usable as a slot number.
+    static std::uint64_t hashName(std::string_view name) {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : name) {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    void insert(std::uint64_t hash, RecordStore::Id id) {
+        if ((used + 1) * 2 > slots.size()) {
+            grow();
+        }
+        std::size_t i = home(hash);
+        while (slots[i].id != emptySlot) {
+            i = (i + 1) & (slots.size() - 1);
+        }
+        slots[i] = Slot{hash, id};
+        used++;
+    }
+
+    void erase(std::uint64_t hash, RecordStore::Id id) {
+        std::size_t mask = slots.size() - 1;
+        std::size_t i = home(hash);
+        while (slots[i].id != emptySlot && !(slots[i].hash == hash && slots[i].id == id)) {
+            i = (i + 1) & mask;
+        }
+        if (slots[i].id == emptySlot) {
+            return;
+        }
+
+        // Pull every later slot of the cluster back into the hole if its home allows it.
+        std::size_t hole = i;
+        for (std::size_t j = (i + 1) & mask; slots[j].id != emptySlot; j = (j + 1) & mask) {
+            std::size_t want = home(slots[j].hash);
+            if (((j - want) & mask) >= ((j - hole) & mask)) {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole] = Slot{0, emptySlot};
+        used--;
+    }
+
+    /// \brief Calls visit(id) for every record whose name hashes to the given value.
+    template <typename Visitor>
+    void forEachCandidate(std::uint64_t hash, Visitor&& visit) const {
+        for (std::size_t i = home(hash); slots[i].id != emptySlot; i = (i + 1) & (slots.size() - 1)) {
+            if (slots[i].hash == hash) {
+                visit(slots[i].id);
+            }
+        }
+    }
+
+    void clear() {
+        slots.assign(16, Slot{0, emptySlot});
+        used = 0;
+    }
+
+    /// \brief Makes room for the given number of entries up front.
+    void reserve(std::size_t count) {
+        std::size_t wanted = 16;
+        while (wanted < count * 2) {
+            wanted *= 2;
+        }
+        if (wanted > slots.size()) {
+            slots.assign(wanted, Slot{0, emptySlot});
+            used = 0;
+        }
+    }
+};
+
+
+
+
+/**
+ * \class CategoryIndex
+ * \brief An inverted index from decrypted category names to the records in that category.
+ *
+ * Every category owns a posting list of record ids kept in ascending order. New records always get the
+ * largest id, so adding one is an append; erasing one is a binary search in the posting list of its
+ * category. A category exists while it has password sets; once its last one is gone, its posting list
+ * stays behind empty for the rest of the session.
+ */
+class CategoryIndex {
+
+private:
+    std::unordered_map<std::string, std::vector<RecordStore::Id>> postings;
+
+public:
+    void insert(const std::string& category, RecordStore::Id id) {
+        std::vector<RecordStore::Id>& list = postings[category];
+        if (list.empty() || list.back() < id) {
+            list.push_back(id);
+        } else {
+            list.insert(std::upper_bound(list.begin(), list.end(), id), id);
+        }
+    }
+
+    void erase(const std::string& category, RecordStore::Id id) {
+        auto it = postings.find(category);
+        if (it == postings.end()) {
+            return;
+        }
+        std::vector<RecordStore::Id>& list = it->second;
+        auto position = std::lower_bound(list.begin(), list.end(), id);
+        if (position != list.end() && *position == id) {
+            list.erase(position);
+        }
+    }
+
+    /// \brief Replaces the posting list of a category with one that is already in ascending order.
+    void assign(const std::string& category, std::vector<RecordStore::Id> ids) {
+        postings[category] = std::move(ids);
+    }
+
+    /// \brief The posting list of a category, or nullptr if the category does not exist.
+    const std::vector<RecordStore::Id>* find(const std::string& category) const {
+        auto it = postings.find(category);
+        return it != postings.end() ? &it->second : nullptr;
+    }
+
+    /// \brief Forgets a category together with its posting list. Returns false if it did not exist.
+    bool remove(const std::string& category) {
+        return postings.erase(category) > 0;
+    }
+
+    /// \brief Empties all posting lists but keeps the categories themselves.
+    void clear() {
+        for (auto& entry : postings) {
+            entry.second.clear();
+        }
+    }
+};
+
+
+
+
+/**
+ * \class AlphabeticOrder
+ * \brief Keeps the live records sorted by their decrypted name.
+ *
+ * The decrypted name of every record is computed once, when the record is inserted, and kept as its sort
+ * key. The order itself is a permutation of record ids sorted by (key, id), maintained with a binary search
+ * on every insert and erase, so listing the vault alphabetically is a plain walk over that permutation.
+ */
+class AlphabeticOrder {
+
+private:
+    std::vector<std::string> keys;
+    std::vector<RecordStore::Id> order;
+
+    auto comesBefore() const {
+        return [this](RecordStore::Id x, RecordStore::Id y) {
+            int compared = keys[x].compare(keys[y]);
+            return compared < 0 || (compared == 0 && x < y);
+        };
+    }
+
+public:
+    void insert(RecordStore::Id id, std::string key) {
+        if (keys.size() <= id) {
+            keys.resize(id + 1);
+        }
+        keys[id] = std::move(key);
+        order.insert(std::upper_bound(order.begin(), order.end(), id, comesBefore()), id);
+    }
+
+    void erase(RecordStore::Id id) {
+        auto position = std::lower_bound(order.begin(), order.end(), id, comesBefore());
+        if (position != order.end() && *position == id) {
+            order.erase(position);
+        }
+        std::string().swap(keys[id]);
+    }
+
+    /**
+     * \brief Replaces the whole order at once; cheaper than inserting the records one by one.
+     *
+     * The ids are cut into one run per thread of the pool, the runs are sorted in parallel and then merged
+     * pairwise, again in parallel, until a single run is left.
+     */
+    void assign(std::vector<std::string> newKeys, std::vector<RecordStore::Id> ids, ThreadPool& pool) {
+        keys = std::move(newKeys);
+        order = std::move(ids);
+
+        std::size_t runs = std::min(pool.size(), order.size() / 4096 + 1);
+        std::vector<std::size_t> bounds(runs + 1);
+        for (std::size_t i = 0; i <= runs; i++) {
+            bounds[i] = order.size() * i / runs;
+        }
+
+        pool.parallelFor(runs, [&](std::size_t run) {
+            std::sort(order.begin() + bounds[run], order.begin() + bounds[run + 1], comesBefore());
+        });
+        for (std::size_t width = 1; width < runs; width *= 2) {
+            pool.parallelFor((runs + 2 * width - 1) / (2 * width), [&](std::size_t merge) {
+                std::size_t low = merge * 2 * width;
+                std::size_t middle = std::min(low + width, runs);
+                std::size_t high = std::min(low + 2 * width, runs);
+                std::inplace_merge(order.begin() + bounds[low], order.begin() + bounds[middle],
+                                   order.begin() + bounds[high], comesBefore());
+            });
+        }
+    }
+
+    /// \brief Replaces the whole order with one that is already sorted, such as a persisted one.
+    void assignSorted(std::vector<std::string> newKeys, std::vector<RecordStore::Id> ids) {
+        keys = std::move(newKeys);
+        order = std::move(ids);
+    }
+
+    /// \brief The decrypted name of a live record.
+    const std::string& key(RecordStore::Id id) const {
+        return keys[id];
+    }
+
+    /// \brief The ids of all live records in alphabetic order.
+    const std::vector<RecordStore::Id>& ids() const {
+        return order;
+    }
+};
+
+
+
+
+/// \brief Folds ASCII letters to lower case, so text searches ignore case.
+std::string foldCase(std::string_view text) {
+    std::string folded(text);
+    for (char& c : folded) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    return folded;
+}
+
+
+/**
+ * \class TrigramIndex
+ * \brief Answers substring and prefix queries over the decrypted name, website and login of every record.
+ *
+ * The three fields of a record are folded to lower case, each is prefixed with two start markers, and
+ * they are joined into one indexed text. Every three consecutive bytes within a field are a trigram
+ * whose posting list holds the ids of all records containing it. A query is cut into trigrams the same
+ * way, with the start markers only for a prefix query, and the posting lists are intersected shortest
+ * first. The few candidates left are confirmed against their indexed text, which the index keeps for
+ * that purpose. Queries shorter than a trigram fall back to a scan of the texts.
+ *
+ * Ids only grow while records are added, so a new record is simply appended to its posting lists. An
+ * edited record keeps its id, so replace() moves it between posting lists at its sorted place. An
+ * erased record only loses its text; its ids stay in the posting lists and are skipped by queries until
+ * they make up half of all entries, at which point the lists are swept.
+ */
+class TrigramIndex {
+
+private:
+    using Trigram = std::uint32_t;
+    using Postings = std::unordered_map<Trigram, std::vector<RecordStore::Id>>;
+
+    Postings postings;
+    std::vector<std::string> texts;
+    std::size_t entries = 0;
+    std::size_t staleEntries = 0;
+
+    /// \brief Calls visit(trigram) once for every distinct trigram of an indexed text or a query pattern.
+    template <typename Visitor>
+    static void forEachTrigram(std::string_view text, Visitor&& visit) {
+        std::vector<Trigram> found;
+        for (std::size_t i = 0; i + 3 <= text.size(); i++) {
+            if (text[i] == '\0' || text[i + 1] == '\0' || text[i + 2] == '\0') {
+                continue;
+            }
+            found.push_back(static_cast<Trigram>(static_cast<unsigned char>(text[i]))
+                            | static_cast<Trigram>(static_cast<unsigned char>(text[i + 1])) << 8
+                            | static_cast<Trigram>(static_cast<unsigned char>(text[i + 2])) << 16);
+        }
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+        for (Trigram trigram : found) {
+            visit(trigram);
+        }
+    }
+
+    void sweep() {
+        for (auto& entry : postings) {
+            auto& ids = entry.second;
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [this](RecordStore::Id id) {
+                return texts[id].empty();
+            }), ids.end());
+        }
+        entries -= staleEntries;
+        staleEntries = 0;
+    }
+
+public:
+    /// \brief The first byte of every indexed field; a prefix query starts with two of them.
+    static constexpr char startMarker = '\x01';
+
+    /// \brief Builds the indexed text of a record from its decrypted fields.
+    static std::string indexedText(std::string_view name, std::string_view website, std::string_view login) {
+        std::string text;
+        text.reserve(name.size() + website.size() + login.size() + 8);
+        for (std::string_view field : {name, website, login}) {
+            if (!text.empty()) {
+                text.push_back('\0');
+            }
+            text.append(2, startMarker);
+            text += foldCase(field);
+        }
+        return text;
+    }
+
+    /// \brief Indexes a record whose id is larger than that of every record indexed so far.
+    void insert(RecordStore::Id id, std::string text) {
+        if (texts.size() <= id) {
+            texts.resize(id + 1);
+        }
+        forEachTrigram(text, [this, id](Trigram trigram) {
+            postings[trigram].push_back(id);
+            entries++;
+        });
+        texts[id] = std::move(text);
+    }
+
+    /// \brief Indexes a new version of an indexed record under the same id, keeping every posting list sorted.
+    void replace(RecordStore::Id id, std::string text) {
+        forEachTrigram(texts[id], [this, id](Trigram trigram) {
+            auto& ids = postings[trigram];
+            auto it = std::lower_bound(ids.begin(), ids.end(), id);
+            if (it != ids.end() && *it == id) {
+                ids.erase(it);
+                entries--;
+            }
+        });
+        forEachTrigram(text, [this, id](Trigram trigram) {
+            auto& ids = postings[trigram];
+            ids.insert(std::lower_bound(ids.begin(), ids.end(), id), id);
+            entries++;
+        });
+        texts[id] = std::move(text);
+    }
+
+    void erase(RecordStore::Id id) {
+        forEachTrigram(texts[id], [this](Trigram) {
+            staleEntries++;
+        });
+        std::string().swap(texts[id]);
+        if (staleEntries > 1024 && 2 * staleEntries > entries) {
+            sweep();
+        }
+    }
+
+    /**
+     * \brief Replaces the whole index at once.
+     *
+     * Every thread of the pool builds the posting lists of a run of ids, and the runs are appended to each
+     * other in id order, so every list comes out sorted.
+     *
+     * \param newTexts The indexed text of every id, empty for ids that are not live.
+     * \param pool The threads to build on.
+     */
+    void assign(std::vector<std::string> newTexts, ThreadPool& pool) {
+        texts = std::move(newTexts);
+        postings.clear();
+        entries = 0;
+        staleEntries = 0;
+
+        std::size_t runs = std::min(pool.size(), texts.size() / 4096 + 1);
+        std::vector<Postings> partial(runs);
+        pool.parallelFor(runs, [&](std::size_t run) {
+            for (std::size_t id = texts.size() * run / runs; id < texts.size() * (run + 1) / runs; id++) {
+                forEachTrigram(texts[id], [&](Trigram trigram) {
+                    partial[run][trigram].push_back(static_cast<RecordStore::Id>(id));
+                });
+            }
+        });
+
+        for (auto& run : partial) {
+            for (auto& entry : run) {
+                auto& ids = postings[entry.first];
+                ids.insert(ids.end(), entry.second.begin(), entry.second.end());
+                entries += entry.second.size();
+            }
+            Postings().swap(run);
+        }
+    }
+
+    void clear() {
+        texts.clear();
+        postings.clear();
+        entries = 0;
+        staleEntries = 0;
+    }
+
+    /**
+     * \brief Finds all records with a field that contains, or starts with, the given text.
+     *
+     * \param query The text to look for; upper and lower case letters match each other.
+     * \param prefixOnly Whether the field has to start with the text rather than just contain it.
+     * \return The ids of all matching records, ascending.
+     */
+    std::vector<RecordStore::Id> search(std::string_view query, bool prefixOnly) const {
+
+        std::string pattern = prefixOnly ? std::string(2, startMarker) + foldCase(query) : foldCase(query);
+        std::vector<RecordStore::Id> matches;
+
+        auto confirmed = [this, &pattern](RecordStore::Id id) {
+            return !texts[id].empty() && texts[id].find(pattern) != std::string::npos;
+        };
+
+        if (pattern.size() < 3) {
+            for (RecordStore::Id id = 0; id < texts.size(); id++) {
+                if (confirmed(id)) {
+                    matches.push_back(id);
+                }
+            }
+            return matches;
+        }
+
+        std::vector<const std::vector<RecordStore::Id>*> lists;
+        bool missing = false;
+        forEachTrigram(pattern, [&](Trigram trigram) {
+            auto it = postings.find(trigram);
+            if (it == postings.end()) {
+                missing = true;
+            } else {
+                lists.push_back(&it->second);
+            }
+        });
+        if (missing || lists.empty()) {
+            return matches;
+        }
+
+        std::sort(lists.begin(), lists.end(), [](const auto* x, const auto* y) {
+            return x->size() < y->size();
+        });
+
+        // Intersect shortest first. Against a much longer list, galloping from one remaining candidate to
+        // the next beats walking the whole list.
+        std::vector<RecordStore::Id> candidates = *lists[0];
+        std::vector<RecordStore::Id> kept;
+        for (std::size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+            const auto& list = *lists[i];
+            kept.clear();
+            if (list.size() > 16 * candidates.size()) {
+                auto cursor = list.begin();
+                for (RecordStore::Id id : candidates) {
+                    std::size_t step = 1;
+                    auto bound = cursor;
+                    while (bound != list.end() && *bound < id) {
+                        cursor = bound;
+                        bound = static_cast<std::size_t>(list.end() - bound) > step ? bound + step : list.end();
+                        step *= 2;
+                    }
+                    cursor = std::lower_bound(cursor, bound, id);
+                    if (cursor == list.end()) {
+                        break;
+                    }
+                    if (*cursor == id) {
+                        kept.push_back(id);
+                    }
+                }
+            } else {
+                std::set_intersection(candidates.begin(), candidates.end(), list.begin(), list.end(),
+                                      std::back_inserter(kept));
+            }
+            candidates.swap(kept);
+        }
+
+        for (RecordStore::Id id : candidates) {
+            if (confirmed(id)) {
+                matches.push_back(id);
+            }
+        }
+        return matches;
+    }
+};
+
+
+
+/**
+ * \class EditDistance
+ * \brief Computes the Levenshtein distance from one fixed string to many others.
+ *
+ * For a pattern of up to 64 bytes the bit-parallel algorithm of Myers, in the form given by Hyyrö, is
+ * used: a whole column of the edit matrix lives in two machine words, so comparing against a text costs
+ * a handful of word operations per text byte. The per-byte match masks are prepared once, in the
+ * constructor. Longer patterns fall back to the classic row by row dynamic programme.
+ */
+class EditDistance {
+
+private:
+    std::string pattern;
+    std::uint64_t matchMasks[256] = {};
+
+public:
+    explicit EditDistance(std::string_view pattern) : pattern(pattern) {
+        if (pattern.size() <= 64) {
+            for (std::size_t i = 0; i < pattern.size(); i++) {
+                matchMasks[static_cast<unsigned char>(pattern[i])] |= std::uint64_t(1) << i;
+            }
+        }
+    }
+
+    /// \brief The number of single-byte insertions, deletions and substitutions that turn the pattern into text.
+    std::size_t to(std::string_view text) const {
+
+        if (pattern.empty()) {
+            return text.size();
+        }
+
+        if (pattern.size() <= 64) {
+            std::uint64_t positive = ~std::uint64_t(0);
+            std::uint64_t negative = 0;
+            std::uint64_t last = std::uint64_t(1) << (pattern.size() - 1);
+            std::size_t score = pattern.size();
+
+            for (char c : text) {
+                std::uint64_t match = matchMasks[static_cast<unsigned char>(c)];
+                std::uint64_t vertical = match | negative;
+                std::uint64_t diagonal = (((match & positive) + positive) ^ positive) | match;
+                std::uint64_t horizontalPositive = negative | ~(diagonal | positive);
+                std::uint64_t horizontalNegative = positive & diagonal;
+                if ((horizontalPositive & last) != 0) {
+                    score++;
+                } else if ((horizontalNegative & last) != 0) {
+                    score--;
+                }
+                horizontalPositive = (horizontalPositive << 1) | 1;
+                horizontalNegative <<= 1;
+                positive = horizontalNegative | ~(vertical | horizontalPositive);
+                negative = horizontalPositive & vertical;
+            }
+            return score;
+        }
+
+        std::vector<std::size_t> row(text.size() + 1);
+        for (std::size_t j = 0; j <= text.size(); j++) {
+            row[j] = j;
+        }
+        for (std::size_t i = 1; i <= pattern.size(); i++) {
+            std::size_t diagonal = row[0];
+            row[0] = i;
+            for (std::size_t j = 1; j <= text.size(); j++) {
+                std::size_t above = row[j];
+                row[j] = std::min({row[j] + 1, row[j - 1] + 1, diagonal + (pattern[i - 1] != text[j - 1] ? 1 : 0)});
+                diagonal = above;
+            }
+        }
+        return row[text.size()];
+    }
+};
+
+
+/**
+ * \class BkTree
+ * \brief A Burkhard-Keller tree of names for finding the closest ones to a misspelt query.
+ *
+ * Every node holds one distinct name and the ids of the records carrying it. The children of a node are
+ * keyed by their edit distance to it, so by the triangle inequality a search for names within distance
+ * r of the query only has to descend into children keyed between d - r and d + r, where d is the
+ * distance of the query to the node itself. While looking for the k closest names, r shrinks to the
+ * distance of the k-th best name found so far.
+ *
+ * A node whose last record is erased stays in the tree to route searches, it just no longer matches.
+ */
+class BkTree {
+
+private:
+    struct Node {
+        std::string key;
+        std::vector<RecordStore::Id> ids;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> children;
+    };
+
+    std::vector<Node> nodes;
+    std::size_t liveIds = 0;
+
+    /// \brief The node holding key, or -1.
+    long findNode(const std::string& key) const {
+        EditDistance distanceFromKey(key);
+        std::size_t current = 0;
+        while (current < nodes.size()) {
+            std::size_t distance = distanceFromKey.to(nodes[current].key);
+            if (distance == 0) {
+                return static_cast<long>(current);
+            }
+            auto& children = nodes[current].children;
+            auto child = std::find_if(children.begin(), children.end(), [distance](const auto& edge) {
+                return edge.first == distance;
+            });
+            if (child == children.end()) {
+                return -1;
+            }
+            current = child->second;
+        }
+        return -1;
+    }
+
+public:
+    /// \brief A record found by closest(), with the edit distance of its name to the query.
+    struct Match {
+        std::size_t distance;
+        RecordStore::Id id;
+    };
+
+    void insert(const std::string& key, RecordStore::Id id) {
+
+        liveIds++;
+        if (nodes.empty()) {
+            nodes.push_back({key, {id}, {}});
+            return;
+        }
+
+        EditDistance distanceFromKey(key);
+        std::size_t current = 0;
+        while (true) {
+            auto distance = static_cast<std::uint32_t>(distanceFromKey.to(nodes[current].key));
+            if (distance == 0) {
+                nodes[current].ids.push_back(id);
+                return;
+            }
+            auto& children = nodes[current].children;
+            auto child = std::find_if(children.begin(), children.end(), [distance](const auto& edge) {
+                return edge.first == distance;
+            });
+            if (child == children.end()) {
+                children.emplace_back(distance, static_cast<std::uint32_t>(nodes.size()));
+                nodes.push_back({key, {id}, {}});
+                return;
+            }
+            current = child->second;
+        }
+    }
+
+    void erase(const std::string& key, RecordStore::Id id) {
+        long node = findNode(key);
+        if (node < 0) {
+            return;
+        }
+        auto& ids = nodes[node].ids;
+        auto position = std::find(ids.begin(), ids.end(), id);
+        if (position != ids.end()) {
+            ids.erase(position);
+            liveIds--;
+        }
+    }
+
+    void clear() {
+        nodes.clear();
+        liveIds = 0;
+    }
+
+    /**
+     * \brief Renumbers the nodes in breadth-first order.
+     *
+     * Inserting one name at a time scatters the children of a node all over the node array. After the
+     * renumbering the children of every node sit next to each other, which is the order a search visits
+     * them in, so a search touches far fewer cache lines. Names inserted later are appended as usual.
+     */
+    void relayout() {
+        if (nodes.empty()) {
+            return;
+        }
+        std::vector<Node> ordered;
+        ordered.reserve(nodes.size());
+        ordered.push_back(std::move(nodes[0]));
+        for (std::size_t next = 0; next < ordered.size(); next++) {
+            // A fresh copy, so the child lists are also allocated one after the other.
+            auto children = ordered[next].children;
+            ordered[next].children.swap(children);
+            for (auto& child : ordered[next].children) {
+                std::uint32_t position = static_cast<std::uint32_t>(ordered.size());
+                ordered.push_back(std::move(nodes[child.second]));
+                child.second = position;
+            }
+        }
+        nodes.swap(ordered);
+    }
+
+    /// \brief Whether nodes of erased names make up most of the tree, so it is worth building anew.
+    bool isMostlyDead() const {
+        return nodes.size() > 1024 && nodes.size() > 2 * liveIds;
+    }
+
+    /**
+     * \brief Finds the records whose names are closest to the query.
+     *
+     * \param query The name to look for.
+     * \param maxDistance The largest edit distance a result may have.
+     * \param limit The largest number of names to return; all records of those names are returned.
+     * \param nameOf Gives the name of a record id, to order records that share a folded name.
+     * \return The matching records, closest first, then in alphabetic order of their names.
+     */
+    template <typename NameOf>
+    std::vector<Match> closest(const std::string& query, std::size_t maxDistance, std::size_t limit,
+                               NameOf&& nameOf) const {
+
+        // The best names so far, as a max-heap on (distance, node), so the worst one is dropped first.
+        std::vector<std::pair<std::size_t, std::uint32_t>> best;
+        std::size_t radius = maxDistance;
+        EditDistance distanceFromQuery(query);
+
+        auto worse = [this](const std::pair<std::size_t, std::uint32_t>& x, const std::pair<std::size_t, std::uint32_t>& y) {
+            return x.first != y.first ? x.first < y.first : nodes[x.second].key < nodes[y.second].key;
+        };
+
+        std::vector<std::uint32_t> pending;
+        std::vector<std::pair<std::size_t, std::uint32_t>> candidates;
+        if (!nodes.empty() && limit > 0) {
+            pending.push_back(0);
+        }
+        while (!pending.empty()) {
+            std::uint32_t current = pending.back();
+            pending.pop_back();
+
+            std::size_t distance = distanceFromQuery.to(nodes[current].key);
+            if (distance <= radius && !nodes[current].ids.empty()) {
+                best.emplace_back(distance, current);
+                std::push_heap(best.begin(), best.end(), worse);
+                if (best.size() > limit) {
+                    std::pop_heap(best.begin(), best.end(), worse);
+                    best.pop_back();
+                }
+                if (best.size() == limit) {
+                    radius = std::min(radius, best.front().first);
+                }
+            }
+
+            // Children keyed closest to the distance of this node are the likeliest to hold close names, so
+            // they are pushed last and searched first, which shrinks the radius early.
+            candidates.clear();
+            for (const auto& child : nodes[current].children) {
+                if (child.first + radius >= distance && child.first <= distance + radius) {
+                    std::size_t gap = child.first > distance ? child.first - distance : distance - child.first;
+                    candidates.emplace_back(gap, child.second);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), std::greater<>());
+            for (const auto& candidate : candidates) {
+                pending.push_back(candidate.second);
+            }
+        }
+
+        std::sort_heap(best.begin(), best.end(), worse);
+
+        std::vector<Match> matches;
+        for (const auto& name : best) {
+            std::vector<RecordStore::Id> ids = nodes[name.second].ids;
+            std::sort(ids.begin(), ids.end(), [&nameOf](RecordStore::Id x, RecordStore::Id y) {
+                int compared = nameOf(x).compare(nameOf(y));
+                return compared < 0 || (compared == 0 && x < y);
+            });
+            for (RecordStore::Id id : ids) {
+                matches.push_back({name.first, id});
+            }
+        }
+        return matches;
+    }
+};
+
+
+
+/**
+ * \class EpochDomain
+ * \brief Epoch-based reclamation: frees retired objects only once no reader can still be using them.
+ *
+ * A reader pins the domain for as long as it uses shared objects, announcing the current epoch in one
+ * of a fixed number of slots. Pinning and unpinning are a compare-and-swap and a store; a reader never
+ * takes a lock and never waits for a writer. A writer that unlinks an object retires it, which stamps
+ * it with the current epoch and advances the epoch. reclaim() then frees every retired object stamped
+ * before the oldest epoch any reader still announces.
+ *
+ * retire() and reclaim() must not be called by two threads at the same time.
+ */
+class EpochDomain {
+
+public:
+    /// Readers that can be pinned at the same time; more wait for a free slot.
+    static constexpr std::size_t slotCount = 128;
+
+private:
+    struct alignas(64) Slot {
+        /// The announced epoch, or 0 while the slot is free.
+        std::atomic<std::uint64_t> epoch{0};
+    };
+
+    Slot slots[slotCount];
+    std::atomic<std::uint64_t> globalEpoch{1};
+    std::vector<std::pair<std::uint64_t, std::function<void()>>> retired;
+
+public:
+    /// \brief Keeps a reader pinned until it goes out of scope.
+    class Guard {
+
+    private:
+        std::atomic<std::uint64_t>* slot = nullptr;
+
+    public:
+        Guard() = default;
+
+        explicit Guard(std::atomic<std::uint64_t>* slot) : slot(slot) {
+        }
+
+        Guard(Guard&& other) noexcept : slot(other.slot) {
+            other.slot = nullptr;
+        }
+
+        Guard& operator=(Guard&& other) noexcept {
+            std::swap(slot, other.slot);
+            return *this;
+        }
+
+        ~Guard() {
+            if (slot != nullptr) {
+                slot->store(0, std::memory_order_release);
+            }
+        }
+    };
+
+    EpochDomain() = default;
+
+    ~EpochDomain() {
+        for (auto& object : retired) {
+            object.second();
+        }
+    }
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    /**
+     * \brief Pins the calling thread; shared objects loaded after this stay valid until the guard goes.
+     *
+     * Every thread starts looking for a free slot at its own place, so readers rarely compete for one.
+     */
+    Guard pin() {
+        static thread_local std::size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+        for (std::size_t attempt = 0;; attempt++) {
+            std::atomic<std::uint64_t>& slot = slots[(start + attempt) % slotCount].epoch;
+            std::uint64_t free = 0;
+            if (slot.compare_exchange_strong(free, globalEpoch.load())) {
+                return Guard(&slot);
+            }
+            if (attempt % slotCount == slotCount - 1) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /// \brief Hands over an object that readers can no longer reach; free runs once none uses it.
+    void retire(std::function<void()> free) {
+        retired.emplace_back(globalEpoch.fetch_add(1), std::move(free));
+    }
+
+    /**
+     * \brief Frees the retired objects no reader can be using any more.
+     *
+     * \return The number of objects freed.
+     */
+    std::size_t reclaim() {
+        std::uint64_t oldest = UINT64_MAX;
+        for (const Slot& slot : slots) {
+            std::uint64_t epoch = slot.epoch.load();
+            if (epoch != 0) {
+                oldest = std::min(oldest, epoch);
+            }
+        }
+
+        auto safe = std::partition(retired.begin(), retired.end(), [oldest](const auto& object) {
+            return object.first >= oldest;
+        });
+        std::vector<std::function<void()>> frees;
+        for (auto it = safe; it != retired.end(); ++it) {
+            frees.push_back(std::move(it->second));
+        }
+        retired.erase(safe, retired.end());
+        for (auto& free : frees) {
+            free();
+        }
+        return frees.size();
+    }
+
+    /// \brief The number of retired objects still waiting for their readers.
+    std::size_t pending() const {
+        return retired.size();
+    }
+};
+
+
+
+/**
+ * \class Versioned
+ * \brief Holds the current version of an immutable object, in the style of read-copy-update.
+ *
+ * Readers get the current version with read(), without taking a lock, and can use it for as long as
+ * they hold on to the Snapshot, however many versions are published meanwhile. A writer builds the
+ * next version on the side and publish()es it with one atomic exchange; the version it replaces is
+ * freed through the EpochDomain once its last reader is gone. Only one thread may publish at a time.
+ */
+template <typename T>
+class Versioned {
+
+private:
+    mutable EpochDomain domain;
+    std::atomic<const T*> current{nullptr};
+    std::uint64_t published = 0;
+
+public:
+    /// \brief A pinned version; it stays valid and unchanged for as long as this object lives.
+    class Snapshot {
+
+    private:
+        EpochDomain::Guard guard;
+        const T* value;
+
+    public:
+        Snapshot(EpochDomain::Guard guard, const T* value) : guard(std::move(guard)), value(value) {
+        }
+
+        const T* operator->() const {
+            return value;
+        }
+
+        const T& operator*() const {
+            return *value;
+        }
+
+        explicit operator bool() const {
+            return value != nullptr;
+        }
+    };
+
+    Versioned() = default;
+
+    ~Versioned() {
+        delete current.load();
+    }
+
+    Versioned(const Versioned&) = delete;
+    Versioned& operator=(const Versioned&) = delete;
+
+    /// \brief The current version, or an empty Snapshot if nothing was published yet.
+    Snapshot read() const {
+        EpochDomain::Guard guard = domain.pin();
+        return Snapshot(std::move(guard), current.load());
+    }
+
+    /// \brief Makes a new version current and frees the old ones no reader holds any more.
+    void publish(std::unique_ptr<const T> next) {
+        const T* old = current.exchange(next.release());
+        if (old != nullptr) {
+            domain.retire([old]() {
+                delete old;
+            });
+        }
+        published++;
+        domain.reclaim();
+    }
+
+    /// \brief The current version, for the publishing thread only, which is the only one that can change it.
+    const T* latest() const {
+        return current.load(std::memory_order_relaxed);
+    }
+
+    /// \brief The number of versions published so far.
+    std::uint64_t versions() const {
+        return published;
+    }
+
+    /// \brief The number of old versions that are still pinned by readers.
+    std::size_t retained() const {
+        return domain.pending();
+    }
+};
+
+
+
+/**
+ * \class VaultSnapshot
+ * \brief An immutable version of the password sets and of the lookups readers need, see Versioned.
+ *
+ * The snapshot keeps what the name index, the category index and the alphabetic order answer, over a
+ * copy of the records: names and categories in plaintext, the other fields sealed. Consecutive versions
+ * share almost all of their memory. The records are kept in pages of pageSize ids, the name lookup in
+ * nameShards shards by name hash, the alphabetic order in blocks of up to 2 * blockSize ids and every
+ * category in a list of its own, each part held by a shared_ptr. A change copies the tables of pointers
+ * and only the parts it touches, so publishing a version costs a few thousand pointer copies, not a copy
+ * of the vault.
+ *
+ * Record ids are those of the PasswordManager's RecordStore. The changing methods may only be called on a
+ * draft no reader can see yet.
+ */
+class VaultSnapshot {
+
+public:
+    static constexpr std::size_t pageSize = 256;
+    static constexpr std::size_t nameShards = 1024;
+    static constexpr std::size_t blockSize = 1024;
+
+    struct Entry {
+        bool live = false;
+        std::string name;
+        std::string category;
+        std::string password;
+        std::string website;
+        std::string login;
+        std::string nonce;
+    };
+
+private:
+    using Page = std::vector<Entry>;
+    using Shard = std::vector<std::pair<std::uint64_t, RecordStore::Id>>;
+    using Block = std::vector<RecordStore::Id>;
+
+    std::vector<std::shared_ptr<Page>> pages;
+    std::vector<std::shared_ptr<Shard>> shards = std::vector<std::shared_ptr<Shard>>(nameShards);
+    std::unordered_map<std::string, std::shared_ptr<Block>> categories;
+    std::vector<std::shared_ptr<Block>> blocks;
+    std::size_t live = 0;
+
+    /// \brief The part itself if this draft is its only owner, otherwise a private copy of it.
+    template <typename Part>
+    static Part& own(std::shared_ptr<Part>& part) {
+        if (part == nullptr) {
+            part = std::make_shared<Part>();
+        } else if (part.use_count() > 1) {
+            part = std::make_shared<Part>(*part);
+        }
+        return *part;
+    }
+
+    bool comesBefore(RecordStore::Id x, RecordStore::Id y) const {
+        int compared = entry(x).name.compare(entry(y).name);
+        return compared < 0 || (compared == 0 && x < y);
+    }
+
+    /// \brief The block an id belongs to by its name: the first whose last id does not come before it.
+    std::size_t blockOf(RecordStore::Id id) const {
+        auto found = std::lower_bound(blocks.begin(), blocks.end(), id, [this](const auto& block, RecordStore::Id x) {
+            return comesBefore(block->back(), x);
+        });
+        return std::min(static_cast<std::size_t>(found - blocks.begin()), blocks.empty() ? 0 : blocks.size() - 1);
+    }
+
+public:
+    /// \brief A record; only valid if entry(id).live.
+    const Entry& entry(RecordStore::Id id) const {
+        static const Entry none;
+        std::size_t page = id / pageSize;
+        return page < pages.size() && pages[page] != nullptr ? (*pages[page])[id % pageSize] : none;
+    }
+
+    /// \brief The number of live records.
+    std::size_t size() const {
+        return live;
+    }
+
+    /// \brief The ids of all records with the given name, in ascending order.
+    std::vector<RecordStore::Id> findByName(const std::string& name) const {
+        std::vector<RecordStore::Id> matches;
+        std::uint64_t hash = NameIndex::hashName(name);
+        const std::shared_ptr<Shard>& shard = shards[hash % nameShards];
+        if (shard != nullptr) {
+            auto range = std::equal_range(shard->begin(), shard->end(), std::make_pair(hash, RecordStore::Id(0)),
+                                          [](const auto& x, const auto& y) { return x.first < y.first; });
+            for (auto it = range.first; it != range.second; ++it) {
+                if (entry(it->second).name == name) {
+                    matches.push_back(it->second);
+                }
+            }
+        }
+        std::sort(matches.begin(), matches.end());
+        return matches;
+    }
+
+    /// \brief The ids of all records in a category, in ascending order, or nullptr if it has none.
+    const std::vector<RecordStore::Id>* findByCategory(const std::string& category) const {
+        auto it = categories.find(category);
+        return it != categories.end() ? it->second.get() : nullptr;
+    }
+
+    /// \brief Visits the ids of all records in alphabetic order of their names.
+    template <typename Visitor>
+    void forEachAlphabetic(Visitor&& visit) const {
+        for (const auto& block : blocks) {
+            for (RecordStore::Id id : *block) {
+                visit(id);
+            }
+        }
+    }
+
+    /// \brief Adds a record under an id that is not live.
+    void insert(RecordStore::Id id, Entry record) {
+        std::size_t page = id / pageSize;
+        if (pages.size() <= page) {
+            pages.resize(page + 1);
+        }
+        Page& records = own(pages[page]);
+        records.resize(pageSize);
+        record.live = true;
+        records[id % pageSize] = std::move(record);
+        const Entry& stored = records[id % pageSize];
+        live++;
+
+        std::uint64_t hash = NameIndex::hashName(stored.name);
+        Shard& shard = own(shards[hash % nameShards]);
+        shard.insert(std::upper_bound(shard.begin(), shard.end(), std::make_pair(hash, id)), std::make_pair(hash, id));
+
+        Block& members = own(categories[stored.category]);
+        members.insert(std::upper_bound(members.begin(), members.end(), id), id);
+
+        if (blocks.empty()) {
+            blocks.push_back(std::make_shared<Block>(1, id));
+            return;
+        }
+        std::size_t index = blockOf(id);
+        Block& block = own(blocks[index]);
+        block.insert(std::upper_bound(block.begin(), block.end(), id, [this](RecordStore::Id x, RecordStore::Id y) {
+            return comesBefore(x, y);
+        }), id);
+        if (block.size() > 2 * blockSize) {
+            auto upper = std::make_shared<Block>(block.begin() + blockSize, block.end());
+            block.resize(blockSize);
+            blocks.insert(blocks.begin() + index + 1, std::move(upper));
+        }
+    }
+
+    /// \brief Removes a live record.
+    void erase(RecordStore::Id id) {
+        const Entry& record = entry(id);
+        if (!record.live) {
+            return;
+        }
+
+        std::uint64_t hash = NameIndex::hashName(record.name);
+        Shard& shard = own(shards[hash % nameShards]);
+        shard.erase(std::find(shard.begin(), shard.end(), std::make_pair(hash, id)));
+
+        auto category = categories.find(record.category);
+        Block& members = own(category->second);
+        members.erase(std::lower_bound(members.begin(), members.end(), id));
+        if (members.empty()) {
+            categories.erase(category);
+        }
+
+        std::size_t index = blockOf(id);
+        Block& block = own(blocks[index]);
+        block.erase(std::lower_bound(block.begin(), block.end(), id, [this](RecordStore::Id x, RecordStore::Id y) {
+            return comesBefore(x, y);
+        }));
+        if (block.empty()) {
+            blocks.erase(blocks.begin() + index);
+        }
+
+        own(pages[id / pageSize])[id % pageSize] = Entry();
+        live--;
+    }
+
+    /**
+     * \brief Builds a whole snapshot at once, far faster than inserting the records one by one.
+     *
+     * \param ordered The ids of all records, already in alphabetic order of their names.
+     * \param record Returns the record with a given id.
+     */
+    template <typename Source>
+    static std::unique_ptr<VaultSnapshot> build(const std::vector<RecordStore::Id>& ordered, Source&& record) {
+        auto snapshot = std::make_unique<VaultSnapshot>();
+        for (RecordStore::Id id : ordered) {
+            std::size_t page = id / pageSize;
+            if (snapshot->pages.size() <= page) {
+                snapshot->pages.resize(page + 1);
+            }
+            Page& records = own(snapshot->pages[page]);
+            records.resize(pageSize);
+            records[id % pageSize] = record(id);
+            records[id % pageSize].live = true;
+
+            std::uint64_t hash = NameIndex::hashName(records[id % pageSize].name);
+            own(snapshot->shards[hash % nameShards]).emplace_back(hash, id);
+            own(snapshot->categories[records[id % pageSize].category]).push_back(id);
+
+            if (snapshot->blocks.empty() || snapshot->blocks.back()->size() == blockSize) {
+                snapshot->blocks.push_back(std::make_shared<Block>());
+            }
+            snapshot->blocks.back()->push_back(id);
+        }
+        for (auto& shard : snapshot->shards) {
+            if (shard != nullptr) {
+                std::sort(shard->begin(), shard->end());
+            }
+        }
+        for (auto& category : snapshot->categories) {
+            std::sort(category.second->begin(), category.second->end());
+        }
+        snapshot->live = ordered.size();
+        return snapshot;
+    }
+};
+
+
+
+/**
+ * \struct FlushPolicy
+ * \brief Decides when blocks appended to a vault reach the disk.
+ *
+ * A flush writes every queued block with a single write() followed by a single fsync(), so the cost of
+ * the sync is shared by the whole group. What an add or a delete guarantees once it returns:
+ *
+ * - Immediate: the block has been written and synced. It survives a crash of the process and of the
+ *   machine. This is the default.
+ * - Count, Bytes: the block is queued until limit blocks, or limit bytes, are waiting. A crash loses
+ *   at most the last limit - 1 blocks, or fewer than limit bytes.
+ * - Time: the block is queued until the oldest waiting block is limit milliseconds old. The age is
+ *   checked whenever the manager is used, by appends and by pollFlush(), so an idle manager
+ *   keeps its queue until it is used again or destroyed.
+ * - Explicit: the block is queued until PasswordManager::flushWrites() is called.
+ *
+ * In every mode the queue is flushed when the policy changes, before a compaction, and when the
+ * PasswordManager is destroyed, so only a crash ever loses queued blocks. Blocks are always appended in
+ * order, and a flushed group is all-or-nothing: it goes through the write-ahead journal, see the
+ * journal namespace. The in-memory state never waits for the disk, so queries see queued changes
+ * right away.
+ */
+struct FlushPolicy {
+
+    enum Trigger : std::uint8_t {Immediate, Count, Bytes, Time, Explicit};
+
+    Trigger trigger = Immediate;
+
+    /// Blocks for Count, bytes for Bytes, milliseconds for Time; unused otherwise.
+    std::size_t limit = 0;
+};
+
+
+/**
+ * \brief Parses a flush policy written as immediate, explicit, count=<blocks>, bytes=<bytes> or time=<ms>.
+ *
+ * \param text The policy as typed on the command line.
+ * \param policy Receives the policy.
+ * \return False if the text is not a policy.
+ */
+bool parseFlushPolicy(const std::string& text, FlushPolicy& policy) {
+
+    if (text == "immediate" || text == "explicit") {
+        policy = {text == "immediate" ? FlushPolicy::Immediate : FlushPolicy::Explicit, 0};
+        return true;
+    }
+
+    static const std::pair<const char*, FlushPolicy::Trigger> triggers[] = {
+        {"count=", FlushPolicy::Count}, {"bytes=", FlushPolicy::Bytes}, {"time=", FlushPolicy::Time}};
+    for (const auto& trigger : triggers) {
+        std::size_t prefix = std::strlen(trigger.first);
+        if (text.compare(0, prefix, trigger.first) != 0 || text.size() == prefix
+            || text.find_first_not_of("0123456789", prefix) != std::string::npos) {
+            continue;
+        }
+        errno = 0;
+        unsigned long long limit = std::strtoull(text.c_str() + prefix, nullptr, 10);
+        if (errno == ERANGE || limit > SIZE_MAX) {
+            return false;
+        }
+        policy = {trigger.second, static_cast<std::size_t>(limit)};
+        return true;
+    }
+    return false;
+}
+
+
+/// Whether a PasswordManager restores its indexes from the sidecar of its vault and writes it on close.
+enum class IndexSidecar : std::uint8_t {Use, Ignore};
+
+
+/**
+ * \class PasswordManager
+ * \brief A class to manage passwords.
+ *
+ * This class provides functionality for managing passwords. It allows
+ * storing, retrieving, and manipulating password data stored in a
+ * specified file.
+ */
+class PasswordManager {
+
+private:
+    std::string fileName;
+    VaultFormat format = VaultFormat::Binary;
+    VaultHeader vaultHeader;
+    std::string vaultKey;
+    bool unlocked = false;
+    /// Set once by unlock() and never replaced: runSnapshotCommand() uses it without taking any lock.
+    std::unique_ptr<FieldCipher> cipher;
+    RecordStore passwords;
+    NameIndex nameIndex;
+    CategoryIndex categoryIndex;
+    AlphabeticOrder alphabeticOrder;
+
+    /// Built on the first substring search only, since it needs the websites and logins decrypted.
+    TrigramIndex textIndex;
+    bool textIndexBuilt = false;
+
+    /// Built on the first fuzzy search only, and from then on kept up to date like the other indexes.
+    BkTree nameTree;
+    bool nameTreeBuilt = false;
+
+    /// Number of blocks in the vault file, live password sets, overwritten ones and tombstones alike.
+    std::size_t fileBlocks = 0;
+
+    /// Length of the part of the vault file that holds valid blocks.
+    std::size_t validBytes = 0;
+
+    /// Share of dead blocks in the vault file above which it gets compacted.
+    double compactionRatio = 0.5;
+
+    /// Threads that loading and index rebuilds are spread over.
+    ThreadPool pool;
+
+    IndexSidecar sidecarMode = IndexSidecar::Use;
+
+    /// Whether the sidecar on disk still matches the vault and the indexes; see writeSidecar().
+    bool sidecarCurrent = false;
+
+    /// Whether a write to the vault file failed, so the file may lack something the indexes hold.
+    bool writeFailed = false;
+
+    /// The vault file as this object last saw it: which file it was, when it changed, the length of
+    /// the part held in memory and the last bytes of that part. See refresh().
+    dev_t knownDevice = 0;
+    ino_t knownInode = 0;
+    std::int64_t knownModified = 0;
+    std::size_t knownSize = 0;
+    std::size_t knownLength = 0;
+    std::string knownTail;
+
+    /// Set once the vault changed in a way only a full reload can catch up with.
+    bool reloadPending = false;
+
+    /// Watches the vault for changes by other processes, once watchForChanges() was called.
+    std::unique_ptr<VaultWatcher> watcher;
+
+    std::thread compactor;
+    int compactFd = -1;
+    bool compacting = false;
+    std::atomic<bool> compactionDone{false};
+    std::atomic<bool> compactionSucceeded{false};
+    std::string appendedDuringCompaction;
+    std::size_t blocksDuringCompaction = 0;
+
+    /// Dead blocks the running compaction leaves out; fileBlocks drops by this once it is swapped in.
+    std::size_t deadBlocksCompacted = 0;
+
+    FlushPolicy flushPolicy;
+    std::string deferredBlocks;
+    std::size_t deferredCount = 0;
+    std::chrono::steady_clock::time_point oldestDeferred;
+
+    /// The write-ahead journal, opened on first use.
+    int journalFd = -1;
+
+    /// Published versions of the password sets for readers on other threads, kept only once enabled.
+    bool snapshotsEnabled = false;
+    Versioned<VaultSnapshot> versions;
+    std::unique_ptr<VaultSnapshot> snapshotDraft;
+
+
+public:
+    /**
+     * \brief Opens a vault, creating it if the file does not exist yet.
+     *
+     * A new vault is created binary and sealed with ChaCha20-Poly1305 under a key derived with PBKDF2, whose
+     * iteration count is calibrated to defaultUnlockMilliseconds on this machine. The key is derived exactly
+     * once here and kept for the lifetime of the object.
+     *
+     * If the master password is wrong nothing is loaded and nothing is ever written; see isUnlocked(). Text
+     * vaults have no key, so for them the password is still checked against mainPassword.
+     *
+     * Once the password checks out, an update cut short by a crash is finished or undone, see
+     * recoverJournal(); a vault whose header was torn by a crash can't be opened in any case, since the
+     * header is written only when the vault is created or replaced. If the sidecar of the vault is still current, the password sets are loaded and indexed from it, see
+     * loadFromSidecar(); otherwise the whole vault is loaded and the indexes are rebuilt. All of this
+     * happens under the exclusive VaultLock, so no other process writes the vault meanwhile.
+     *
+     * \param fileName The vault file.
+     * \param masterPassword The master password the vault key is derived from.
+     * \param threads The number of threads to load the vault and build its indexes on; 0 means one per core.
+     * \param sidecar Whether to use the index sidecar; benchmarks of the load turn it off.
+     */
+    PasswordManager(const std::string& fileName, const std::string& masterPassword, std::size_t threads = 0,
+                    IndexSidecar sidecar = IndexSidecar::Use)
+        : fileName(fileName), pool(threads), sidecarMode(sidecar) {
+
+        VaultLock lock(fileName, LOCK_EX);
+        if (!unlock(masterPassword)) {
+            return;
+        }
+        lock.acquire();
+        recoverJournal(fileName);
+
+        if (!loadFromSidecar()) {
+            passwords = loadRecords();
+            rebuildIndexes();
+        }
+
+        // A torn block at the end of a binary vault would hide everything appended after it.
+        cutTornTail(validBytes);
+        rememberVault(validBytes);
+    }
+
+    ~PasswordManager() {
+        flushWrites();
+        finishCompaction();
+        writeSidecar();
+        // An empty journal has nothing left to recover, so it isn't left lying next to the vault. Other
+        // processes check under the lock that their journal is still there, see writeJournal().
+        struct stat info{};
+        if (journalFd >= 0 && ::fstat(journalFd, &info) == 0 && info.st_size == 0) {
+            VaultLock lock(fileName, LOCK_EX);
+            if (::fstat(journalFd, &info) == 0 && info.st_size == 0) {
+                std::remove(journal::fileOf(fileName).c_str());
+            }
+        }
+        if (journalFd >= 0) {
+            ::close(journalFd);
+        }
+    }
+
+    PasswordManager(const PasswordManager&) = delete;
+    PasswordManager& operator=(const PasswordManager&) = delete;
+
+    /**
+     * \brief Sets the share of dead blocks in the vault file above which it gets compacted.
+     *
+     * \param ratio A value between 0 and 1; 0 compacts after every delete, 1 never compacts.
+     */
+    void setCompactionRatio(double ratio) {
+        compactionRatio = ratio;
+    }
+
+    /// \brief Whether the master password opened the vault.
+    bool isUnlocked() const {
+        return unlocked;
+    }
+
+    /// \brief The number of password sets currently held in memory.
+    std::size_t passwordCount() const {
+        return passwords.size();
+    }
+
+    /**
+     * \brief Finds all password sets with the given name.
+     *
+     * The name is hashed and looked up in the name index, and the few records whose name hash matches
+     * are confirmed against their sort key. The cost does not depend on the size of the vault.
+     *
+     * \param name The decrypted name to look for.
+     * \return The ids of all matching records.
+     */
+    std::vector<RecordStore::Id> findByName(const std::string& name) const {
+
+        PM_TIME_SCOPE(Search);
+        std::vector<RecordStore::Id> matches;
+        nameIndex.forEachCandidate(NameIndex::hashName(name), [&](RecordStore::Id id) {
+            if (alphabeticOrder.key(id) == name) {
+                matches.push_back(id);
+            }
+        });
+        std::sort(matches.begin(), matches.end());
+        return matches;
+    }
+
+    /**
+     * \brief Finds all password sets in a category.
+     *
+     * \param category The decrypted category.
+     * \return The ids of its records in ascending order; empty also if the category does not exist.
+     */
+    std::vector<RecordStore::Id> findByCategory(const std::string& category) const {
+        PM_TIME_SCOPE(CategoryList);
+        const std::vector<RecordStore::Id>* members = categoryIndex.find(category);
+        return members != nullptr ? *members : std::vector<RecordStore::Id>();
+    }
+
+    /**
+     * \brief Visits all password sets in alphabetic order of their names.
+     *
+     * \param visit Called with the id and the decrypted name of every live record.
+     */
+    template <typename Visitor>
+    void forEachAlphabetic(Visitor&& visit) const {
+        PM_TIME_SCOPE(AlphabeticList);
+        for (RecordStore::Id id : alphabeticOrder.ids()) {
+            visit(id, alphabeticOrder.key(id));
+        }
+    }
+
+    /**
+     * \brief Finds all password sets whose name, website or login contains the given text.
+     *
+     * The query goes through the trigram index, so only records sharing all of its trigrams are ever looked
+     * at. The index is built on the first call. Upper and lower case letters match each other.
+     *
+     * \param text The text to look for.
+     * \param prefixOnly Whether a field has to start with the text rather than just contain it.
+     * \return The ids of all matching records, in alphabetic order of their names.
+     */
+    std::vector<RecordStore::Id> findContaining(const std::string& text, bool prefixOnly) {
+        PM_TIME_SCOPE(TextSearch);
+        prepareTextSearch();
+        std::vector<RecordStore::Id> matches = textIndex.search(text, prefixOnly);
+        std::sort(matches.begin(), matches.end(), [this](RecordStore::Id x, RecordStore::Id y) {
+            int compared = alphabeticOrder.key(x).compare(alphabeticOrder.key(y));
+            return compared < 0 || (compared == 0 && x < y);
+        });
+        return matches;
+    }
+
+    /**
+     * \brief Finds the password sets whose names are closest to a possibly misspelt one.
+     *
+     * The names are looked up in a BK-tree, so only a small part of the vault is ever compared with the
+     * query. The tree is built on the first call and rebuilt once most of its names have been deleted.
+     * Upper and lower case letters count as the same.
+     *
+     * \param name The name to look for.
+     * \param maxDistance The largest edit distance a result may have.
+     * \param limit The largest number of distinct names to return.
+     * \return The matching records, closest first, ties in alphabetic order.
+     */
+    std::vector<BkTree::Match> findClosest(const std::string& name, std::size_t maxDistance, std::size_t limit) {
+
+        PM_TIME_SCOPE(FuzzySearch);
+        prepareFuzzySearch();
+        return nameTree.closest(foldCase(name), maxDistance, limit, [this](RecordStore::Id id) -> const std::string& {
+            return alphabeticOrder.key(id);
+        });
+    }
+
+    /**
+     * \brief Builds the BK-tree for findClosest(), or rebuilds it if most of its names have been deleted.
+     *
+     * Right after this call findClosest() changes nothing, so it may run on several threads at once.
+     */
+    void prepareFuzzySearch() {
+        if (nameTreeBuilt && nameTree.isMostlyDead()) {
+            nameTree.clear();
+            nameTreeBuilt = false;
+        }
+        if (!nameTreeBuilt) {
+            passwords.forEachLive([this](RecordStore::Id id) {
+                nameTree.insert(foldCase(alphabeticOrder.key(id)), id);
+            });
+            nameTree.relayout();
+            nameTreeBuilt = true;
+        }
+    }
+
+    /**
+     * \brief Builds the trigram index for findContaining() unless it is built already.
+     *
+     * Websites and logins are decrypted for nothing else, so this is left until the first substring search
+     * rather than done on every start. Right after this call findContaining() changes nothing, so it may
+     * run on several threads at once.
+     */
+    void prepareTextSearch() {
+
+        if (textIndexBuilt) {
+            return;
+        }
+        PM_TIME_SCOPE(RebuildIndexes);
+        std::vector<RecordStore::Id> ids;
+        std::vector<std::string_view> encryptedWebsites;
+        std::vector<std::string_view> encryptedLogins;
+        std::vector<std::string_view> nonces;
+        ids.reserve(passwords.size());
+        encryptedWebsites.reserve(passwords.size());
+        encryptedLogins.reserve(passwords.size());
+        nonces.reserve(passwords.size());
+
+        passwords.forEachLive([&](RecordStore::Id id) {
+            ids.push_back(id);
+            encryptedWebsites.push_back(passwords.sealedField(id, Field::Website));
+            encryptedLogins.push_back(passwords.sealedField(id, Field::Login));
+            nonces.push_back(passwords.nonce(id));
+        });
+
+        // Names are already decrypted in the alphabetic order, so only the other two columns are opened.
+        std::size_t chunks = std::min(pool.size() * 4, ids.size() / 1024 + 1);
+        std::vector<std::string> texts(passwords.endId());
+
+        pool.parallelFor(chunks, [&](std::size_t chunk) {
+
+            std::size_t begin = ids.size() * chunk / chunks;
+            std::size_t end = ids.size() * (chunk + 1) / chunks;
+            std::vector<std::string_view> chunkWebsites(encryptedWebsites.begin() + begin,
+                                                        encryptedWebsites.begin() + end);
+            std::vector<std::string_view> chunkLogins(encryptedLogins.begin() + begin, encryptedLogins.begin() + end);
+            std::vector<std::string_view> chunkNonces(nonces.begin() + begin, nonces.begin() + end);
+
+            std::string websiteColumn;
+            std::string loginColumn;
+            std::vector<std::uint32_t> websiteOffsets;
+            std::vector<std::uint32_t> loginOffsets;
+            cipher->openColumn(chunkWebsites, chunkNonces, Field::Website, websiteColumn, websiteOffsets);
+            cipher->openColumn(chunkLogins, chunkNonces, Field::Login, loginColumn, loginOffsets);
+
+            auto slice = [](const std::string& column, const std::vector<std::uint32_t>& offsets, std::size_t k) {
+                return std::string_view(column).substr(offsets[k], offsets[k + 1] - offsets[k]);
+            };
+
+            for (std::size_t i = begin; i < end; i++) {
+                std::size_t k = i - begin;
+                texts[ids[i]] = TrigramIndex::indexedText(alphabeticOrder.key(ids[i]), slice(websiteColumn, websiteOffsets, k),
+                                                          slice(loginColumn, loginOffsets, k));
+            }
+        });
+
+        textIndex.assign(std::move(texts), pool);
+        textIndexBuilt = true;
+    }
+
+    /**
+     * \brief Starts keeping a VaultSnapshot of the password sets for readers on other threads.
+     *
+     * From then on every change is applied to a draft of the next version as well, which is published
+     * once the change is complete, see runSnapshotCommand(). This keeps a second copy of the records in
+     * memory, so only the daemon turns it on.
+     */
+    void enableSnapshots() {
+        if (!snapshotsEnabled) {
+            snapshotsEnabled = true;
+            snapshotDraft = buildSnapshot();
+            publishSnapshot();
+        }
+    }
+
+    /**
+     * \brief The latest published version of the password sets; empty unless enableSnapshots() was called.
+     *
+     * Any thread may call this at any time, also while another one changes the vault. The version never
+     * changes and stays valid for as long as the returned object is held.
+     */
+    Versioned<VaultSnapshot>::Snapshot snapshot() const {
+        return versions.read();
+    }
+
+    /// \brief The number of snapshot versions published so far, and of old ones readers still hold.
+    std::pair<std::uint64_t, std::size_t> snapshotVersions() const {
+        return {versions.versions(), versions.retained()};
+    }
+
+    /**
+     * \brief Answers a command of the batch language from the latest snapshot, without taking any lock.
+     *
+     * Exact name searches that find something, list and category are answered the same way runCommand()
+     * answers them. Any thread may call this at any time, also while another one changes the vault.
+     *
+     * \return False if the command can't be answered from a snapshot: it changes something, needs the
+     * trigram index or the BK-tree, is malformed, or snapshots are not enabled. Nothing is output then.
+     */
+    bool runSnapshotCommand(const std::string& line, std::string& output) const {
+
+        std::istringstream words(line);
+        std::vector<std::string> arguments;
+        std::string command;
+        words >> command;
+        for (std::string word; words >> word;) {
+            arguments.push_back(word);
+        }
+
+        Versioned<VaultSnapshot>::Snapshot snapshot = versions.read();
+        if (!snapshot) {
+            return false;
+        }
+
+        auto print = [&](RecordStore::Id id) {
+            const VaultSnapshot::Entry& entry = snapshot->entry(id);
+            output += entry.name;
+            output += '\t';
+            output += entry.category;
+            for (Field field : {Field::Website, Field::Login, Field::Password}) {
+                const std::string& sealed = field == Field::Website ? entry.website
+                                          : field == Field::Login ? entry.login : entry.password;
+                output += '\t';
+                output += cipher->open(sealed, entry.nonce, field);
+            }
+            output += '\n';
+        };
+
+        if (command == "search" && arguments.size() == 1) {
+            PM_TIME_SCOPE(Search);
+            std::vector<RecordStore::Id> matches = snapshot->findByName(arguments[0]);
+            if (matches.empty()) {
+                return false;
+            }
+            std::for_each(matches.begin(), matches.end(), print);
+            return true;
+        } else if (command == "list" && arguments.empty()) {
+            PM_TIME_SCOPE(AlphabeticList);
+            snapshot->forEachAlphabetic(print);
+            return true;
+        } else if (command == "category" && arguments.size() == 1) {
+            PM_TIME_SCOPE(CategoryList);
+            const std::vector<RecordStore::Id>* members = snapshot->findByCategory(arguments[0]);
+            if (members != nullptr) {
+                std::for_each(members->begin(), members->end(), print);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * \brief Adds a password set to the vault.
+     *
+     * \param plain The password set in plaintext; it is sealed under a fresh record nonce.
+     * \return True if its block was written to the vault file, or queued while writes are deferred. If not,
+     * the password set is not added.
+     */
+    bool insertPassword(const PasswordData& plain) {
+        PM_TIME_SCOPE(Insert);
+        PasswordData sealed = sealRecord(plain);
+        if (!appendToVault(serialize(sealed), 1)) {
+            return false;
+        }
+        storeRecord(sealed, plain);
+        publishSnapshot();
+        return true;
+    }
+
+    /**
+     * \brief Replaces a password set with a new version, keeping its record id.
+     *
+     * The record is updated in place and only its entries in the indexes are swapped, so nothing is
+     * rebuilt. On disk the edit is one append of two blocks: a tombstone for the old name followed by the
+     * new version, journaled so they reach the vault all-or-nothing. Since the tombstone cancels every
+     * password set of that name, a name shared by several password sets can't be edited this way.
+     *
+     * \param name The name of the password set to edit.
+     * \param plain The new version in plaintext, possibly under a new name; it is sealed under a fresh
+     * record nonce.
+     * \return False if there is no password set of that name or several of them, or if the vault file could
+     * not be written; the password sets in memory are then left as they were.
+     */
+    bool editByName(const std::string& name, const PasswordData& plain) {
+
+        PM_TIME_SCOPE(Edit);
+        std::vector<RecordStore::Id> matches = findByName(name);
+        if (matches.size() != 1) {
+            return false;
+        }
+
+        PasswordData sealed = sealRecord(plain);
+        if (!appendToVault(serializeTombstone(RecordKind::NameTombstone, name) + serialize(sealed), 2)) {
+            return false;
+        }
+
+        unindexRecord(matches[0], false);
+        passwords.replace(matches[0], viewOf(sealed), plain.category);
+        indexRecord(matches[0], plain, false);
+        if (textIndexBuilt) {
+            textIndex.replace(matches[0], TrigramIndex::indexedText(plain.name, plain.website, plain.login));
+        }
+
+        compactIfNeeded();
+        publishSnapshot();
+        return true;
+    }
+
+    /**
+     * \brief Deletes every password set with the given name.
+     *
+     * A single name tombstone is appended to the vault file, then the records are dropped from memory.
+     *
+     * \param name The decrypted name.
+     * \return The number of password sets deleted, or -1 if the tombstone could not be written; nothing is
+     * deleted then.
+     */
+    long removeByName(const std::string& name) {
+
+        PM_TIME_SCOPE(Delete);
+        std::vector<RecordStore::Id> matches = findByName(name);
+
+        if (!matches.empty() && !appendToVault(serializeTombstone(RecordKind::NameTombstone, name), 1)) {
+            return -1;
+        }
+
+        for (RecordStore::Id id : matches) {
+            eraseRecord(id);
+        }
+        collectGarbage();
+        compactIfNeeded();
+        publishSnapshot();
+        return static_cast<long>(matches.size());
+    }
+
+    /**
+     * \brief Deletes a category together with all of its password sets.
+     *
+     * \param category The decrypted category.
+     * \return The number of password sets deleted; 0 also if the category does not exist. -1 if the
+     * tombstone could not be written; nothing is deleted then.
+     */
+    long removeCategory(const std::string& category) {
+
+        PM_TIME_SCOPE(Delete);
+        const std::vector<RecordStore::Id>* members = categoryIndex.find(category);
+        if (members == nullptr) {
+            return 0;
+        }
+
+        if (!members->empty() && !appendToVault(serializeTombstone(RecordKind::CategoryTombstone, category), 1)) {
+            return -1;
+        }
+
+        std::vector<RecordStore::Id> doomed = *members;
+        for (RecordStore::Id id : doomed) {
+            eraseRecord(id);
+        }
+        categoryIndex.remove(category);
+        collectGarbage();
+        compactIfNeeded();
+        publishSnapshot();
+        return static_cast<long>(doomed.size());
+    }
+
+    /**
+     * \brief Sets when appended blocks reach the disk; see FlushPolicy for what each policy guarantees.
+     *
+     * Whatever is queued under the old policy is flushed first.
+     */
+    void setFlushPolicy(FlushPolicy policy) {
+        flushWrites();
+        flushPolicy = policy;
+    }
+
+    FlushPolicy getFlushPolicy() const {
+        return flushPolicy;
+    }
+
+    /// \brief Flushes the queue if the flush policy says it is due, e.g. because the time limit has passed.
+    void pollFlush() {
+        if (!deferredBlocks.empty() && flushDue()) {
+            flushWrites();
+        }
+    }
+
+    /// \brief The number of appended blocks that have not reached the disk yet.
+    std::size_t pendingBlocks() const {
+        return deferredCount;
+    }
+
+    /**
+     * \brief Writes all queued blocks to the vault file with one write and one fsync.
+     *
+     * \return True if nothing was queued or the queued blocks were written and synced.
+     */
+    bool flushWrites() {
+        if (deferredBlocks.empty()) {
+            return true;
+        }
+        bool written = writeBlocks(deferredBlocks, deferredCount);
+        fileBlocks -= written ? 0 : deferredCount;
+        deferredBlocks.clear();
+        deferredCount = 0;
+        return written;
+    }
+
+    /**
+     * \brief Starts watching the vault for changes made by other processes; see refresh().
+     */
+    void watchForChanges() {
+        if (watcher == nullptr) {
+            watcher = std::make_unique<VaultWatcher>(fileName);
+        }
+    }
+
+    /// \brief A descriptor that turns readable when the vault may have changed, or -1 if it must be polled.
+    int changeDescriptor() const {
+        return watcher == nullptr ? -1 : watcher->descriptor();
+    }
+
+    /**
+     * \brief Catches up with changes other processes made to the vault since this object last saw it.
+     *
+     * If they only appended to the vault, only the appended blocks are read and applied to the password sets
+     * and indexes in memory, see applyAppended(). If the vault was replaced, as by a compaction, or if this
+     * object wrote its own blocks after foreign ones it hadn't taken in yet, the vault is loaded again from
+     * scratch. Queued writes go out first. A vault replaced by one sealed under another key is left alone,
+     * see sameSealing(); the cipher is never swapped, since snapshot readers use it without a lock.
+     *
+     * This is cheap to call often: with watchForChanges() it returns at once unless the watcher reported a
+     * change, and otherwise it costs one stat() of the vault.
+     *
+     * \return True if the password sets in memory changed.
+     */
+    bool refresh() {
+
+        if (!unlocked || (watcher != nullptr && !watcher->mayHaveChanged() && !reloadPending)) {
+            return false;
+        }
+        if (watcher != nullptr) {
+            watcher->settle();
+        }
+        struct stat info{};
+        if (!vaultChanged(info) && !reloadPending) {
+            return false;
+        }
+
+        flushWrites();
+        finishCompaction();
+        VaultLock lock(fileName, LOCK_EX);
+        replayJournal(fileName);
+        if (!vaultChanged(info) && !reloadPending) {
+            return false;
+        }
+        if (!reloadPending && vaultOnlyGrew(info)) {
+            applyAppended();
+        } else if (!reloadVault()) {
+            return false;
+        }
+        publishSnapshot();
+        return true;
+    }
+
+    /**
+     * \brief Main application loop.
+     *
+     * This method continuously displays a command menu and waits for user input. Depending on the input,
+     * it calls appropriate methods to perform actions such as searching passwords by name or by text, sorting passwords,
+     * adding or editing a password, and adding or deleting a category. If the input is not recognized,
+     * it prints an error message and waits for another input. Changes other processes made to the vault
+     * are taken in before every command, see refresh().
+     */
+    void run() {
+        std::string command;
+        watchForChanges();
+
+        while (true) {
+
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "| Pick a number of a command  |" << std::endl;
+            std::cout << "| that you would like to use  |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "| 1. Search                   |" << std::endl;
+            std::cout << "| 2. Sort passwords           |" << std::endl;
+            std::cout << "| 3. Add password             |" << std::endl;
+            std::cout << "| 4. Edit password            |" << std::endl;
+            std::cout << "| 5. Delete password          |" << std::endl;
+            std::cout << "| 6. Delete category          |" << std::endl;
+            std::cout << "| 7. Text search              |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+
+            if (!(std::cin >> command)) {
+                return;
+            }
+            pollFlush();
+            refresh();
+
+            if (command == "1") {
+                searchPasswords();
+            } else if (command == "2") {
+                sortPasswords();
+            } else if (command == "3") {
+                addPassword();
+            } else if (command == "4") {
+                editPassword();
+            } else if (command == "5") {
+                deletePassword();
+            } else if (command == "6") {
+                deleteCategory();
+            } else if (command == "7") {
+                textSearchPasswords();
+            } else {
+                std::cout << "-------------------------------" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|       Unknown command.      |" << std::endl;
+                std::cout << "|       Please try again.     |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "-------------------------------" << std::endl;
+            }
+        }
+    }
+
+    /**
+     * \brief Runs one command of the batch language, see runBatch().
+     *
+     * \param line The command and its arguments, separated by whitespace.
+     * \param output Receives the results.
+     * \return An error message, or an empty string if the command ran. Empty lines and comments run.
+     */
+    std::string runCommand(const std::string& line, std::string& output) {
+
+        std::istringstream words(line);
+        std::vector<std::string> arguments;
+        std::string command;
+        words >> command;
+        for (std::string word; words >> word;) {
+            arguments.push_back(word);
+        }
+
+        if (command.empty() || command[0] == '#') {
+            return std::string();
+        }
+
+        static const std::unordered_map<std::string, std::size_t> arity = {
+            {"add", 5}, {"edit", 6}, {"search", 1}, {"contains", 1}, {"prefix", 1}, {"list", 0}, {"category", 1},
+            {"delete", 1}, {"deletecategory", 1}, {"flush", 0}, {"stats", 0}};
+        auto wanted = arity.find(command);
+
+        auto print = [&](RecordStore::Id id) {
+            output += alphabeticOrder.key(id);
+            for (Field field : {Field::Category, Field::Website, Field::Login, Field::Password}) {
+                output += '\t';
+                output += decryptField(id, field);
+            }
+            output += '\n';
+        };
+
+        if (wanted == arity.end()) {
+            return "unknown command " + command;
+        } else if (arguments.size() != wanted->second) {
+            return command + " takes " + std::to_string(wanted->second) + " arguments";
+        } else if (command == "add") {
+            PasswordData plain;
+            plain.name = arguments[0];
+            plain.login = arguments[1];
+            plain.password = arguments[2];
+            plain.category = arguments[3];
+            plain.website = arguments[4];
+            if (!insertPassword(plain)) {
+                return "can't write the vault";
+            }
+        } else if (command == "search") {
+            std::vector<RecordStore::Id> matches = findByName(arguments[0]);
+            if (matches.empty()) {
+                for (const auto& match : findClosest(arguments[0], maxTypos, 5)) {
+                    matches.push_back(match.id);
+                }
+            }
+            std::for_each(matches.begin(), matches.end(), print);
+        } else if (command == "contains" || command == "prefix") {
+            for (RecordStore::Id id : findContaining(arguments[0], command == "prefix")) {
+                print(id);
+            }
+        } else if (command == "list") {
+            forEachAlphabetic([&](RecordStore::Id id, const std::string&) {
+                print(id);
+            });
+        } else if (command == "category") {
+            for (RecordStore::Id id : findByCategory(arguments[0])) {
+                print(id);
+            }
+        } else if (command == "edit") {
+            PasswordData plain;
+            plain.name = arguments[1];
+            plain.login = arguments[2];
+            plain.password = arguments[3];
+            plain.category = arguments[4];
+            plain.website = arguments[5];
+            std::size_t matches = findByName(arguments[0]).size();
+            if (matches > 1) {
+                return "several password sets are named " + arguments[0];
+            }
+            bool edited = editByName(arguments[0], plain);
+            if (!edited && matches == 1) {
+                return "can't write the vault";
+            }
+            output += "edited " + std::to_string(edited ? 1 : 0) + "\n";
+        } else if (command == "delete") {
+            long deleted = removeByName(arguments[0]);
+            if (deleted < 0) {
+                return "can't write the vault";
+            }
+            output += "deleted " + std::to_string(deleted) + "\n";
+        } else if (command == "deletecategory") {
+            long deleted = removeCategory(arguments[0]);
+            if (deleted < 0) {
+                return "can't write the vault";
+            }
+            output += "deleted " + std::to_string(deleted) + "\n";
+        } else if (command == "flush") {
+            flushWrites();
+        } else if (command == "stats") {
+#ifdef PM_ENABLE_STATS
+            std::ostringstream report;
+            stats::report(report);
+            output += report.str();
+#else
+            return "built without PM_ENABLE_STATS";
+#endif
+        }
+        return std::string();
+    }
+
+    /**
+     * \brief Whether a command of the batch language leaves the password sets and the vault file alone.
+     *
+     * Such commands may run on several threads at once, as long as no other command runs meanwhile and
+     * prepareFuzzySearch() and prepareTextSearch() were called after the last change; see runDaemon().
+     */
+    static bool isReadOnlyCommand(const std::string& line) {
+        std::istringstream words(line);
+        std::string command;
+        words >> command;
+        return command == "search" || command == "contains" || command == "prefix" || command == "list"
+               || command == "category" || command == "stats" || command.empty() || command[0] == '#';
+    }
+
+    /**
+     * \brief Runs a script of commands without the menu.
+     *
+     * Every line is one command, its arguments separated by whitespace:
+     *
+     *     add <name> <login> <password> <category> <website>
+     *     search <name>        exact name, or the closest names if there is none
+     *     contains <text>      name, website or login containing the text
+     *     prefix <text>        name, website or login starting with the text
+     *     list                 all password sets in alphabetic order
+     *     category <category>  all password sets of a category
+     *     edit <name> <new name> <login> <password> <category> <website>
+     *     delete <name>
+     *     deletecategory <category>
+     *     flush                write all queued changes to the vault file now
+     *     stats                latency histograms and counters so far, see stats::report()
+     *
+     * Empty lines and lines starting with '#' are skipped. Found password sets are printed one per line as
+     * name, category, website, login and password separated by tabs; deletions print the number of password
+     * sets deleted, and malformed lines an error naming the line.
+     *
+     * Nothing is flushed line by line: the output is collected and written in large pieces, and the blocks
+     * appended to the vault file follow the flush policy. Under the default Immediate policy they are
+     * written a megabyte at a time for the length of the script instead. In any case they are flushed on
+     * 'flush' and at the end of the script.
+     *
+     * Once watchForChanges() was called, changes other processes made to the vault are taken in before
+     * each line, see refresh().
+     *
+     * \param script The commands.
+     * \param out Receives the results.
+     * \return The number of lines that could not be run.
+     */
+    std::size_t runBatch(std::istream& script, std::ostream& out) {
+
+        std::string output;
+        std::string line;
+        std::size_t lineNumber = 0;
+        std::size_t errors = 0;
+
+        // Unless the caller chose a policy, writes are grouped a megabyte at a time.
+        FlushPolicy previousPolicy = flushPolicy;
+        if (flushPolicy.trigger == FlushPolicy::Immediate) {
+            setFlushPolicy({FlushPolicy::Bytes, 1 << 20});
+        }
+
+        while (std::getline(script, line)) {
+
+            lineNumber++;
+            if (watcher != nullptr) {
+                refresh();
+            }
+            std::string error = runCommand(line, output);
+            if (!error.empty()) {
+                output += "error: line " + std::to_string(lineNumber) + ": " + error + "\n";
+                errors++;
+            }
+
+            if (output.size() >= (1 << 16)) {
+                out << output;
+                output.clear();
+            }
+            pollFlush();
+        }
+
+        setFlushPolicy(previousPolicy);
+        out << output;
+        out.flush();
+        return errors;
+    }
+
+
+
+    /**
+     * \brief Loads password data from the source file into a record store.
+     *
+     * This method maps the source file specified by fileName into memory and walks it block by block in
+     * whichever format the file is in, so nothing is copied through a stream buffer. Every field is then copied exactly once, straight from the
+     * mapping into the arena of the RecordStore. The fields stay encrypted and are only decrypted when they are shown,
+     * except for the category, which the store interns in plaintext.
+     *
+     * The file is a log, so a password set is only loaded if no tombstone written after it cancels it. Only the
+     * position of the last tombstone per name and per category is remembered, which needs one extra pass over
+     * the mapping, and that pass is skipped entirely when the file contains no tombstones.
+     *
+     * The mapping is cut into chunks at block boundaries by splitRecords(), and both passes run over the
+     * chunks on the thread pool. Each chunk knows the file position of its first block, so the tombstones
+     * found in all chunks can be merged before any password set is materialized. The chunks are joined in
+     * file order, so the result is the same as with a single thread.
+     * The store of loaded passwords is then returned.
+     *
+     * With the indexes of a current sidecar the tombstone pass is skipped as well: only the blocks the
+     * sidecar lists are loaded, and their categories are taken from it instead of being decrypted.
+     *
+     * \param restored The indexes from the sidecar, or nullptr to load the vault on its own.
+     * \return A RecordStore holding all passwords loaded from the source file.
+     */
+    RecordStore loadRecords(const sidecar::Indexes* restored = nullptr){
+
+        PM_TIME_SCOPE(Load);
+        MappedFile file(fileName);
+        std::string_view buffer = file.view();
+
+        std::size_t header = format == VaultFormat::Binary && !buffer.empty() ? headerSize(buffer) : 0;
+        std::string_view records = buffer.substr(header);
+        if (restored != nullptr) {
+            records = records.substr(0, restored->validBytes > header ? restored->validBytes - header : 0);
+        }
+
+        // A few chunks per thread, so one slow chunk does not hold up the others.
+        std::vector<RecordChunk> chunks = splitRecords(records, format, pool.size() * 4);
+
+        // Sealed names differ from record to record, so tombstones are matched on the decrypted keys.
+        struct ChunkTombstones {
+            std::unordered_map<std::string, std::size_t> names;
+            std::unordered_map<std::string, std::size_t> categories;
+            std::size_t validBytes = 0;
+        };
+        std::vector<ChunkTombstones> found(chunks.size());
+
+        auto collectTombstones = [this](ChunkTombstones& tombstones, std::size_t firstBlock) {
+            return [this, &tombstones, position = firstBlock](const RecordView& record) mutable {
+                if (record.kind == RecordKind::NameTombstone) {
+                    tombstones.names[cipher->open(record.name, record.nonce, Field::Name)] = position;
+                } else if (record.kind == RecordKind::CategoryTombstone) {
+                    tombstones.categories[cipher->open(record.category, record.nonce, Field::Category)] = position;
+                }
+                position++;
+            };
+        };
+
+        // The binary walk always needs a first pass, which also verifies the checksums and finds the end of
+        // the valid blocks, so the second pass can skip them. Everything after the first broken block is
+        // dropped, even if later chunks are intact.
+        bool hasTombstones = true;
+        if (restored != nullptr) {
+            hasTombstones = false;
+        } else if (format == VaultFormat::Binary) {
+            pool.parallelFor(chunks.size(), [&](std::size_t c) {
+                found[c].validBytes = forEachBinaryRecord(chunks[c].bytes, collectTombstones(found[c], chunks[c].firstBlock));
+            });
+            for (std::size_t c = 0; c < chunks.size(); c++) {
+                if (found[c].validBytes < chunks[c].bytes.size()) {
+                    chunks[c].bytes = chunks[c].bytes.substr(0, found[c].validBytes);
+                    chunks.resize(c + 1);
+                    break;
+                }
+            }
+        } else {
+            hasTombstones = records.substr(0, 1) == "#" || records.find("\n#") != std::string_view::npos;
+            if (hasTombstones) {
+                pool.parallelFor(chunks.size(), [&](std::size_t c) {
+                    forEachTextRecord(chunks[c].bytes, collectTombstones(found[c], chunks[c].firstBlock));
+                });
+            }
+        }
+        validBytes = header + (chunks.empty() ? 0 : chunks.back().bytes.data() + chunks.back().bytes.size() - records.data());
+
+        // Chunks are merged in file order, so the last tombstone per key wins.
+        std::unordered_map<std::string, std::size_t> lastNameTombstone;
+        std::unordered_map<std::string, std::size_t> lastCategoryTombstone;
+        for (std::size_t c = 0; c < chunks.size(); c++) {
+            for (auto& tombstone : found[c].names) {
+                lastNameTombstone[tombstone.first] = tombstone.second;
+            }
+            for (auto& tombstone : found[c].categories) {
+                lastCategoryTombstone[tombstone.first] = tombstone.second;
+            }
+        }
+        found.clear();
+
+        auto cancelled = [this](const std::unordered_map<std::string, std::size_t>& tombstones,
+                                const RecordView& record, Field field, std::size_t position) {
+            if (tombstones.empty()) {
+                return false;
+            }
+            std::string_view sealed = field == Field::Name ? record.name : record.category;
+            auto it = tombstones.find(cipher->open(sealed, record.nonce, field));
+            return it != tombstones.end() && it->second > position;
+        };
+
+        std::vector<RecordStore> loadedChunks(chunks.size());
+        std::vector<std::size_t> chunkBlocks(chunks.size());
+
+        pool.parallelFor(chunks.size(), [&](std::size_t c) {
+
+            std::size_t position = chunks[c].firstBlock;
+            RecordStore& loadedPasswords = loadedChunks[c];
+            std::string category;
+            std::size_t listed = 0;
+            if (restored != nullptr) {
+                listed = std::lower_bound(restored->blocks.begin(), restored->blocks.end(), position) - restored->blocks.begin();
+            }
+
+            auto load = [&](const RecordView& record) {
+
+                std::size_t current = position++;
+                if (restored != nullptr) {
+                    if (listed < restored->blocks.size() && restored->blocks[listed] == current) {
+                        if (record.kind == RecordKind::Entry) {
+                            loadedPasswords.add(record, restored->categories[restored->categoryOf[listed]]);
+                        }
+                        listed++;
+                    }
+                    return;
+                }
+                if (record.kind != RecordKind::Entry) {
+                    return;
+                }
+                if (hasTombstones && (cancelled(lastNameTombstone, record, Field::Name, current)
+                                      || cancelled(lastCategoryTombstone, record, Field::Category, current))) {
+                    return;
+                }
+
+                category.resize(record.category.size());
+                long length = cipher->openInto(record.category, record.nonce, Field::Category, category.data());
+                category.resize(length < 0 ? 0 : static_cast<std::size_t>(length));
+
+                loadedPasswords.add(record, category);
+            };
+
+            if (format == VaultFormat::Binary) {
+                forEachBinaryRecord(chunks[c].bytes, load, false);
+            } else {
+                forEachTextRecord(chunks[c].bytes, load);
+            }
+            chunkBlocks[c] = position - chunks[c].firstBlock;
+        });
+
+        fileBlocks = 0;
+        for (std::size_t c = 0; c < chunks.size(); c++) {
+            fileBlocks += chunkBlocks[c];
+        }
+
+        // The columns of a single chunk grew by doubling, so they are tightened once at the end.
+        RecordStore loadedPasswords;
+        if (loadedChunks.size() == 1) {
+            loadedPasswords = std::move(loadedChunks[0]);
+        } else {
+            loadedPasswords.reserveFor(loadedChunks);
+            for (auto& chunk : loadedChunks) {
+                loadedPasswords.append(std::move(chunk));
+            }
+        }
+        loadedPasswords.shrinkToFit();
+        return loadedPasswords;
+    }
+
+    /**
+     * \brief Loads the vault the way it used to be held, as one PasswordData per password set.
+     *
+     * Only the benchmarks use this, as the baseline the record store is measured against.
+     *
+     * \return The sealed password sets, in file order.
+     */
+    std::vector<PasswordData> loadToVector(){
+        RecordStore store = loadRecords();
+        std::vector<PasswordData> loadedPasswords;
+        loadedPasswords.reserve(store.size());
+        store.forEachLive([&](RecordStore::Id id) {
+            loadedPasswords.push_back(sealedRecord(store, id));
+        });
+        return loadedPasswords;
+    }
+
+
+
+    /**
+     * \brief Loads the password sets and their indexes with the help of the sidecar, if it is still current.
+     *
+     * The sidecar is mapped, checked against its checksum and the identity of the vault, and opened with the
+     * vault cipher. Then only the blocks it lists are loaded, with the categories it gives, and the name
+     * index, the category index and the alphabetic order are filled straight from it; nothing is decrypted
+     * or sorted. The vault was checked when the sidecar was written and hasn't changed since, so its block
+     * checksums aren't verified again.
+     *
+     * \return False if there is no usable sidecar; the vault must then be loaded as usual.
+     */
+    bool loadFromSidecar() {
+
+        if (sidecarMode == IndexSidecar::Ignore) {
+            return false;
+        }
+
+        sidecar::Indexes indexes;
+        {
+            MappedFile file(sidecar::fileOf(fileName));
+            sidecar::Identity recorded;
+            sidecar::Identity current;
+            std::string_view nonce;
+            std::string_view sealed;
+            if (!sidecar::decode(file.view(), recorded, nonce, sealed) || !sidecar::identify(fileName, current)
+                || !(recorded == current)) {
+                return false;
+            }
+            if (!sidecar::decodeIndexes(cipher->open(sealed, nonce, Field::Name), indexes)
+                || indexes.validBytes > recorded.length) {
+                return false;
+            }
+        }
+
+        RecordStore loaded = loadRecords(&indexes);
+        if (loaded.size() != indexes.blocks.size() || loaded.endId() != indexes.blocks.size()
+            || fileBlocks != indexes.fileBlocks) {
+            return false;
+        }
+        passwords = std::move(loaded);
+        restoreIndexes(indexes);
+        sidecarCurrent = true;
+        return true;
+    }
+
+    /// \brief Fills the indexes from a sidecar whose records have just been loaded, see loadFromSidecar().
+    void restoreIndexes(sidecar::Indexes& indexes) {
+
+        PM_TIME_SCOPE(RebuildIndexes);
+        nameIndex.clear();
+        categoryIndex.clear();
+        textIndex.clear();
+        textIndexBuilt = false;
+        nameTree.clear();
+        nameTreeBuilt = false;
+
+        std::size_t records = indexes.blocks.size();
+        std::vector<std::string> names(records);
+        nameIndex.reserve(records);
+        for (std::size_t i = 0; i < records; i++) {
+            nameIndex.insert(indexes.hashes[i], static_cast<RecordStore::Id>(i));
+            names[i].assign(indexes.name(i));
+        }
+        for (std::size_t c = 0; c < indexes.categories.size(); c++) {
+            categoryIndex.assign(indexes.categories[c], std::move(indexes.postings[c]));
+        }
+        alphabeticOrder.assignSorted(std::move(names), std::move(indexes.order));
+    }
+
+    /**
+     * \brief Writes the sidecar of the vault, so the next start can skip the index rebuild.
+     *
+     * Record ids need not follow the file, since an edit keeps the id of the password set it changes, so the
+     * live blocks are found by walking the vault once more. Every entry block is matched to the records with
+     * the same nonce and sealed fields, without decrypting anything. Where more blocks match than there are
+     * such records, as with the copies an edit writes again, the last ones are live: nothing after the last
+     * tombstone of a name or category can cancel them. If the blocks and the records don't add up, no
+     * sidecar is written and the next start rebuilds the indexes.
+     *
+     * Nothing is written if the sidecar is current already, if a write to the vault failed, if another
+     * process changed the vault since this object last saw it, or if the vault holds no password sets. The
+     * file is renamed into place but not synced: a torn sidecar fails its checksum and costs no more than
+     * one rebuild. All of this happens under the exclusive VaultLock, so processes closing the same vault
+     * take turns.
+     */
+    void writeSidecar() {
+
+        if (sidecarMode == IndexSidecar::Ignore || !unlocked || sidecarCurrent) {
+            return;
+        }
+        // A process that changed the vault later may have left a sidecar that is current.
+        VaultLock lock(fileName, LOCK_EX);
+        struct stat info{};
+        if (reloadPending || vaultChanged(info)) {
+            return;
+        }
+        std::string sidecarFile = sidecar::fileOf(fileName);
+        std::remove(sidecarFile.c_str());
+
+        sidecar::Identity identity;
+        if (writeFailed || passwords.size() == 0 || !sidecar::identify(fileName, identity)) {
+            return;
+        }
+        MappedFile file(fileName);
+        std::string_view buffer = file.view();
+        if (buffer.size() != identity.length) {
+            return;
+        }
+        std::size_t header = format == VaultFormat::Binary ? headerSize(buffer) : 0;
+
+        // Text records have no nonce, so there the sealed category has to tell records apart as well.
+        bool withCategory = format == VaultFormat::Text;
+        auto contentHash = [](std::initializer_list<std::string_view> fields) {
+            std::uint64_t hash = 0;
+            for (std::string_view field : fields) {
+                hash = (hash ^ NameIndex::hashName(field)) * 1099511628211ULL;
+            }
+            return hash;
+        };
+        auto sealedCategory = [this, withCategory](RecordStore::Id id) {
+            return withCategory ? cipher->seal(passwords.category(id), {}, Field::Category) : std::string();
+        };
+        auto sameContent = [&](RecordStore::Id id, const RecordView& record) {
+            return passwords.nonce(id) == record.nonce && passwords.sealedField(id, Field::Name) == record.name
+                   && passwords.sealedField(id, Field::Password) == record.password
+                   && passwords.sealedField(id, Field::Website) == record.website
+                   && passwords.sealedField(id, Field::Login) == record.login
+                   && (!withCategory || sealedCategory(id) == record.category);
+        };
+
+        std::vector<std::pair<std::uint64_t, RecordStore::Id>> keyed;
+        keyed.reserve(passwords.size());
+        passwords.forEachLive([&](RecordStore::Id id) {
+            keyed.emplace_back(contentHash({passwords.nonce(id), passwords.sealedField(id, Field::Name),
+                                            passwords.sealedField(id, Field::Password),
+                                            passwords.sealedField(id, Field::Website),
+                                            passwords.sealedField(id, Field::Login), sealedCategory(id)}), id);
+        });
+        std::sort(keyed.begin(), keyed.end());
+
+        // Records with the same content form a group, named after its smallest id.
+        std::vector<std::pair<std::uint32_t, RecordStore::Id>> matched;
+        std::vector<std::uint32_t> groupSize(passwords.endId());
+        std::size_t position = 0;
+        auto match = [&](const RecordView& record) {
+            std::size_t current = position++;
+            if (record.kind != RecordKind::Entry) {
+                return;
+            }
+            std::uint64_t hash = contentHash({record.nonce, record.name, record.password, record.website, record.login,
+                                              withCategory ? record.category : std::string_view()});
+            RecordStore::Id group = 0;
+            std::uint32_t members = 0;
+            for (auto it = std::lower_bound(keyed.begin(), keyed.end(), std::make_pair(hash, RecordStore::Id(0)));
+                 it != keyed.end() && it->first == hash; ++it) {
+                if (sameContent(it->second, record) && members++ == 0) {
+                    group = it->second;
+                }
+            }
+            if (members > 0) {
+                groupSize[group] = members;
+                matched.emplace_back(static_cast<std::uint32_t>(current), group);
+            }
+        };
+
+        std::size_t walked = buffer.size();
+        if (format == VaultFormat::Binary) {
+            walked = header + forEachBinaryRecord(buffer.substr(header), match, false);
+        } else {
+            forEachTextRecord(buffer, match);
+        }
+        if (walked != buffer.size() || position != fileBlocks || position > UINT32_MAX) {
+            return;
+        }
+
+        std::vector<std::uint32_t> blocks;
+        std::vector<RecordStore::Id> owners;
+        for (auto it = matched.rbegin(); it != matched.rend(); ++it) {
+            if (groupSize[it->second] > 0) {
+                groupSize[it->second]--;
+                blocks.push_back(it->first);
+                owners.push_back(it->second);
+            }
+        }
+        if (blocks.size() != passwords.size()) {
+            return;
+        }
+        std::reverse(blocks.begin(), blocks.end());
+        std::reverse(owners.begin(), owners.end());
+
+        sidecar::Indexes indexes;
+        std::size_t records = blocks.size();
+        indexes.validBytes = walked;
+        indexes.fileBlocks = position;
+        indexes.blocks = std::move(blocks);
+        indexes.hashes.resize(records);
+        indexes.nameOffsets.reserve(records + 1);
+
+        std::unordered_map<std::string, std::uint32_t> categoryNumbers;
+        for (std::size_t i = 0; i < records; i++) {
+            const std::string& name = alphabeticOrder.key(owners[i]);
+            indexes.hashes[i] = NameIndex::hashName(name);
+            indexes.nameOffsets.push_back(static_cast<std::uint32_t>(indexes.names.size()));
+            indexes.names += name;
+
+            auto number = categoryNumbers.emplace(passwords.category(owners[i]),
+                                                  static_cast<std::uint32_t>(indexes.categories.size()));
+            if (number.second) {
+                indexes.categories.push_back(passwords.category(owners[i]));
+                indexes.postings.emplace_back();
+            }
+            indexes.postings[number.first->second].push_back(static_cast<std::uint32_t>(i));
+        }
+        if (indexes.names.size() > UINT32_MAX) {
+            return;
+        }
+        indexes.nameOffsets.push_back(static_cast<std::uint32_t>(indexes.names.size()));
+
+        // The alphabetic order is carried over from memory. Every group comes out in file order, and the
+        // runs of equal names are put back in file order as well.
+        std::vector<std::uint32_t> firstRank(passwords.endId() + 1);
+        for (RecordStore::Id owner : owners) {
+            firstRank[owner + 1]++;
+        }
+        for (std::size_t id = 0; id < passwords.endId(); id++) {
+            firstRank[id + 1] += firstRank[id];
+        }
+        std::vector<std::uint32_t> ranks(records);
+        std::vector<std::uint32_t> filled(firstRank.begin(), firstRank.end() - 1);
+        for (std::size_t i = 0; i < records; i++) {
+            ranks[filled[owners[i]]++] = static_cast<std::uint32_t>(i);
+        }
+        indexes.order.reserve(records);
+        for (RecordStore::Id id : alphabeticOrder.ids()) {
+            indexes.order.insert(indexes.order.end(), ranks.begin() + firstRank[id], ranks.begin() + firstRank[id + 1]);
+        }
+        for (std::size_t begin = 0, end = 0; begin < records; begin = end) {
+            for (end = begin + 1; end < records && indexes.name(indexes.order[end]) == indexes.name(indexes.order[begin]); end++) {
+            }
+            std::sort(indexes.order.begin() + begin, indexes.order.begin() + end);
+        }
+
+        std::string nonce = cipher->makeNonce();
+        std::string contents = sidecar::encode(identity, nonce, cipher->seal(sidecar::encodeIndexes(indexes), nonce, Field::Name));
+
+        std::string replacement = sidecarFile + ".new";
+        int fd = ::open(replacement.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        bool written = fd >= 0 && writeAll(fd, contents);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!written || ::rename(replacement.c_str(), sidecarFile.c_str()) != 0) {
+            std::remove(replacement.c_str());
+            return;
+        }
+        sidecarCurrent = true;
+    }
+
+
+
+    /**
+     * \brief Encrypts the provided data.
+     *
+     * This static method performs a basic Caesar cipher encryption on the provided data string,
+     * shifting each character in the string by a fixed amount defined by the 'shift' constant.
+     * The whole string goes through the vector kernel picked by shiftKernel().
+     * The encrypted data is then returned.
+     *
+     * \param data The data to be encrypted.
+     * \return A string representing the encrypted data.
+     */
+    static std::string encryptData(std::string_view data) {
+        PM_TIME_SCOPE(Encrypt);
+        PM_COUNT(EncryptCalls, 1);
+        PM_COUNT(EncryptBytes, data.size());
+        std::string encryptedData(data);
+        shiftBytes(encryptedData.data(), encryptedData.data(), encryptedData.size(), shift);
+        return encryptedData;
+    }
+
+
+
+
+    /**
+     * \brief Decrypts the provided data.
+     *
+     * This static method performs a basic Caesar cipher decryption on the provided encrypted data string,
+     * shifting each character in the string back by a fixed amount defined by the 'shift' constant.
+     * The whole string goes through shiftBytes() and thus the vector kernel picked by shiftKernel().
+     * The decrypted data is then returned.
+     *
+     * \param encryptedData The encrypted data to be decrypted.
+     * \return A string representing the decrypted data.
+     */
+    static std::string decryptData(std::string_view encryptedData) {
+        PM_TIME_SCOPE(Decrypt);
+        PM_COUNT(DecryptCalls, 1);
+        PM_COUNT(DecryptBytes, encryptedData.size());
+        std::string decryptedData(encryptedData);
+        shiftBytes(decryptedData.data(), decryptedData.data(), decryptedData.size(), -shift);
+        return decryptedData;
+    }
+
+    /// \brief Encrypts a string in place.
+    static void encryptInPlace(std::string& data) {
+        PM_TIME_SCOPE(Encrypt);
+        PM_COUNT(EncryptCalls, 1);
+        PM_COUNT(EncryptBytes, data.size());
+        shiftBytes(data.data(), data.data(), data.size(), shift);
+    }
+
+    /// \brief Decrypts a string in place.
+    static void decryptInPlace(std::string& data) {
+        PM_TIME_SCOPE(Decrypt);
+        PM_COUNT(DecryptCalls, 1);
+        PM_COUNT(DecryptBytes, data.size());
+        shiftBytes(data.data(), data.data(), data.size(), -shift);
+    }
+
+    /**
+     * \brief Decrypts into a caller-provided buffer, without allocating.
+     *
+     * \param encryptedData The encrypted data.
+     * \param out A buffer of at least encryptedData.size() bytes.
+     */
+    static void decryptInto(std::string_view encryptedData, char* out) {
+        PM_TIME_SCOPE(Decrypt);
+        PM_COUNT(DecryptCalls, 1);
+        PM_COUNT(DecryptBytes, encryptedData.size());
+        shiftBytes(out, encryptedData.data(), encryptedData.size(), -shift);
+    }
+
+private:
+
+
+
+    /**
+     * \brief Checks the master password and derives the vault key.
+     *
+     * An empty or missing file becomes a new binary vault whose header is written right away, so the first
+     * password typed in for it is its master password from then on. The format and the cipher of the vault
+     * are settled here for the whole session.
+     *
+     * \param masterPassword The password typed in at start-up.
+     * \return True if the vault may be opened with it.
+     */
+    bool unlock(const std::string& masterPassword) {
+
+        MappedFile file(fileName);
+        std::string_view buffer = file.view();
+
+        if (buffer.empty()) {
+            vaultHeader = makeVaultHeader(masterPassword, calibrateKdfIterations(defaultUnlockMilliseconds), vaultKey);
+            std::string header = encodeHeader(vaultHeader);
+            unlocked = replaceFile(fileName, [&header](int fd) {
+                return writeAll(fd, header);
+            });
+            format = VaultFormat::Binary;
+            cipher = makeCipher(vaultHeader.cipherId, vaultKey);
+            return unlocked;
+        }
+
+        unlocked = checkMasterPassword(buffer, masterPassword, vaultHeader, vaultKey);
+        if (unlocked) {
+            format = detectFormat(buffer);
+            cipher = makeCipher(format == VaultFormat::Binary ? vaultHeader.cipherId : 0, vaultKey);
+        }
+        return unlocked;
+    }
+
+    /**
+     * \brief Appends already serialized blocks to the end of the vault file.
+     *
+     * This is the only way the vault file grows. Unless the flush policy is Immediate, the blocks are only
+     * queued and go out together once the policy says so.
+     *
+     * \param blocks The serialized blocks.
+     * \param count The number of blocks in blocks.
+     * \return True if the blocks were written or queued.
+     */
+    bool appendToVault(const std::string& blocks, std::size_t count) {
+
+        sidecarCurrent = false;
+        if (flushPolicy.trigger == FlushPolicy::Immediate) {
+            bool written = writeBlocks(blocks, count);
+            fileBlocks += written ? count : 0;
+            return written;
+        }
+        fileBlocks += count;
+
+        if (deferredBlocks.empty()) {
+            oldestDeferred = std::chrono::steady_clock::now();
+        }
+        deferredBlocks += blocks;
+        deferredCount += count;
+        return !flushDue() || flushWrites();
+    }
+
+    bool flushDue() const {
+        switch (flushPolicy.trigger) {
+            case FlushPolicy::Count:
+                return deferredCount >= flushPolicy.limit;
+            case FlushPolicy::Bytes:
+                return deferredBlocks.size() >= flushPolicy.limit;
+            case FlushPolicy::Time:
+                return std::chrono::steady_clock::now() - oldestDeferred
+                       >= std::chrono::milliseconds(flushPolicy.limit);
+            case FlushPolicy::Explicit:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    /**
+     * \brief Writes blocks to the end of the vault file and syncs them to the disk.
+     *
+     * Several blocks, or any text block, go through the write-ahead journal first, so a crash leaves either
+     * all of them or none. A single binary block needs no journal: if it is torn, it fails its checksum
+     * and is cut off on the next start. An add or a delete written on its own therefore still costs one
+     * write and one fsync.
+     *
+     * While a compaction is running in the background, the same bytes are also kept aside so they can be
+     * carried over into the compacted file.
+     *
+     * The blocks are written under the exclusive VaultLock. If another process changed the vault since this
+     * object last saw it, a journal it left behind is applied first and a torn block it left is cut off, so
+     * the new blocks always follow valid ones. The password sets in memory then no longer match the file,
+     * and the next refresh() loads it again.
+     */
+    bool writeBlocks(const std::string& blocks, std::size_t count) {
+
+        PM_TIME_SCOPE(Append);
+        if (compactionDone) {
+            finishCompaction();
+        }
+
+        VaultLock lock(fileName, LOCK_EX);
+        struct stat info{};
+        if (vaultChanged(info)) {
+            // Blocks sealed under this key must not go into a vault that was replaced by another one.
+            if (!sameSealing()) {
+                writeFailed = true;
+                return false;
+            }
+            replayJournal(fileName);
+            ::stat(fileName.c_str(), &info);
+            cutTornTail(vaultOnlyGrew(info) ? knownLength : 0);
+            reloadPending = true;
+        } else if (static_cast<std::size_t>(info.st_size) > knownLength) {
+            cutTornTail(knownLength);
+        }
+
+        int fd = ::open(fileName.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0600);
+        if (fd < 0) {
+            return false;
+        }
+
+        bool journaled = format == VaultFormat::Text || count > 1;
+        bool written = !journaled || (::fstat(fd, &info) == 0 && writeJournal(info.st_size, blocks));
+        written = written && writeAll(fd, blocks);
+        crashPoint();
+        written = written && ::fsync(fd) == 0;
+        ::close(fd);
+        crashPoint();
+
+        if (written && journaled) {
+            clearJournal(false);
+        }
+        writeFailed = writeFailed || !written;
+        if (written && ::stat(fileName.c_str(), &info) == 0) {
+            rememberVault(static_cast<std::size_t>(info.st_size));
+        }
+
+        if (compacting) {
+            appendedDuringCompaction += blocks;
+            blocksDuringCompaction += count;
+        }
+        return written;
+    }
+
+    /**
+     * \brief Records the vault file as it is now, with the first length bytes held in memory.
+     *
+     * Called whenever this object has caught up with the file: after loading it and after each of its own
+     * writes, all under the exclusive VaultLock. See vaultChanged() and refresh().
+     */
+    void rememberVault(std::size_t length) {
+
+        struct stat info{};
+        if (::stat(fileName.c_str(), &info) != 0) {
+            return;
+        }
+        knownDevice = info.st_dev;
+        knownInode = info.st_ino;
+        knownModified = static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+        knownSize = static_cast<std::size_t>(info.st_size);
+        knownLength = length;
+
+        std::size_t tail = std::min<std::size_t>(length, 4096);
+        knownTail.resize(tail);
+        int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || ::pread(fd, &knownTail[0], tail, static_cast<off_t>(length - tail)) != static_cast<ssize_t>(tail)) {
+            knownTail.clear();
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /// \brief Whether the vault file is no longer the one rememberVault() saw last; info is filled in.
+    bool vaultChanged(struct stat& info) const {
+        if (::stat(fileName.c_str(), &info) != 0) {
+            return true;
+        }
+        std::int64_t modified = static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+        return info.st_dev != knownDevice || info.st_ino != knownInode || modified != knownModified
+               || static_cast<std::size_t>(info.st_size) != knownSize;
+    }
+
+    /**
+     * \brief Whether the vault file only grew since rememberVault(): it is the same file, still as long as
+     * the part held in memory, and still ends that part with the same bytes.
+     *
+     * Only appends leave all of that in place. A compaction renames another file in, and a journal replay
+     * cuts the file back before it appends; either way the part in memory is no longer a prefix of it.
+     */
+    bool vaultOnlyGrew(const struct stat& info) const {
+
+        if (info.st_dev != knownDevice || info.st_ino != knownInode
+            || static_cast<std::size_t>(info.st_size) < knownLength || knownTail.size() != std::min<std::size_t>(knownLength, 4096)) {
+            return false;
+        }
+        std::string tail(knownTail.size(), '\0');
+        int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        bool same = fd >= 0 && ::pread(fd, &tail[0], tail.size(), static_cast<off_t>(knownLength - tail.size()))
+                                   == static_cast<ssize_t>(tail.size()) && tail == knownTail;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return same;
+    }
+
+    /**
+     * \brief Cuts a torn block off the end of a binary vault, so nothing appended after it gets hidden.
+     *
+     * A single binary block is appended without the journal, so a writer that crashed can leave part of
+     * one behind. The caller holds the exclusive VaultLock, so no live writer is halfway through a block.
+     *
+     * \param from A block boundary up to which the vault is known to be valid.
+     */
+    void cutTornTail(std::size_t from) {
+
+        if (format != VaultFormat::Binary) {
+            return;
+        }
+        std::size_t end;
+        std::size_t size;
+        {
+            MappedFile file(fileName);
+            std::string_view buffer = file.view();
+            size = buffer.size();
+            if (buffer.empty()) {
+                return;
+            }
+            std::size_t start = std::max(from, headerSize(buffer));
+            end = start > size ? size : start + forEachBinaryRecord(buffer.substr(start), [](const RecordView&) {});
+        }
+        if (end < size) {
+            ::truncate(fileName.c_str(), static_cast<off_t>(end));
+        }
+    }
+
+    /**
+     * \brief Takes in the password sets and tombstones other processes appended after the part in memory.
+     *
+     * The new blocks are applied in file order, the same way they were applied by the process that wrote
+     * them. The caller holds the exclusive VaultLock and has checked with vaultOnlyGrew() that the part in
+     * memory is still a prefix of the file.
+     */
+    void applyAppended() {
+
+        PM_TIME_SCOPE(Load);
+        std::size_t consumed;
+        {
+            MappedFile file(fileName);
+            std::string_view buffer = file.view();
+            std::string_view appended = buffer.substr(std::min(knownLength, buffer.size()));
+
+            auto apply = [this](const RecordView& record) {
+                fileBlocks++;
+                if (record.kind == RecordKind::NameTombstone) {
+                    for (RecordStore::Id id : findByName(cipher->open(record.name, record.nonce, Field::Name))) {
+                        eraseRecord(id);
+                    }
+                    return;
+                }
+                if (record.kind == RecordKind::CategoryTombstone) {
+                    std::string category = cipher->open(record.category, record.nonce, Field::Category);
+                    if (const std::vector<RecordStore::Id>* members = categoryIndex.find(category)) {
+                        std::vector<RecordStore::Id> doomed = *members;
+                        for (RecordStore::Id id : doomed) {
+                            eraseRecord(id);
+                        }
+                        categoryIndex.remove(category);
+                    }
+                    return;
+                }
+                PasswordData plain;
+                for (Field field : {Field::Name, Field::Category, Field::Website, Field::Login}) {
+                    std::string_view sealed = field == Field::Name ? record.name : field == Field::Category ? record.category
+                                              : field == Field::Website ? record.website : record.login;
+                    plain.field(field) = cipher->open(sealed, record.nonce, field);
+                }
+                indexRecord(passwords.add(record, plain.category), plain);
+            };
+
+            if (format == VaultFormat::Binary) {
+                consumed = forEachBinaryRecord(appended, apply);
+            } else {
+                forEachTextRecord(appended, apply);
+                consumed = appended.size();
+            }
+        }
+        collectGarbage();
+        sidecarCurrent = false;
+        rememberVault(knownLength + consumed);
+    }
+
+    /**
+     * \brief Whether the vault file is still sealed the way it was when it was unlocked, so the cipher of
+     * this object fits it. Another process may have replaced it with a vault under another key.
+     */
+    bool sameSealing() const {
+        MappedFile file(fileName);
+        std::string_view buffer = file.view();
+        if (buffer.empty() || detectFormat(buffer) != format) {
+            return false;
+        }
+        if (format == VaultFormat::Text) {
+            return true;
+        }
+        VaultHeader header;
+        return decodeHeader(buffer, header) && header.cipherId == vaultHeader.cipherId
+               && header.kdf == vaultHeader.kdf
+               && header.salt == vaultHeader.salt && header.verifier == vaultHeader.verifier;
+    }
+
+    /**
+     * \brief Loads the vault again from scratch, after it was replaced or changed in a way that can't be
+     * applied block by block. The caller holds the exclusive VaultLock.
+     *
+     * \return False if the vault is now sealed under another key; what is in memory then stays as it is.
+     */
+    bool reloadVault() {
+        if (!sameSealing()) {
+            return false;
+        }
+        passwords = loadRecords();
+        rebuildIndexes();
+        cutTornTail(validBytes);
+        rememberVault(validBytes);
+        sidecarCurrent = false;
+        reloadPending = false;
+        return true;
+    }
+
+    /// \brief Serializes a password set in the format of the vault file.
+    std::string serialize(const PasswordData& data) const {
+        if (format == VaultFormat::Text) {
+            return data.toString();
+        }
+        std::string block;
+        encodeBinaryRecord(block, viewOf(data));
+        return block;
+    }
+
+    /**
+     * \brief Seals a tombstone key and serializes the tombstone in the format of the vault file.
+     *
+     * \param kind Which kind of tombstone to write.
+     * \param key The decrypted name or category the tombstone cancels.
+     */
+    std::string serializeTombstone(RecordKind kind, const std::string& key) const {
+        Field field = kind == RecordKind::NameTombstone ? Field::Name : Field::Category;
+        std::string nonce = cipher->makeNonce();
+        std::string keyENC = cipher->seal(key, nonce, field);
+
+        if (format == VaultFormat::Text) {
+            return (kind == RecordKind::NameTombstone ? nameTombstone : categoryTombstone) + "\n" + keyENC + "\n\n";
+        }
+        RecordView record;
+        record.kind = kind;
+        (kind == RecordKind::NameTombstone ? record.name : record.category) = keyENC;
+        record.nonce = nonce;
+        std::string block;
+        encodeBinaryRecord(block, record);
+        return block;
+    }
+
+    /**
+     * \brief Decrypts one field of a password set with the cipher of the vault.
+     *
+     * The category is interned in plaintext by the record store, so it is simply copied.
+     *
+     * \return The plaintext, or an empty string if the field does not authenticate.
+     */
+    std::string decryptField(RecordStore::Id id, Field field) const {
+        if (field == Field::Category) {
+            return passwords.category(id);
+        }
+        return cipher->open(passwords.sealedField(id, field), passwords.nonce(id), field);
+    }
+
+    /**
+     * \brief A stored password set as it is written to the vault file.
+     *
+     * The category is sealed again under the record nonce. Sealing is deterministic for a given key and
+     * nonce, so this gives back the very bytes the category was loaded from.
+     */
+    PasswordData sealedRecord(RecordStore::Id id) const {
+        return sealedRecord(passwords, id);
+    }
+
+    PasswordData sealedRecord(const RecordStore& store, RecordStore::Id id) const {
+        PasswordData sealed;
+        sealed.nonce.assign(store.nonce(id));
+        for (Field field : {Field::Name, Field::Password, Field::Website, Field::Login}) {
+            sealed.field(field).assign(store.sealedField(id, field));
+        }
+        sealed.category = cipher->seal(store.category(id), sealed.nonce, Field::Category);
+        return sealed;
+    }
+
+    /**
+     * \brief Seals all fields of a password set under a fresh record nonce.
+     *
+     * \param plain The password set in plaintext.
+     * \return The same password set as stored in the vault.
+     */
+    PasswordData sealRecord(const PasswordData& plain) const {
+        PasswordData sealed;
+        sealed.nonce = cipher->makeNonce();
+        for (Field field : {Field::Name, Field::Password, Field::Category, Field::Website, Field::Login}) {
+            sealed.field(field) = cipher->seal(plain.field(field), sealed.nonce, field);
+        }
+        return sealed;
+    }
+
+    /**
+     * \brief Writes a group of blocks to the journal and syncs it, see the journal namespace.
+     *
+     * \param vaultLength The length of the vault file before the group is appended.
+     * \param blocks The group.
+     */
+    bool writeJournal(off_t vaultLength, std::string_view blocks) {
+
+        PM_TIME_SCOPE(Journal);
+        // Another process may have removed the journal when it closed the vault.
+        struct stat opened{};
+        struct stat current{};
+        if (journalFd >= 0 && (::fstat(journalFd, &opened) != 0 || ::stat(journal::fileOf(fileName).c_str(), &current) != 0
+                               || opened.st_ino != current.st_ino || opened.st_dev != current.st_dev)) {
+            ::close(journalFd);
+            journalFd = -1;
+        }
+        if (journalFd < 0) {
+            journalFd = ::open(journal::fileOf(fileName).c_str(), O_RDWR | O_CREAT, 0600);
+        }
+        bool written = journalFd >= 0 && ::lseek(journalFd, 0, SEEK_SET) == 0
+                       && writeAll(journalFd, journal::encode(static_cast<std::uint64_t>(vaultLength), blocks));
+        crashPoint();
+        written = written && ::fsync(journalFd) == 0;
+        crashPoint();
+        return written;
+    }
+
+    /**
+     * \brief Empties the journal once its group is safely in the vault.
+     *
+     * \param sync Whether the empty journal must reach the disk, which only matters before the vault file
+     * is replaced.
+     */
+    void clearJournal(bool sync) {
+        if (journalFd >= 0 && ::ftruncate(journalFd, 0) == 0 && sync) {
+            ::fsync(journalFd);
+        }
+        crashPoint();
+    }
+
+    /**
+     * \brief Starts a background compaction when the vault file holds too many dead blocks.
+     *
+     * The live records are serialized in memory right away, so the background thread never touches the
+     * record store. It only writes the compacted file next to the vault; swapping it in is done by
+     * finishCompaction(), which also appends whatever was written to the vault in the meantime. Only once the
+     * compacted file is in place does fileBlocks lose the dead blocks it left out.
+     *
+     * Nothing is compacted while the vault holds changes of other processes that this object hasn't taken
+     * in, since the snapshot would lose them, or while another process is compacting it.
+     */
+    void compactIfNeeded() {
+
+        // The snapshot below already holds the queued records, so they must reach the old file first.
+        flushWrites();
+        if (compactionDone) {
+            finishCompaction();
+        }
+        if (compacting || fileBlocks == 0 || reloadPending) {
+            return;
+        }
+        std::size_t dead = fileBlocks - passwords.size();
+        if (static_cast<double>(dead) <= compactionRatio * static_cast<double>(fileBlocks)) {
+            return;
+        }
+
+        std::string target = fileName + ".compact";
+        {
+            VaultLock lock(fileName, LOCK_EX);
+            struct stat info{};
+            if (vaultChanged(info)) {
+                return;
+            }
+            compactFd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (compactFd < 0) {
+                return;
+            }
+        }
+
+        std::string live = format == VaultFormat::Binary ? encodeHeader(vaultHeader) : std::string();
+        passwords.forEachLive([this, &live](RecordStore::Id id) {
+            live += serialize(sealedRecord(id));
+        });
+
+        compacting = true;
+        compactionDone = false;
+        appendedDuringCompaction.clear();
+        blocksDuringCompaction = 0;
+        deadBlocksCompacted = dead;
+
+        compactor = std::thread([this, live = std::move(live)]() {
+            PM_TIME_SCOPE(Compaction);
+            compactionSucceeded = writeAll(compactFd, live) && ::fsync(compactFd) == 0;
+            compactionDone = true;
+        });
+    }
+
+    /**
+     * \brief Waits for a running compaction and swaps the compacted file in.
+     *
+     * The blocks written in the meantime are appended to the compacted file, which is synced before it is
+     * renamed over the vault. A crash at any point leaves either the old vault or the compacted one, each
+     * with every block that was synced. If the compacted file can't be written, it is dropped and the old
+     * vault stays.
+     *
+     * The swap happens under the exclusive VaultLock, and only if no other process changed the vault in the
+     * meantime and the compacted file is still the one this object wrote; a process that opened the vault
+     * in between removes it as a leftover. Otherwise the compaction is dropped as well, and if the vault
+     * changed, the next refresh() loads it again.
+     */
+    void finishCompaction() {
+
+        if (!compacting) {
+            return;
+        }
+        compactor.join();
+        compacting = false;
+        compactionDone = false;
+
+        std::string target = fileName + ".compact";
+        VaultLock lock(fileName, LOCK_EX);
+        bool written = compactionSucceeded && writeAll(compactFd, appendedDuringCompaction) && ::fsync(compactFd) == 0;
+        crashPoint();
+        appendedDuringCompaction.clear();
+
+        struct stat info{};
+        struct stat compacted{};
+        struct stat current{};
+        reloadPending = reloadPending || vaultChanged(info);
+        bool ours = ::fstat(compactFd, &compacted) == 0 && ::stat(target.c_str(), &current) == 0
+                    && compacted.st_ino == current.st_ino && compacted.st_dev == current.st_dev;
+        ::close(compactFd);
+        compactFd = -1;
+        if (!written || reloadPending || !ours) {
+            if (ours) {
+                std::remove(target.c_str());
+            }
+            return;
+        }
+
+        // The journal refers to offsets in the old vault, so it must not outlive it.
+        clearJournal(true);
+        if (::rename(target.c_str(), fileName.c_str()) != 0) {
+            std::remove(target.c_str());
+            return;
+        }
+        crashPoint();
+        syncDirectoryOf(fileName);
+        rememberVault(static_cast<std::size_t>(compacted.st_size));
+        fileBlocks -= deadBlocksCompacted;
+    }
+
+    /**
+     * \brief Stores a new password set and adds it to the indexes.
+     *
+     * \param data The sealed password set.
+     * \param plain The same password set in plaintext, to index it without decrypting it again.
+     * \return The id of the new record.
+     */
+    RecordStore::Id storeRecord(const PasswordData& data, const PasswordData& plain) {
+        RecordStore::Id id = passwords.add(viewOf(data), plain.category);
+        indexRecord(id, plain);
+        return id;
+    }
+
+    /**
+     * \brief Removes a password set from memory and from the indexes.
+     *
+     * \param id The id of the record to remove.
+     *
+     * \see collectGarbage()
+     */
+    void eraseRecord(RecordStore::Id id) {
+        unindexRecord(id);
+        passwords.erase(id);
+    }
+
+    /**
+     * \brief Squeezes erased slots out of the record store once they outnumber the live records.
+     *
+     * This renumbers the records and therefore rebuilds the indexes. Spread over the erases that caused it,
+     * the cost stays constant per erase. It must not be called while record ids are still being used.
+     */
+    void collectGarbage() {
+        if (passwords.garbage() > 1024 && passwords.garbage() > passwords.size()) {
+            passwords.compact();
+            rebuildIndexes();
+        }
+    }
+
+    /// \brief Adds a record to the indexes; the trigram index is left to the caller if withText is false.
+    void indexRecord(RecordStore::Id id, const PasswordData& plain, bool withText = true) {
+        nameIndex.insert(NameIndex::hashName(plain.name), id);
+        categoryIndex.insert(plain.category, id);
+        if (textIndexBuilt && withText) {
+            textIndex.insert(id, TrigramIndex::indexedText(plain.name, plain.website, plain.login));
+        }
+        if (nameTreeBuilt) {
+            nameTree.insert(foldCase(plain.name), id);
+        }
+        alphabeticOrder.insert(id, plain.name);
+        if (snapshotsEnabled) {
+            draftSnapshot().insert(id, snapshotEntry(id));
+        }
+    }
+
+    /// \brief Removes a record from the indexes; the trigram index is left to the caller if withText is false.
+    void unindexRecord(RecordStore::Id id, bool withText = true) {
+        if (snapshotsEnabled) {
+            draftSnapshot().erase(id);
+        }
+        nameIndex.erase(NameIndex::hashName(alphabeticOrder.key(id)), id);
+        categoryIndex.erase(passwords.category(id), id);
+        if (textIndexBuilt && withText) {
+            textIndex.erase(id);
+        }
+        if (nameTreeBuilt) {
+            nameTree.erase(foldCase(alphabeticOrder.key(id)), id);
+        }
+        alphabeticOrder.erase(id);
+    }
+
+    /**
+     * \brief Builds the name, category and alphabetic indexes from scratch from the records in memory.
+     *
+     * The trigram index and the BK-tree are dropped and built again on their next use.
+     */
+    void rebuildIndexes() {
+        PM_TIME_SCOPE(RebuildIndexes);
+        nameIndex.clear();
+        categoryIndex.clear();
+        textIndex.clear();
+        textIndexBuilt = false;
+        nameTree.clear();
+        nameTreeBuilt = false;
+        nameIndex.reserve(passwords.size());
+
+        std::vector<RecordStore::Id> ids;
+        std::vector<std::string_view> encryptedNames;
+        std::vector<std::string_view> nonces;
+        ids.reserve(passwords.size());
+        encryptedNames.reserve(passwords.size());
+        nonces.reserve(passwords.size());
+
+        passwords.forEachLive([&](RecordStore::Id id) {
+            ids.push_back(id);
+            encryptedNames.push_back(passwords.sealedField(id, Field::Name));
+            nonces.push_back(passwords.nonce(id));
+        });
+
+        // Every chunk of the column is decrypted and hashed on its own thread; only the inserts stay serial.
+        // Categories are already in plaintext in the record store.
+        std::size_t chunks = std::min(pool.size() * 4, ids.size() / 1024 + 1);
+        std::vector<std::string> names(passwords.endId());
+        std::vector<std::uint64_t> hashes(ids.size());
+
+        pool.parallelFor(chunks, [&](std::size_t chunk) {
+
+            std::size_t begin = ids.size() * chunk / chunks;
+            std::size_t end = ids.size() * (chunk + 1) / chunks;
+            std::vector<std::string_view> chunkNames(encryptedNames.begin() + begin, encryptedNames.begin() + end);
+            std::vector<std::string_view> chunkNonces(nonces.begin() + begin, nonces.begin() + end);
+
+            std::string nameColumn;
+            std::vector<std::uint32_t> nameOffsets;
+            cipher->openColumn(chunkNames, chunkNonces, Field::Name, nameColumn, nameOffsets);
+
+            for (std::size_t i = begin; i < end; i++) {
+                std::size_t k = i - begin;
+                names[ids[i]].assign(nameColumn, nameOffsets[k], nameOffsets[k + 1] - nameOffsets[k]);
+                hashes[i] = NameIndex::hashName(names[ids[i]]);
+            }
+        });
+
+        for (std::size_t i = 0; i < ids.size(); i++) {
+            nameIndex.insert(hashes[i], ids[i]);
+            categoryIndex.insert(passwords.category(ids[i]), ids[i]);
+        }
+
+        alphabeticOrder.assign(std::move(names), std::move(ids), pool);
+
+        if (snapshotsEnabled) {
+            snapshotDraft = buildSnapshot();
+        }
+    }
+
+    /// \brief The snapshot entry of an indexed record.
+    VaultSnapshot::Entry snapshotEntry(RecordStore::Id id) const {
+        VaultSnapshot::Entry entry;
+        entry.name = alphabeticOrder.key(id);
+        entry.category = passwords.category(id);
+        entry.password = passwords.sealedField(id, Field::Password);
+        entry.website = passwords.sealedField(id, Field::Website);
+        entry.login = passwords.sealedField(id, Field::Login);
+        entry.nonce = passwords.nonce(id);
+        return entry;
+    }
+
+    /// \brief A snapshot of all indexed records, built in alphabetic order.
+    std::unique_ptr<VaultSnapshot> buildSnapshot() const {
+        return VaultSnapshot::build(alphabeticOrder.ids(), [this](RecordStore::Id id) {
+            return snapshotEntry(id);
+        });
+    }
+
+    /// \brief The draft of the next snapshot version, started as a copy of the latest one.
+    VaultSnapshot& draftSnapshot() {
+        if (snapshotDraft == nullptr) {
+            snapshotDraft = std::make_unique<VaultSnapshot>(*versions.latest());
+        }
+        return *snapshotDraft;
+    }
+
+    /// \brief Publishes the draft, if there is one, as the new snapshot version.
+    void publishSnapshot() {
+        if (snapshotDraft != nullptr) {
+            versions.publish(std::move(snapshotDraft));
+        }
+    }
+
+
+
+    /**
+     * \brief Add new password to the program.
+     *
+     * This method prompts the user to input details for a new password set.
+     * The entered data is collected in a PasswordData structure and sealed with the cipher of the vault.
+     * The encrypted data is then written to the file and added to the passwords vector.
+     */
+    void addPassword() {
+
+        clearConsole();
+
+
+        PasswordData newPasswordSet;
+        std::string temp;
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|       Type in the name      |" << std::endl;
+        std::cout << "|     of the password set:    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+        std::cin >> temp;
+        newPasswordSet.name = temp;
+
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|          optional           |" << std::endl;
+        std::cout << "|     (for none type 'x')     |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|      Type in the login      |" << std::endl;
+        std::cout << "|        for this set:        |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+        std::cin >> temp;
+        newPasswordSet.login = temp;
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|     Type in the password    |" << std::endl;
+        std::cout << "|        for this set:        |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+        std::cin >> temp;
+        newPasswordSet.password = temp;
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|     Type in the category    |" << std::endl;
+        std::cout << "|     of the password set:    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+        std::cin >> temp;
+        newPasswordSet.category = temp;
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|          optional           |" << std::endl;
+        std::cout << "|     (for none type 'x')     |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|     Type in the website     |" << std::endl;
+        std::cout << "|    for the password set:    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+        std::cin >> temp;
+        newPasswordSet.website = temp;
+
+
+
+        if(insertPassword(newPasswordSet)){
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|     Password  has been      |" << std::endl;
+            std::cout << "|     successfully added      |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+        }else{
+            clearConsole();
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|      An error occurred      |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+        }
+    }
+
+
+
+
+    /**
+     * \brief Search password data by the password set name.
+     *
+     * This method allows the user to search for a password set by its name.
+     * The name is looked up with findByName(), which only decrypts the records
+     * whose name hash matches the entered search term.
+     * If a match is found, it displays the details of the password set. Otherwise the
+     * password sets with the closest names, at most maxTypos edits away, are displayed
+     * instead, closest first.
+     */
+    void searchPasswords() {
+
+        clearConsole();
+
+
+        std::string searchTerm;
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|       Search the name       |" << std::endl;
+        std::cout << "|       of the password:      |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+        std::cin >> searchTerm;
+
+
+
+        bool found = false;
+
+        for(RecordStore::Id id : findByName(searchTerm)){
+
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "Name: " << decryptField(id, Field::Name) << std::endl;
+            std::cout << "Category: " << decryptField(id, Field::Category) << std::endl;
+            std::cout << "Website: " << decryptField(id, Field::Website) << std::endl;
+            std::cout << "Login: " << decryptField(id, Field::Login) << std::endl;
+            std::cout << "Password: " << decryptField(id, Field::Password)<< std::endl;
+            std::cout << "-------------------------------" << std::endl;
+            found = true;
+        }
+
+        std::vector<BkTree::Match> closest;
+        if (!found) {
+            closest = findClosest(searchTerm, maxTypos, 5);
+        }
+
+        if (!found && !closest.empty()) {
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|   Can't find any matches.   |" << std::endl;
+            std::cout << "|     Closest names found:    |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+
+            for (const auto& match : closest) {
+
+                std::cout << "-------------------------------" << std::endl;
+                std::cout << "Name: " << alphabeticOrder.key(match.id) << std::endl;
+                std::cout << "Category: " << decryptField(match.id, Field::Category) << std::endl;
+                std::cout << "Website: " << decryptField(match.id, Field::Website) << std::endl;
+                std::cout << "Login: " << decryptField(match.id, Field::Login) << std::endl;
+                std::cout << "Password: " << decryptField(match.id, Field::Password)<< std::endl;
+                std::cout << "-------------------------------" << std::endl;
+            }
+        }
+        else if (!found) {
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|   Can't find any matches.   |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+        }
+    }
+
+
+    /**
+     * \brief Search password data by a piece of the name, website or login.
+     *
+     * This method asks whether the typed text should be contained anywhere in a field or only at its
+     * start, then looks it up with findContaining(). All matching password sets are displayed in
+     * alphabetic order.
+     */
+    void textSearchPasswords() {
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|     How do you want to      |" << std::endl;
+        std::cout << "|   search the name, website  |" << std::endl;
+        std::cout << "|         and login?          |" << std::endl;
+        std::cout << "|       to proceed type:      |" << std::endl;
+        std::cout << "|      (contains/prefix)      |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+
+        std::string command;
+        std::cin >> command;
+
+        if (command != "contains" && command != "prefix") {
+            return;
+        }
+
+        clearConsole();
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|    Type in the text you     |" << std::endl;
+        std::cout << "|       are looking for:      |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+
+        std::string searchTerm;
+        std::cin >> searchTerm;
+
+        clearConsole();
+        std::vector<RecordStore::Id> matches = findContaining(searchTerm, command == "prefix");
+
+        for (RecordStore::Id id : matches) {
+
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "Name: " << alphabeticOrder.key(id) << std::endl;
+            std::cout << "Category: " << decryptField(id, Field::Category) << std::endl;
+            std::cout << "Website: " << decryptField(id, Field::Website) << std::endl;
+            std::cout << "Login: " << decryptField(id, Field::Login) << std::endl;
+            std::cout << "Password: " << decryptField(id, Field::Password)<< std::endl;
+            std::cout << "-------------------------------" << std::endl;
+        }
+
+        if (matches.empty()) {
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|   Can't find any matches.   |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+        }
+    }
+
+
+    /**
+     * @brief Sorts a vector of passwords.
+     *
+     * This function sorts the list of passwords based on user input. The user can choose to sort the passwords alphabetically or by category.
+     * If the user chooses to sort by category, they will be prompted to enter the desired category, and the function will print out the
+     * passwords belonging to that category, taken from the posting list in the category index. If the category doesn't exist in the list
+     * of passwords, the user will be informed that no matches were found.
+     *
+     * If the user chooses to sort the passwords alphabetically, the function walks the alphabetic order, which is kept sorted by
+     * the decrypted password name as passwords are added and deleted, and prints out the list in that order.
+     *
+     * @note The function assumes that the `PasswordData` structure contains encrypted data. Therefore, it decrypts the data before
+     * printing and comparing.
+     *
+     * @note This function interacts with the user through the console, prompting the user to enter commands and categories and printing out results.
+     *
+     * @see AlphabeticOrder
+     */
+    void sortPasswords() {
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|      How do you want to     |" << std::endl;
+        std::cout << "|     sort your passwords?    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|       to proceed type:      |" << std::endl;
+        std::cout << "|    (alphabetic/category)    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+
+        std::string command;
+        std::cin >> command;
+
+        if(command == "category"){
+            clearConsole();
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|    Type in the category:    |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+
+            std::string category;
+            std::cin >> category;
+
+
+            bool foundCategory = false;
+
+            clearConsole();
+            PM_TIME_SCOPE(CategoryList);
+            const std::vector<RecordStore::Id>* members = categoryIndex.find(category);
+            if(members != nullptr){
+
+                for(RecordStore::Id id : *members){
+
+                    std::cout << "-------------------------------" << std::endl;
+                    std::cout << "Name: " << decryptField(id, Field::Name) << std::endl;
+                    std::cout << "Category: " << category << std::endl;
+                    std::cout << "Website: " << decryptField(id, Field::Website) << std::endl;
+                    std::cout << "Login: " << decryptField(id, Field::Login) << std::endl;
+                    std::cout << "Password: " << decryptField(id, Field::Password)<< std::endl;
+                    std::cout << "-------------------------------" << std::endl;
+                    std::cout << std::endl;
+                    std::cout << std::endl;
+                    foundCategory = true;
+                }
+            }
+            if(!foundCategory){
+
+                clearConsole();
+                std::cout << "-------------------------------" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|   Can't find any matches.   |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "-------------------------------" << std::endl;
+            }
+
+
+
+        }
+        else if(command == "alphabetic"){
+
+            clearConsole();
+            PM_TIME_SCOPE(AlphabeticList);
+            for (RecordStore::Id id : alphabeticOrder.ids()){
+                std::cout << "-------------------------------" << std::endl;
+                std::cout << "Name: " << alphabeticOrder.key(id) << std::endl;
+                std::cout << "Category: " << decryptField(id, Field::Category) << std::endl;
+                std::cout << "Website: " << decryptField(id, Field::Website) << std::endl;
+                std::cout << "Login: " << decryptField(id, Field::Login) << std::endl;
+                std::cout << "Password: " << decryptField(id, Field::Password)<< std::endl;
+                std::cout << "-------------------------------" << std::endl;
+                std::cout << std::endl;
+                std::cout << std::endl;
+            }
+        }
+
+    }
+
+    /**
+     * \brief Edits a chosen password set.
+     *
+     * This method prompts the user for the name of the password set and then for each of its fields,
+     * where '-' keeps the current value. The changes are saved with editByName(), which updates the
+     * record and the indexes in place and appends the new version to the vault in a single write. A name
+     * shared by several password sets is refused.
+     */
+    void editPassword() {
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|        Type the name        |" << std::endl;
+        std::cout << "|     of the password that    |" << std::endl;
+        std::cout << "|      you want to edit:      |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+
+        std::string name;
+        std::cin >> name;
+
+        std::vector<RecordStore::Id> matches = findByName(name);
+        if(matches.empty()){
+            clearConsole();
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|   Can't find any matches.   |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+            return;
+        }
+        if(matches.size() > 1){
+            clearConsole();
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|    Several password sets    |" << std::endl;
+            std::cout << "|      share this name.       |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+            return;
+        }
+
+        PasswordData editedPasswordSet;
+        static const std::pair<Field, const char*> prompts[] = {
+            {Field::Name,     "|     Type in the new name    |"},
+            {Field::Login,    "|     Type in the new login   |"},
+            {Field::Password, "|   Type in the new password  |"},
+            {Field::Category, "|   Type in the new category  |"},
+            {Field::Website,  "|   Type in the new website   |"}};
+
+        for(const auto& prompt : prompts){
+
+            std::string current = decryptField(matches[0], prompt.first);
+
+            clearConsole();
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|     (to keep it type '-')   |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << prompt.second << std::endl;
+            std::cout << "|     of the password set:    |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "Current: " << current << std::endl;
+
+            std::string temp;
+            std::cin >> temp;
+            editedPasswordSet.field(prompt.first) = temp == "-" ? current : temp;
+        }
+
+        clearConsole();
+        if(editByName(name, editedPasswordSet)){
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|     Password  has been      |" << std::endl;
+            std::cout << "|     successfully edited     |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+        }else{
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|      An error occurred      |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+        }
+    }
+
+
+
+
+    /**
+     * @brief Deletes a chosen password set.
+     *
+     * This function allows the user to delete a password from the list of passwords. The user is asked to type the name of the password
+     * they want to delete. The user is then asked for confirmation before the password is deleted. If the user
+     * confirms the deletion, a tombstone carrying the sealed name is appended to the file and the password is removed from memory.
+     * The file itself is only rewritten by a background compaction, once enough of it is dead.
+     *
+     * @note This function interacts with the user through the console, prompting the user to enter the name of the password and confirm the
+     * delete and informing the user that the password has been deleted.
+     *
+     * @see compactIfNeeded()
+     */
+    void deletePassword() {
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|        Type the name        |" << std::endl;
+        std::cout << "|     of the password that    |" << std::endl;
+        std::cout << "|      you want to delete:    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+
+        std::string nameOfThePasswordToDeleteDEC;
+        std::cin >> nameOfThePasswordToDeleteDEC;
+
+
+        clearConsole();
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|        Are you sure?        |" << std::endl;
+        std::cout << "|    (type yes to confirm)    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+
+        std::string command;
+        std::cin >> command;
+
+        if(command == "yes") {
+
+
+            long deleted = removeByName(nameOfThePasswordToDeleteDEC);
+
+            clearConsole();
+            if(deleted < 0){
+                std::cout << "-------------------------------" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|      An error occurred      |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "-------------------------------" << std::endl;
+                return;
+            }
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|        Password has         |" << std::endl;
+            std::cout << "|        been deleted.        |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+
+        }
+    }
+
+
+
+    /**
+     * @brief Deletes a category together with all of its password sets.
+     *
+     * The records to remove are taken from the posting list of the category, so the in-memory work is
+     * proportional to the size of the category rather than to the size of the vault. On disk, a single
+     * category tombstone is appended.
+     */
+    void deleteCategory() {
+
+        clearConsole();
+
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|        Type the name        |" << std::endl;
+        std::cout << "|     of the category that    |" << std::endl;
+        std::cout << "|      you want to delete:    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+
+        std::string category;
+        std::cin >> category;
+
+        const std::vector<RecordStore::Id>* members = categoryIndex.find(category);
+        if(members == nullptr){
+            clearConsole();
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|   Can't find any matches.   |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+            return;
+        }
+
+        clearConsole();
+        std::cout << "-------------------------------" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|   All passwords in this     |" << std::endl;
+        std::cout << "|   category will be gone.    |" << std::endl;
+        std::cout << "|        Are you sure?        |" << std::endl;
+        std::cout << "|    (type yes to confirm)    |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "|                             |" << std::endl;
+        std::cout << "-------------------------------" << std::endl;
+
+        std::string command;
+        std::cin >> command;
+
+        if(command == "yes") {
+
+            long deleted = removeCategory(category);
+
+            clearConsole();
+            if(deleted < 0){
+                std::cout << "-------------------------------" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|      An error occurred      |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "|                             |" << std::endl;
+                std::cout << "-------------------------------" << std::endl;
+                return;
+            }
+            std::cout << "-------------------------------" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|        Category has         |" << std::endl;
+            std::cout << "|        been deleted.        |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "|                             |" << std::endl;
+            std::cout << "-------------------------------" << std::endl;
+        }
+    }
+
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+//main menu
+void menuTypePassword(){
+
+    clearConsole();
+
+    std::cout << "-------------------------------" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|           Hello             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|         Welcome to          |" << std::endl;
+    std::cout << "|    The Password Manager     |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|    To start, type in the    |" << std::endl;
+    std::cout << "|     name of the source      |" << std::endl;
+    std::cout << "|           file:             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "-------------------------------" << std::endl;
+
+    std::string fileName;
+    std::cin >> fileName;
+
+
+    clearConsole();
+
+    std::cout << "-------------------------------" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|   To continue, type in the  |" << std::endl;
+    std::cout << "|     general password:       |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "-------------------------------" << std::endl;
+
+    std::string typedPassword;
+    std::cin >> typedPassword;
+
+    bool unlocked = false;
+    {
+        PasswordManager manager(fileName, typedPassword);
+        unlocked = manager.isUnlocked();
+        if (unlocked) {
+            clearConsole();
+            manager.run();
+        }
+    }
+    if(!unlocked) {
+        tryAgain();
+    }
+
+}
+
+//wrong password screen
+void tryAgain(){
+    clearConsole();
+
+    std::cout << "-------------------------------" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|        Wrong password       |" << std::endl;
+    std::cout << "|    type 'x' to try again:   |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "|                             |" << std::endl;
+    std::cout << "-------------------------------" << std::endl;
+
+    std::string command;
+    std::cin >> command;
+
+    if(command == "x"){
+        menuTypePassword();
+    }
+}
+
+
+
+
+/**
+ * \class BoundedQueue
+ * \brief A first-in first-out queue between threads that never holds more than capacity items.
+ *
+ * push() waits while the queue is full and pop() while it is empty, so a fast producer is held back to
+ * the pace of its consumers instead of piling items up in memory. Once close() is called, pop() hands
+ * out what is left and then returns false.
+ */
+template <typename T>
+class BoundedQueue {
+
+private:
+    std::deque<T> items;
+    std::size_t capacity;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+public:
+    explicit BoundedQueue(std::size_t capacity) : capacity(std::max<std::size_t>(capacity, 1)) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return closed || items.size() < capacity; });
+        items.push_back(std::move(item));
+        changed.notify_all();
+    }
+
+    /// \return False once the queue is closed and empty.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        changed.notify_all();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        changed.notify_all();
+    }
+};
+
+
+/**
+ * \brief Streams chunks through a read, transform and write pipeline with a bounded number of chunks in flight.
+ *
+ * One pool thread reads, workers pool threads transform and the calling thread writes. The chunks are
+ * transformed in any order but written in the order they were read. At most depth chunks are ever
+ * between the reader and the writer, so the memory used depends on depth and the chunk size, never on
+ * the length of the stream. After a failed write the reader is stopped and the chunks already read are
+ * dropped.
+ *
+ * \param workers The number of transform threads, at least one.
+ * \param depth The largest number of chunks in flight.
+ * \param read Fills in the next chunk and the position of its first record; returns false at the end.
+ * \param transform Turns a chunk and its position into the bytes to write.
+ * \param write Writes the bytes of one chunk; returns false if it failed.
+ * \return False if a write failed.
+ */
+template <typename Read, typename Transform, typename Write>
+bool runPipeline(std::size_t workers, std::size_t depth, Read&& read, Transform&& transform, Write&& write) {
+
+    struct Chunk {
+        std::size_t sequence = 0;
+        std::size_t position = 0;
+        std::string bytes;
+    };
+
+    depth = std::max<std::size_t>(depth, 1);
+    BoundedQueue<Chunk> input(depth);
+    std::vector<std::string> output(depth);
+    std::vector<char> ready(depth, 0);
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::size_t issued = 0;
+    std::size_t written = 0;
+    bool reading = true;
+    bool failed = false;
+
+    // Declared last, so its threads are joined before anything they use goes away.
+    ThreadPool pool(std::max<std::size_t>(workers, 1) + 2);
+
+    pool.submit([&]() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return failed || issued - written < depth; });
+                if (failed) {
+                    break;
+                }
+            }
+            Chunk chunk;
+            if (!read(chunk.bytes, chunk.position)) {
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                chunk.sequence = issued++;
+            }
+            input.push(std::move(chunk));
+        }
+        input.close();
+        std::lock_guard<std::mutex> lock(mutex);
+        reading = false;
+        changed.notify_all();
+    });
+
+    for (std::size_t i = 0; i < std::max<std::size_t>(workers, 1); i++) {
+        pool.submit([&]() {
+            Chunk chunk;
+            while (input.pop(chunk)) {
+                std::string bytes;
+                transform(chunk.bytes, chunk.position, bytes);
+                std::lock_guard<std::mutex> lock(mutex);
+                output[chunk.sequence % depth] = std::move(bytes);
+                ready[chunk.sequence % depth] = 1;
+                changed.notify_all();
+            }
+        });
+    }
+
+    while (true) {
+        std::string bytes;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return ready[written % depth] || (!reading && written == issued); });
+            if (!ready[written % depth]) {
+                break;
+            }
+            bytes = std::move(output[written % depth]);
+            ready[written % depth] = 0;
+        }
+        bool ok = failed || write(bytes);
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = !ok;
+        written++;
+        changed.notify_all();
+    }
+    return !failed;
+}
+
+
+/**
+ * \class ChunkReader
+ * \brief Reads a file in chunks of whole records with large sequential reads, for runPipeline().
+ *
+ * Each chunk ends at the last record boundary found in the bytes read so far; the incomplete record
+ * after it is carried over into the next chunk. A record longer than the chunk size makes the chunk grow
+ * until the record fits.
+ */
+class ChunkReader {
+
+public:
+    /**
+     * \brief Finds the end of the last complete record in bytes and counts the records before it.
+     *
+     * If atEnd is set no more bytes will follow, so a record cut short by the end counts as complete, unless
+     * the layout can tell it is torn.
+     */
+    using Boundary = std::function<std::size_t(std::string_view bytes, bool atEnd, std::size_t& records)>;
+
+private:
+    int fd;
+    std::size_t chunkSize;
+    std::size_t remaining;
+    Boundary boundary;
+    std::string carry;
+    std::size_t records = 0;
+    bool atEnd = false;
+    bool readError = false;
+
+public:
+    /**
+     * \param fd The file, positioned at the first record.
+     * \param chunkSize The number of bytes to read per chunk.
+     * \param limit The most bytes to read in total.
+     * \param boundary Finds the record boundaries.
+     */
+    ChunkReader(int fd, std::size_t chunkSize, std::size_t limit, Boundary boundary)
+        : fd(fd), chunkSize(chunkSize), remaining(limit), boundary(std::move(boundary)) {}
+
+    /**
+     * \brief Reads the next chunk.
+     *
+     * \param chunk Receives the bytes of the chunk.
+     * \param firstRecord Receives the number of records before the chunk.
+     * \return False at the end of the file.
+     */
+    bool next(std::string& chunk, std::size_t& firstRecord) {
+
+        std::size_t wanted = chunkSize;
+        while (true) {
+            while (!atEnd && carry.size() < wanted) {
+                std::size_t filled = carry.size();
+                carry.resize(filled + std::min(wanted - filled, remaining));
+                ssize_t got = ::read(fd, carry.data() + filled, carry.size() - filled);
+                if (got < 0 && errno == EINTR) {
+                    carry.resize(filled);
+                    continue;
+                }
+                readError = readError || got < 0;
+                carry.resize(filled + (got > 0 ? static_cast<std::size_t>(got) : 0));
+                remaining -= carry.size() - filled;
+                atEnd = got <= 0 || remaining == 0;
+                PM_COUNT(BytesRead, carry.size() - filled);
+            }
+
+            std::size_t count = 0;
+            std::size_t end = boundary(carry, atEnd, count);
+            if (end > 0) {
+                chunk.assign(carry, 0, end);
+                carry.erase(0, end);
+                firstRecord = records;
+                records += count;
+                return true;
+            }
+            if (atEnd) {
+                return false;
+            }
+            wanted *= 2;
+        }
+    }
+
+    /// \brief Changes where the chunks end from the next chunk on, e.g. after a header of a different layout.
+    void setBoundary(Boundary newBoundary) {
+        boundary = std::move(newBoundary);
+    }
+
+    /// \brief Whether reading stopped because of an error rather than the end of the file.
+    bool failed() const {
+        return readError;
+    }
+};
+
+
+/**
+ * \brief The record boundaries of a vault in either layout, for a ChunkReader over its blocks.
+ *
+ * The blocks of a binary vault are walked by their length prefixes alone. A text block is complete once
+ * the newline after its last field has been read.
+ */
+ChunkReader::Boundary vaultBoundary(VaultFormat format) {
+
+    if (format == VaultFormat::Binary) {
+        return [](std::string_view bytes, bool, std::size_t& records) {
+            std::size_t offset = 0;
+            while (bytes.size() - offset >= 9) {
+                std::uint32_t bodyLength = getU32(bytes.data() + offset + 1);
+                if (bodyLength > bytes.size() - offset - 9) {
+                    break;
+                }
+                offset += 9 + bodyLength;
+                records++;
+            }
+            return offset;
+        };
+    }
+
+    return [](std::string_view bytes, bool atEnd, std::size_t& records) {
+        std::size_t end = 0;
+        forEachTextRecord(bytes, [&](const RecordView& record) {
+            std::string_view last = record.kind == RecordKind::Entry ? record.login
+                                    : record.kind == RecordKind::NameTombstone ? record.name : record.category;
+            std::size_t lastEnd = last.data() != nullptr ? last.data() + last.size() - bytes.data() : bytes.size();
+            if (atEnd || lastEnd < bytes.size()) {
+                end = std::min(lastEnd + 1, bytes.size());
+                records++;
+            }
+        });
+        return atEnd ? bytes.size() : end;
+    };
+}
+
+
+/**
+ * \brief The layouts of a password export.
+ *
+ * Csv has a header line naming the columns, followed by one password set per line, quoted as in
+ * RFC 4180. Json is an array of objects, one per password set, with a string member per field.
+ */
+enum class InterchangeFormat {
+    Csv,
+    Json
+};
+
+
+/// \brief Picks the layout of an import or export file by its extension; anything but .json is CSV.
+InterchangeFormat interchangeFormatOf(const std::string& fileName) {
+    std::size_t dot = fileName.rfind('.');
+    std::string extension = dot == std::string::npos ? "" : fileName.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    return extension == "json" ? InterchangeFormat::Json : InterchangeFormat::Csv;
+}
+
+
+/**
+ * \brief The field a CSV column or a JSON member fills in, by its name.
+ *
+ * Next to the names of the fields, the names other password managers export them under are understood:
+ * title, folder, url and username.
+ *
+ * \return The field number, or -1 for a column that is not imported.
+ */
+int interchangeField(std::string_view key) {
+
+    static const std::pair<const char*, Field> names[] = {
+        {"name", Field::Name}, {"title", Field::Name}, {"password", Field::Password},
+        {"category", Field::Category}, {"folder", Field::Category}, {"website", Field::Website},
+        {"url", Field::Website}, {"login", Field::Login}, {"username", Field::Login}};
+
+    for (const auto& name : names) {
+        std::size_t length = std::strlen(name.first);
+        if (key.size() == length && std::equal(key.begin(), key.end(), name.first, [](char x, char y) {
+                return std::tolower(static_cast<unsigned char>(x)) == y;
+            })) {
+            return static_cast<int>(name.second);
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * \brief The length of the first complete record of an import, or 0 if none is complete yet.
+ *
+ * A CSV record ends with the first line break outside of quotes. A JSON record is everything up to the
+ * brace that closes the first object, including the commas and brackets before it.
+ */
+std::size_t nextInterchangeRecord(std::string_view bytes, InterchangeFormat format) {
+
+    if (format == InterchangeFormat::Csv) {
+        bool quoted = false;
+        for (std::size_t i = 0; i < bytes.size(); i++) {
+            if (bytes[i] == '"') {
+                quoted = !quoted;
+            } else if (bytes[i] == '\n' && !quoted) {
+                return i + 1;
+            }
+        }
+        return 0;
+    }
+
+    std::size_t depth = 0;
+    bool quoted = false;
+    for (std::size_t i = 0; i < bytes.size(); i++) {
+        char c = bytes[i];
+        if (quoted) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                quoted = false;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && depth > 0 && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+
+/// \brief The record boundaries of an import file, for a ChunkReader over it.
+ChunkReader::Boundary interchangeBoundary(InterchangeFormat format) {
+    return [format](std::string_view bytes, bool atEnd, std::size_t& records) {
+        std::size_t end = 0;
+        for (std::size_t length; (length = nextInterchangeRecord(bytes.substr(end), format)) > 0; end += length) {
+            records++;
+        }
+        return atEnd ? bytes.size() : end;
+    };
+}
+
+
+/// What parsing one record of an import gave.
+enum class ParsedRecord : std::uint8_t {Blank, Record, Malformed};
+
+/**
+ * \brief Splits one CSV record into its values.
+ *
+ * Quoted values may hold commas, line breaks and doubled quotes. A line break may be CRLF.
+ */
+ParsedRecord parseCsvRecord(std::string_view text, std::vector<std::string>& values) {
+
+    values.assign(1, std::string());
+    if (!text.empty() && text.back() == '\n') {
+        text.remove_suffix(1);
+    }
+    if (!text.empty() && text.back() == '\r') {
+        text.remove_suffix(1);
+    }
+    if (text.empty()) {
+        return ParsedRecord::Blank;
+    }
+
+    bool quoted = false;
+    for (std::size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (quoted) {
+            if (c != '"') {
+                values.back() += c;
+            } else if (i + 1 < text.size() && text[i + 1] == '"') {
+                values.back() += '"';
+                i++;
+            } else {
+                quoted = false;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            values.emplace_back();
+        } else {
+            values.back() += c;
+        }
+    }
+    return quoted ? ParsedRecord::Malformed : ParsedRecord::Record;
+}
+
+
+/// \brief Appends a code point to a string as UTF-8.
+void appendUtf8(std::string& out, std::uint32_t code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xc0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xe0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+}
+
+
+/**
+ * \brief Parses one JSON object of an import into a password set.
+ *
+ * Members whose names are not fields are skipped, whatever their values. Field values must be strings,
+ * numbers, booleans or null, which counts as empty. Anything around the object, such as the brackets
+ * of the array and the commas between objects, is ignored.
+ */
+ParsedRecord parseJsonRecord(std::string_view text, PasswordData& plain) {
+
+    std::size_t i = 0;
+    auto skipSpace = [&]() {
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) {
+            i++;
+        }
+    };
+    auto readHex = [&](std::uint32_t& code) {
+        if (text.size() - i < 4) {
+            return false;
+        }
+        code = 0;
+        for (std::size_t k = 0; k < 4; k++) {
+            char c = text[i++];
+            if (!std::isxdigit(static_cast<unsigned char>(c))) {
+                return false;
+            }
+            code = code * 16 + static_cast<std::uint32_t>(std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+        return true;
+    };
+    auto readString = [&](std::string& out) {
+        out.clear();
+        if (i >= text.size() || text[i] != '"') {
+            return false;
+        }
+        for (i++; i < text.size(); i++) {
+            char c = text[i];
+            if (c == '"') {
+                i++;
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (++i >= text.size()) {
+                return false;
+            }
+            static const std::string_view escapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
+            std::size_t escape = escapes.find(text[i]);
+            if (escape != std::string_view::npos && escape % 2 == 0) {
+                out += escapes[escape + 1];
+                continue;
+            }
+            if (text[i] != 'u') {
+                return false;
+            }
+            i++;
+            std::uint32_t code = 0;
+            if (!readHex(code)) {
+                return false;
+            }
+            if (code >= 0xd800 && code < 0xdc00 && text.substr(i, 2) == "\\u") {
+                i += 2;
+                std::uint32_t low = 0;
+                if (!readHex(low) || low < 0xdc00 || low >= 0xe000) {
+                    return false;
+                }
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            }
+            appendUtf8(out, code);
+            i--;
+        }
+        return false;
+    };
+    // Skips a value of any kind, nested objects and arrays included; a literal is kept in out.
+    std::function<bool(std::string&)> readValue = [&](std::string& out) {
+        skipSpace();
+        if (i >= text.size()) {
+            return false;
+        }
+        if (text[i] == '"') {
+            return readString(out);
+        }
+        out.clear();
+        if (text[i] == '{' || text[i] == '[') {
+            char close = text[i] == '{' ? '}' : ']';
+            std::string ignored;
+            for (i++, skipSpace(); i < text.size() && text[i] != close; skipSpace()) {
+                if (close == '}' && (!readString(ignored) || (skipSpace(), i >= text.size() || text[i++] != ':'))) {
+                    return false;
+                }
+                if (!readValue(ignored)) {
+                    return false;
+                }
+                skipSpace();
+                if (i < text.size() && text[i] == ',') {
+                    i++;
+                } else if (i < text.size() && text[i] != close) {
+                    return false;
+                }
+            }
+            return i++ < text.size();
+        }
+        std::size_t start = i;
+        while (i < text.size() && (std::isalnum(static_cast<unsigned char>(text[i])) || std::strchr("+-.", text[i]) != nullptr)) {
+            i++;
+        }
+        out = std::string(text.substr(start, i - start));
+        if (out == "null") {
+            out.clear();
+        }
+        return i > start;
+    };
+
+    i = text.find('{');
+    if (i == std::string_view::npos) {
+        return text.find_first_not_of(" \t\r\n,[]") == std::string_view::npos ? ParsedRecord::Blank : ParsedRecord::Malformed;
+    }
+
+    plain = PasswordData();
+    std::string key;
+    std::string value;
+    for (i++, skipSpace(); i < text.size() && text[i] != '}'; skipSpace()) {
+        if (!readString(key)) {
+            return ParsedRecord::Malformed;
+        }
+        skipSpace();
+        if (i >= text.size() || text[i++] != ':' || !readValue(value)) {
+            return ParsedRecord::Malformed;
+        }
+        int field = interchangeField(key);
+        if (field >= 0) {
+            plain.field(static_cast<Field>(field)) = value;
+        }
+        skipSpace();
+        if (i < text.size() && text[i] == ',') {
+            i++;
+        } else if (i < text.size() && text[i] != '}') {
+            return ParsedRecord::Malformed;
+        }
+    }
+    return i < text.size() ? ParsedRecord::Record : ParsedRecord::Malformed;
+}
+
+
+/// \brief Appends a value to a CSV record, quoted if it has to be.
+void appendCsvValue(std::string& out, std::string_view value) {
+    if (value.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out.append(value.data(), value.size());
+        return;
+    }
+    out += '"';
+    for (char c : value) {
+        if (c == '"') {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+
+/// \brief Appends a value to JSON output as a string, escaping what has to be escaped.
+void appendJsonString(std::string& out, std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for (char c : value) {
+        auto byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (c == '\r') {
+            out += "\\r";
+        } else if (byte < 0x20) {
+            out += "\\u00";
+            out += hex[byte >> 4];
+            out += hex[byte & 0xf];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+
+/// \brief The order of the fields in an export, the same as the output of the batch list command.
+const Field exportFields[] = {Field::Name, Field::Category, Field::Website, Field::Login, Field::Password};
+
+
+/**
+ * \struct InterchangeOptions
+ * \brief How importVault() and exportVault() run.
+ */
+struct InterchangeOptions {
+    InterchangeFormat format = InterchangeFormat::Csv;
+
+    /// Threads that parse, seal and serialize, or open and format; 0 means one per core.
+    std::size_t workers = 0;
+
+    /// Largest number of chunks between the reader and the writer.
+    std::size_t depth = 8;
+
+    /// Bytes read per chunk.
+    std::size_t chunkSize = 1 << 20;
+};
+
+
+/**
+ * \struct InterchangeResult
+ * \brief What an import or an export did.
+ */
+struct InterchangeResult {
+    bool ok = false;
+    std::string error;
+
+    /// Password sets imported or exported.
+    std::size_t records = 0;
+
+    /// Import records that were malformed or can't be stored in the vault, or vault records that
+    /// failed to authenticate.
+    std::size_t rejected = 0;
+
+    std::size_t bytesRead = 0;
+    std::size_t bytesWritten = 0;
+    double milliseconds = 0;
+};
+
+
+/**
+ * \brief Opens a vault for a streaming import or export without loading it.
+ *
+ * A missing or empty vault is created the way PasswordManager creates it. Once the password checks
+ * out, a journal left by a crash is recovered.
+ *
+ * \param header Receives the header size, 0 for a text vault.
+ * \return The cipher of the vault, or nullptr if the password is wrong.
+ */
+std::unique_ptr<FieldCipher> openVaultStream(const std::string& vaultFile, const std::string& masterPassword,
+                                             VaultFormat& format, std::size_t& header) {
+
+    struct stat info{};
+    if (::stat(vaultFile.c_str(), &info) != 0 || info.st_size == 0) {
+        PasswordManager created(vaultFile, masterPassword);
+        if (!created.isUnlocked()) {
+            return nullptr;
+        }
+    }
+    MappedFile file(vaultFile);
+    VaultHeader vaultHeader;
+    std::string vaultKey;
+    if (file.view().empty() || !checkMasterPassword(file.view(), masterPassword, vaultHeader, vaultKey)) {
+        return nullptr;
+    }
+    format = detectFormat(file.view());
+    header = format == VaultFormat::Binary ? headerSize(file.view()) : 0;
+
+    VaultLock lock(vaultFile, LOCK_EX);
+    recoverJournal(vaultFile);
+    return makeCipher(format == VaultFormat::Binary ? vaultHeader.cipherId : 0, vaultKey);
+}
+
+
+/**
+ * \brief Streams over the valid blocks of a vault file with a ChunkReader.
+ *
+ * Binary blocks are verified the way the loader verifies them, and the walk stops at the first broken
+ * block.
+ *
+ * \param visit Called with every block and its position in the file, in file order.
+ * \return The length of the part of the file that holds the header and the valid blocks.
+ */
+template <typename Visitor>
+std::size_t forEachVaultBlock(int fd, VaultFormat format, std::size_t header, Visitor&& visit) {
+
+    ::lseek(fd, static_cast<off_t>(header), SEEK_SET);
+    ChunkReader reader(fd, 1 << 20, static_cast<std::size_t>(-1), vaultBoundary(format));
+    std::string chunk;
+    std::size_t position = 0;
+    std::size_t valid = header;
+
+    while (reader.next(chunk, position)) {
+        auto visitBlock = [&](const RecordView& record) {
+            visit(record, position++);
+        };
+        if (format == VaultFormat::Binary) {
+            std::size_t length = forEachBinaryRecord(chunk, visitBlock);
+            valid += length;
+            if (length < chunk.size()) {
+                break;
+            }
+        } else {
+            forEachTextRecord(chunk, visitBlock);
+            valid += chunk.size();
+        }
+    }
+    return valid;
+}
+
+
+/**
+ * \brief Appends the password sets of a CSV or JSON file to a vault, streaming, without loading the vault.
+ *
+ * A reader cuts the input into chunks of whole records, workers parse them, seal every password set
+ * under its own nonce and serialize it in the format of the vault, and the calling thread appends the
+ * chunks to the vault in input order with one large write each, see runPipeline(). The memory used
+ * does not depend on the size of the input or of the vault.
+ *
+ * A CSV file starts with a header line naming its columns, see interchangeField(); columns with other
+ * names are ignored. Password sets without a name are rejected, and so are those a text vault can't
+ * hold: with a line break in a field or a name starting with a space.
+ *
+ * The import is all-or-nothing. Before the first write the old length of the vault is recorded in its
+ * journal; the vault is synced at the end and only then is the journal cleared, so a crash in between
+ * cuts the vault back to where it was, see recoverJournal(). The vault is written under the exclusive
+ * VaultLock, so processes that have it open wait for the import to end and then take in the imported
+ * password sets, see PasswordManager::refresh().
+ *
+ * The record nonces are a random base per import with the record's position in the input mixed in.
+ *
+ * \param vaultFile The vault to append to; it is created if it does not exist.
+ * \param inputFile The file to import, or "-" for standard input.
+ * \param masterPassword The master password of the vault.
+ * \return What was imported; the time does not include deriving the vault key.
+ */
+InterchangeResult importVault(const std::string& vaultFile, const std::string& inputFile,
+                              const std::string& masterPassword, const InterchangeOptions& options) {
+
+    InterchangeResult result;
+    VaultFormat format = VaultFormat::Binary;
+    std::size_t header = 0;
+    std::unique_ptr<FieldCipher> cipher = openVaultStream(vaultFile, masterPassword, format, header);
+    if (cipher == nullptr) {
+        result.error = "Wrong password for " + vaultFile;
+        return result;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    int input = inputFile == "-" ? 0 : ::open(inputFile.c_str(), O_RDONLY);
+    if (input < 0) {
+        result.error = "Can't open " + inputFile;
+        return result;
+    }
+
+    // The header line of a CSV file tells which column holds which field.
+    std::vector<int> columns;
+    ChunkReader reader(input, options.chunkSize, static_cast<std::size_t>(-1), interchangeBoundary(options.format));
+    if (options.format == InterchangeFormat::Csv) {
+        reader.setBoundary([](std::string_view bytes, bool atEnd, std::size_t& records) {
+            std::size_t length = nextInterchangeRecord(bytes, InterchangeFormat::Csv);
+            records = 1;
+            return length > 0 || !atEnd ? length : bytes.size();
+        });
+        std::string line;
+        std::size_t position = 0;
+        std::vector<std::string> names;
+        if (reader.next(line, position) && parseCsvRecord(line, names) == ParsedRecord::Record) {
+            for (const std::string& name : names) {
+                columns.push_back(interchangeField(name));
+            }
+        }
+        if (std::find(columns.begin(), columns.end(), static_cast<int>(Field::Name)) == columns.end()) {
+            result.error = "No header line with a name column in " + inputFile;
+            if (input != 0) {
+                ::close(input);
+            }
+            return result;
+        }
+        reader.setBoundary(interchangeBoundary(options.format));
+    }
+
+    VaultLock lock(vaultFile, LOCK_EX);
+    int vault = ::open(vaultFile.c_str(), O_RDWR);
+    std::size_t vaultLength = vault >= 0 ? forEachVaultBlock(vault, format, header, [](const RecordView&, std::size_t) {}) : 0;
+    std::string journalFile = journal::fileOf(vaultFile);
+    int journalFd = ::open(journalFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    // A torn block at the end of a binary vault would hide everything appended after it.
+    bool prepared = vault >= 0 && journalFd >= 0 && writeAll(journalFd, journal::encode(vaultLength, {}))
+                    && ::fsync(journalFd) == 0 && ::ftruncate(vault, static_cast<off_t>(vaultLength)) == 0
+                    && ::lseek(vault, 0, SEEK_END) >= 0;
+    crashPoint();
+
+    std::string nonceBase = randomBytes(cipher->nonceSize());
+    std::atomic<std::size_t> records{0};
+    std::atomic<std::size_t> rejected{0};
+    std::atomic<std::size_t> bytesRead{0};
+
+    auto transform = [&](const std::string& chunk, std::size_t position, std::string& out) {
+
+        std::string_view rest = chunk;
+        std::vector<std::string> values;
+        PasswordData plain;
+        PasswordData sealed;
+        std::size_t accepted = 0;
+        std::size_t refused = 0;
+
+        while (!rest.empty()) {
+            std::size_t length = nextInterchangeRecord(rest, options.format);
+            std::string_view text = rest.substr(0, length > 0 ? length : rest.size());
+            rest.remove_prefix(text.size());
+            std::size_t index = position++;
+
+            ParsedRecord parsed;
+            if (options.format == InterchangeFormat::Csv) {
+                parsed = parseCsvRecord(text, values);
+                plain = PasswordData();
+                for (std::size_t c = 0; c < values.size() && c < columns.size(); c++) {
+                    if (columns[c] >= 0) {
+                        plain.field(static_cast<Field>(columns[c])) = std::move(values[c]);
+                    }
+                }
+            } else {
+                parsed = parseJsonRecord(text, plain);
+            }
+            if (parsed == ParsedRecord::Blank) {
+                continue;
+            }
+
+            bool storable = parsed == ParsedRecord::Record && !plain.name.empty();
+            if (storable && format == VaultFormat::Text) {
+                storable = plain.name[0] != ' ';
+                for (Field field : exportFields) {
+                    storable = storable && plain.field(field).find_first_of("\r\n") == std::string::npos;
+                }
+            }
+            if (!storable) {
+                refused++;
+                continue;
+            }
+
+            sealed.nonce = nonceBase;
+            for (std::size_t k = 0; k < 8 && k + 4 < sealed.nonce.size(); k++) {
+                sealed.nonce[k + 4] = static_cast<char>(sealed.nonce[k + 4] ^ ((index >> (8 * k)) & 0xff));
+            }
+            for (Field field : {Field::Name, Field::Password, Field::Category, Field::Website, Field::Login}) {
+                sealed.field(field) = cipher->seal(plain.field(field), sealed.nonce, field);
+            }
+            if (format == VaultFormat::Text) {
+                out += sealed.toString();
+            } else {
+                encodeBinaryRecord(out, viewOf(sealed));
+            }
+            accepted++;
+        }
+        records += accepted;
+        rejected += refused;
+        bytesRead += chunk.size();
+    };
+
+    bool written = prepared && runPipeline(
+        options.workers == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.workers, options.depth,
+        [&](std::string& chunk, std::size_t& position) {
+            return reader.next(chunk, position);
+        },
+        transform,
+        [&](const std::string& bytes) {
+            result.bytesWritten += bytes.size();
+            return writeAll(vault, bytes);
+        });
+    crashPoint();
+    written = written && !reader.failed() && ::fsync(vault) == 0;
+    crashPoint();
+
+    // A failed import is cut back right away. The journal goes only once the vault is synced either way;
+    // otherwise it is left for recoverJournal() to cut the vault back.
+    bool consistent = written || !prepared
+                      || (::ftruncate(vault, static_cast<off_t>(vaultLength)) == 0 && ::fsync(vault) == 0);
+    if (journalFd >= 0 && consistent && ::ftruncate(journalFd, 0) == 0 && ::fsync(journalFd) == 0) {
+        std::remove(journalFile.c_str());
+    }
+    for (int fd : {vault, journalFd}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    if (input != 0) {
+        ::close(input);
+    }
+
+    result.ok = written;
+    result.error = written ? "" : "Can't write " + vaultFile;
+    result.records = written ? records.load() : 0;
+    result.rejected = rejected;
+    result.bytesRead = bytesRead;
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+
+/**
+ * \brief Writes the password sets of a vault to a CSV or JSON file, streaming, without loading the vault.
+ *
+ * A first pass over the vault collects its tombstones, decrypting nothing else. Then a reader cuts the
+ * vault into chunks of whole blocks, workers open the password sets no later tombstone cancels and format
+ * them, and the calling thread writes the chunks in vault order with one large write each, see
+ * runPipeline(). Apart from the tombstones, which compaction keeps few, the memory used does not depend
+ * on the size of the vault. Password sets come out in the order they were added, the same ones
+ * PasswordManager would load.
+ *
+ * The export holds every password in plaintext, so the file is created readable by its owner only, and
+ * replaced atomically, see replaceFile(). The vault is read under the shared VaultLock, so the export
+ * shows it as it was at one point in time.
+ *
+ * \param vaultFile The vault to export.
+ * \param outputFile The file to write, or "-" for standard output.
+ * \param masterPassword The master password of the vault.
+ * \return What was exported; the time does not include deriving the vault key.
+ */
+InterchangeResult exportVault(const std::string& vaultFile, const std::string& outputFile,
+                              const std::string& masterPassword, const InterchangeOptions& options) {
+
+    InterchangeResult result;
+    struct stat info{};
+    VaultFormat format = VaultFormat::Binary;
+    std::size_t header = 0;
+    std::unique_ptr<FieldCipher> cipher = ::stat(vaultFile.c_str(), &info) == 0 && info.st_size > 0
+                                          ? openVaultStream(vaultFile, masterPassword, format, header) : nullptr;
+    VaultLock lock(vaultFile, LOCK_SH);
+    int vault = cipher != nullptr ? ::open(vaultFile.c_str(), O_RDONLY) : -1;
+    if (vault < 0) {
+        result.error = cipher == nullptr ? "Wrong password for " + vaultFile : "Can't open " + vaultFile;
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Sealed names differ from record to record, so tombstones are matched on the decrypted keys.
+    std::unordered_map<std::string, std::size_t> lastNameTombstone;
+    std::unordered_map<std::string, std::size_t> lastCategoryTombstone;
+    std::size_t validLength = forEachVaultBlock(vault, format, header, [&](const RecordView& record, std::size_t position) {
+        if (record.kind == RecordKind::NameTombstone) {
+            lastNameTombstone[cipher->open(record.name, record.nonce, Field::Name)] = position;
+        } else if (record.kind == RecordKind::CategoryTombstone) {
+            lastCategoryTombstone[cipher->open(record.category, record.nonce, Field::Category)] = position;
+        }
+    });
+
+    ::lseek(vault, static_cast<off_t>(header), SEEK_SET);
+    ChunkReader reader(vault, options.chunkSize, validLength - header, vaultBoundary(format));
+    std::atomic<std::size_t> records{0};
+    std::atomic<std::size_t> rejected{0};
+    std::atomic<std::size_t> bytesRead{0};
+
+    auto transform = [&](const std::string& chunk, std::size_t position, std::string& out) {
+
+        std::string plain[5];
+        std::size_t accepted = 0;
+        std::size_t refused = 0;
+
+        auto cancelled = [](const std::unordered_map<std::string, std::size_t>& tombstones, const std::string& key,
+                            std::size_t current) {
+            auto it = tombstones.find(key);
+            return it != tombstones.end() && it->second > current;
+        };
+
+        auto exportRecord = [&](const RecordView& record) {
+
+            std::size_t current = position++;
+            if (record.kind != RecordKind::Entry) {
+                return;
+            }
+            bool authentic = true;
+            std::string_view sealed[5] = {record.name, record.category, record.website, record.login, record.password};
+            for (std::size_t f = 0; f < 5; f++) {
+                plain[f].resize(sealed[f].size());
+                long length = cipher->openInto(sealed[f], record.nonce, exportFields[f], plain[f].data());
+                authentic = authentic && length >= 0;
+                plain[f].resize(length < 0 ? 0 : static_cast<std::size_t>(length));
+            }
+            if (!authentic) {
+                refused++;
+                return;
+            }
+            if (cancelled(lastNameTombstone, plain[0], current) || cancelled(lastCategoryTombstone, plain[1], current)) {
+                return;
+            }
+
+            if (options.format == InterchangeFormat::Csv) {
+                for (std::size_t f = 0; f < 5; f++) {
+                    if (f > 0) {
+                        out += ',';
+                    }
+                    appendCsvValue(out, plain[f]);
+                }
+                out += '\n';
+            } else {
+                static const char* const keys[] = {",\n{\"name\":", ",\"category\":", ",\"website\":", ",\"login\":", ",\"password\":"};
+                for (std::size_t f = 0; f < 5; f++) {
+                    out += keys[f];
+                    appendJsonString(out, plain[f]);
+                }
+                out += '}';
+            }
+            accepted++;
+        };
+
+        if (format == VaultFormat::Binary) {
+            forEachBinaryRecord(chunk, exportRecord, false);
+        } else {
+            forEachTextRecord(chunk, exportRecord);
+        }
+        records += accepted;
+        rejected += refused;
+        bytesRead += chunk.size();
+    };
+
+    auto writeExport = [&](int fd) {
+        // The first JSON object is not preceded by a comma.
+        bool first = true;
+        std::string head = options.format == InterchangeFormat::Csv ? "name,category,website,login,password\n" : "[";
+        bool written = writeAll(fd, head) && runPipeline(
+            options.workers == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.workers, options.depth,
+            [&](std::string& chunk, std::size_t& position) {
+                return reader.next(chunk, position);
+            },
+            transform,
+            [&](const std::string& bytes) {
+                std::string_view view = bytes;
+                if (first && options.format == InterchangeFormat::Json && !view.empty()) {
+                    view.remove_prefix(1);
+                    first = false;
+                }
+                result.bytesWritten += view.size();
+                return writeAll(fd, view);
+            });
+        std::string tail = options.format == InterchangeFormat::Json ? "\n]\n" : "";
+        result.bytesWritten += head.size() + tail.size();
+        return written && writeAll(fd, tail) && !reader.failed();
+    };
+
+    bool written = outputFile == "-" ? writeExport(1) : replaceFile(outputFile, writeExport);
+    ::close(vault);
+
+    result.ok = written;
+    result.error = written ? "" : "Can't write " + outputFile;
+    result.records = records;
+    result.rejected = rejected;
+    result.bytesRead = bytesRead;
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+
+
+/**
+ * \brief Parses one command line option of --import and --export.
+ *
+ * Accepted: --format=csv|json, --workers=<n>, --depth=<chunks> and --chunk=<bytes>.
+ *
+ * \return False if the option is unknown or its value is invalid.
+ */
+bool parseInterchangeOption(const std::string& argument, InterchangeOptions& options) {
+
+    std::size_t equals = argument.find('=');
+    std::string key = equals == std::string::npos ? std::string() : argument.substr(0, equals);
+    std::string value = argument.substr(equals == std::string::npos ? argument.size() : equals + 1);
+
+    if (key == "--format" && (value == "csv" || value == "json")) {
+        options.format = value == "csv" ? InterchangeFormat::Csv : InterchangeFormat::Json;
+        return true;
+    }
+
+    std::size_t* target = key == "--workers" ? &options.workers
+                        : key == "--depth" ? &options.depth
+                        : key == "--chunk" ? &options.chunkSize
+                        : nullptr;
+    char* end = nullptr;
+    unsigned long long parsed = std::strtoull(value.c_str(), &end, 10);
+    if (target == nullptr || value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])) || *end != '\0'
+        || (parsed == 0 && key != "--workers")) {
+        return false;
+    }
+    *target = static_cast<std::size_t>(parsed);
+    return true;
+}
+
+
+/// \brief Prints what an import or an export did, with its throughput.
+void printInterchangeResult(std::FILE* out, const char* what, const InterchangeResult& result) {
+    double seconds = result.milliseconds / 1000;
+    std::fprintf(out, "%s %zu password sets (%zu rejected) in %.1f ms: %.0f entries/s, %.1f MB/s read, %.1f MB/s written\n",
+                 what, result.records, result.rejected, result.milliseconds, result.records / seconds,
+                 result.bytesRead / seconds / 1e6, result.bytesWritten / seconds / 1e6);
+}
+
+
+
+
+/**
+ * \brief Opens a vault and runs a command script against it, see PasswordManager::runBatch().
+ *
+ * The first line of standard input is the master password. The commands are read from the script file
+ * if one is given, and from the rest of standard input otherwise.
+ *
+ * \param fileName The vault file.
+ * \param scriptName The script file, or an empty string for standard input.
+ * \param policy When the grouped writes reach the disk, see FlushPolicy.
+ * \return The exit code: 0 if every command ran, 1 otherwise.
+ */
+int runBatchMode(const std::string& fileName, const std::string& scriptName, FlushPolicy policy) {
+
+    std::ios::sync_with_stdio(false);
+
+    std::string masterPassword;
+    std::getline(std::cin, masterPassword);
+
+    PasswordManager manager(fileName, masterPassword);
+    if (!manager.isUnlocked()) {
+        std::cerr << "Wrong password for " << fileName << std::endl;
+        return 1;
+    }
+    manager.setFlushPolicy(policy);
+    manager.watchForChanges();
+
+    std::size_t errors = 0;
+    if (scriptName.empty()) {
+        errors = manager.runBatch(std::cin, std::cout);
+    } else {
+        std::ifstream script(scriptName);
+        if (!script.is_open()) {
+            std::cerr << "Can't open " << scriptName << std::endl;
+            return 1;
+        }
+        errors = manager.runBatch(script, std::cout);
+    }
+    return errors == 0 ? 0 : 1;
+}
+
+
+/**
+ * \class Poller
+ * \brief Waits until sockets can be read or written: with epoll on Linux, with poll() elsewhere.
+ *
+ * Building with -DPM_USE_POLL picks poll() on Linux too.
+ */
+class Poller {
+
+public:
+    struct Event {
+        int fd;
+        bool readable;
+        bool writable;
+    };
+
+private:
+#ifdef PM_HAVE_EPOLL
+    int epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<epoll_event> ready = std::vector<epoll_event>(256);
+#else
+    std::vector<pollfd> watched;
+#endif
+    std::vector<Event> events;
+
+public:
+    Poller() = default;
+
+    ~Poller() {
+#ifdef PM_HAVE_EPOLL
+        ::close(epollFd);
+#endif
+    }
+
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    /// \brief Starts watching a socket, or changes what it is watched for. Readability is always watched.
+    void watch(int fd, bool writable) {
+#ifdef PM_HAVE_EPOLL
+        epoll_event event{};
+        event.events = EPOLLIN | (writable ? static_cast<std::uint32_t>(EPOLLOUT) : 0);
+        event.data.fd = fd;
+        if (::epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) != 0 && errno == ENOENT) {
+            ::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+#else
+        short wanted = POLLIN | (writable ? POLLOUT : 0);
+        for (pollfd& entry : watched) {
+            if (entry.fd == fd) {
+                entry.events = wanted;
+                return;
+            }
+        }
+        watched.push_back({fd, wanted, 0});
+#endif
+    }
+
+    /// \brief Stops watching a socket; call it before closing the socket.
+    void forget(int fd) {
+#ifdef PM_HAVE_EPOLL
+        ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+#else
+        watched.erase(std::remove_if(watched.begin(), watched.end(), [fd](const pollfd& entry) {
+            return entry.fd == fd;
+        }), watched.end());
+#endif
+    }
+
+    /**
+     * \brief Waits for the watched sockets.
+     *
+     * A socket that was closed or failed on the other end is reported readable, so the caller finds out
+     * by reading from it.
+     *
+     * \param timeoutMilliseconds How long to wait at most; -1 waits until something happens.
+     * \return The sockets that are ready, valid until the next call.
+     */
+    const std::vector<Event>& wait(int timeoutMilliseconds) {
+        events.clear();
+#ifdef PM_HAVE_EPOLL
+        int count = ::epoll_wait(epollFd, ready.data(), static_cast<int>(ready.size()), timeoutMilliseconds);
+        for (int i = 0; i < count; i++) {
+            std::uint32_t flags = ready[i].events;
+            events.push_back({ready[i].data.fd, (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0,
+                              (flags & EPOLLOUT) != 0});
+        }
+#else
+        if (::poll(watched.data(), watched.size(), timeoutMilliseconds) > 0) {
+            for (const pollfd& entry : watched) {
+                if (entry.revents != 0) {
+                    events.push_back({entry.fd, (entry.revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) != 0,
+                                      (entry.revents & POLLOUT) != 0});
+                }
+            }
+        }
+#endif
+        return events;
+    }
+};
+
+
+/// \brief Write end of the pipe that wakes the daemon's event loop; the signal handler writes to it too.
+std::atomic<int> daemonWakeFd{-1};
+
+/// \brief Set by SIGINT and SIGTERM to shut the daemon down.
+volatile std::sig_atomic_t daemonStopping = 0;
+
+extern "C" void stopDaemon(int) {
+    daemonStopping = 1;
+    int fd = daemonWakeFd.load();
+    if (fd >= 0) {
+        char byte = 0;
+        ssize_t ignored = ::write(fd, &byte, 1);
+        (void)ignored;
+    }
+}
+
+
+/**
+ * \brief Fills in a Unix domain socket address.
+ *
+ * \return False if the path is too long for one.
+ */
+bool socketAddress(const std::string& socketPath, sockaddr_un& address) {
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    return true;
+}
+
+
+/// \brief Connects to a daemon's socket; returns the connected socket, or -1.
+int connectToDaemon(const std::string& socketPath) {
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address)) {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+
+/**
+ * \brief Serves a vault to local clients over a Unix domain socket until SIGINT or SIGTERM.
+ *
+ * The vault is unlocked and loaded once. Clients send commands of the batch language, one per line,
+ * see PasswordManager::runBatch(). The answer to each one is the output runBatch() would print for it,
+ * followed by an empty line; errors come back as a single "error: ..." line. A client may send several
+ * commands at once, and gets the answers back in order.
+ *
+ * A single thread runs the event loop (epoll, or poll() where there is none, see Poller) and does all
+ * socket I/O. The commands run on a pool of worker threads, one command per client at a time. Exact
+ * name searches, list and category are answered from the latest published VaultSnapshot and never wait,
+ * see PasswordManager::runSnapshotCommand(). Other commands that only read, see
+ * PasswordManager::isReadOnlyCommand(), share a reader-writer lock and run side by side; all others
+ * take it alone. Changes reach the disk under the given flush policy, and under the
+ * default Immediate policy a change is on disk before it is answered.
+ *
+ * Changes other processes make to the vault are picked up as the event loop learns about them, see
+ * PasswordManager::refresh(). Without inotify the vault is checked at least once a second.
+ *
+ * The socket is created readable and writable by its owner only.
+ *
+ * \param fileName The vault file.
+ * \param socketPath Where to create the socket.
+ * \param masterPassword The master password of the vault.
+ * \param workers The number of worker threads; 0 means one per core.
+ * \param policy When changes reach the vault file.
+ * \return The exit code of the program.
+ */
+int runDaemon(const std::string& fileName, const std::string& socketPath, const std::string& masterPassword,
+              std::size_t workers, FlushPolicy policy) {
+
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return 1;
+    }
+    int running = connectToDaemon(socketPath);
+    if (running >= 0) {
+        ::close(running);
+        std::cerr << "A daemon is already listening on " << socketPath << std::endl;
+        return 1;
+    }
+
+    PasswordManager manager(fileName, masterPassword);
+    if (!manager.isUnlocked()) {
+        std::cerr << "Wrong password for " << fileName << std::endl;
+        return 1;
+    }
+    manager.setFlushPolicy(policy);
+    manager.prepareFuzzySearch();
+    manager.prepareTextSearch();
+    manager.enableSnapshots();
+    manager.watchForChanges();
+    std::shared_mutex managerLock;
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(socketPath.c_str());
+    mode_t previousMask = ::umask(077);
+    bool bound = listener >= 0 && ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    ::umask(previousMask);
+    if (!bound || ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Can't listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        return 1;
+    }
+
+    int wake[2];
+    if (::pipe(wake) != 0) {
+        ::close(listener);
+        return 1;
+    }
+    for (int fd : {listener, wake[0], wake[1]}) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    daemonWakeFd = wake[1];
+    daemonStopping = 0;
+    std::signal(SIGINT, stopDaemon);
+    std::signal(SIGTERM, stopDaemon);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    struct Connection {
+        std::string in;
+        std::string out;
+        bool busy = false;
+        bool closing = false;
+    };
+    std::unordered_map<int, Connection> connections;
+
+    // Answers travel from the workers back to the event loop through this queue and a byte on the pipe.
+    std::mutex answersMutex;
+    std::vector<std::pair<int, std::string>> answers;
+
+    // A client sending more than this without a newline is cut off.
+    const std::size_t maxLine = 1 << 20;
+
+    Poller poller;
+    poller.watch(listener, false);
+    poller.watch(wake[0], false);
+    int changes = manager.changeDescriptor();
+    if (changes >= 0) {
+        poller.watch(changes, false);
+    }
+
+    {
+        // Declared after everything the workers use, so it is joined before any of it goes away.
+        ThreadPool pool(workers == 0 ? std::max(1u, std::thread::hardware_concurrency()) + 1 : workers + 1);
+
+        auto disconnect = [&](int fd) {
+            poller.forget(fd);
+            ::close(fd);
+            connections.erase(fd);
+        };
+
+        auto flushOut = [&](int fd, Connection& connection) {
+            while (!connection.out.empty()) {
+                ssize_t written = ::write(fd, connection.out.data(), connection.out.size());
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    break;
+                }
+                connection.out.erase(0, static_cast<std::size_t>(written));
+            }
+            poller.watch(fd, !connection.out.empty());
+        };
+
+        auto dispatch = [&](int fd, Connection& connection) {
+            std::size_t newline = connection.in.find('\n');
+            if (connection.busy || newline == std::string::npos) {
+                return;
+            }
+            std::string line = connection.in.substr(0, newline);
+            connection.in.erase(0, newline + 1);
+            connection.busy = true;
+
+            pool.submit([&, fd, line]() {
+                std::string output;
+                std::string error;
+                if (manager.runSnapshotCommand(line, output)) {
+                    // Answered from the latest snapshot, without waiting for a writer.
+                } else if (PasswordManager::isReadOnlyCommand(line)) {
+                    std::shared_lock<std::shared_mutex> lock(managerLock);
+                    error = manager.runCommand(line, output);
+                } else {
+                    std::unique_lock<std::shared_mutex> lock(managerLock);
+                    error = manager.runCommand(line, output);
+                    manager.prepareFuzzySearch();
+                    manager.prepareTextSearch();
+                }
+                if (!error.empty()) {
+                    output = "error: " + error + "\n";
+                }
+                output += '\n';
+                {
+                    std::lock_guard<std::mutex> lock(answersMutex);
+                    answers.emplace_back(fd, std::move(output));
+                }
+                char byte = 0;
+                ssize_t ignored = ::write(wake[1], &byte, 1);
+                (void)ignored;
+            });
+        };
+
+        std::vector<std::pair<int, std::string>> arrived;
+        char buffer[65536];
+        bool timed = policy.trigger == FlushPolicy::Time;
+        bool changed = false;
+
+        while (!daemonStopping) {
+
+            for (const Poller::Event& event : poller.wait(timed ? 10 : changes < 0 ? 1000 : -1)) {
+
+                if (event.fd == changes) {
+                    changed = true;
+                    continue;
+                }
+
+                if (event.fd == listener) {
+                    for (int client; (client = ::accept(listener, nullptr, nullptr)) >= 0;) {
+                        ::fcntl(client, F_SETFL, ::fcntl(client, F_GETFL) | O_NONBLOCK);
+                        connections[client] = Connection();
+                        poller.watch(client, false);
+                    }
+                    continue;
+                }
+
+                if (event.fd == wake[0]) {
+                    while (::read(wake[0], buffer, sizeof(buffer)) > 0) {
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(answersMutex);
+                        arrived.swap(answers);
+                    }
+                    for (auto& answer : arrived) {
+                        Connection& connection = connections[answer.first];
+                        connection.busy = false;
+                        if (connection.closing) {
+                            disconnect(answer.first);
+                            continue;
+                        }
+                        connection.out += answer.second;
+                        dispatch(answer.first, connection);
+                        flushOut(answer.first, connection);
+                    }
+                    arrived.clear();
+                    continue;
+                }
+
+                auto found = connections.find(event.fd);
+                if (found == connections.end()) {
+                    continue;
+                }
+                Connection& connection = found->second;
+
+                if (event.writable) {
+                    flushOut(event.fd, connection);
+                }
+                if (event.readable) {
+                    ssize_t received = 0;
+                    while ((received = ::read(event.fd, buffer, sizeof(buffer))) > 0) {
+                        connection.in.append(buffer, static_cast<std::size_t>(received));
+                    }
+                    bool ended = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+                    if (ended || (connection.in.size() > maxLine && connection.in.find('\n') == std::string::npos)) {
+                        if (connection.busy) {
+                            // The worker still holds the socket number; it is closed once the answer arrives.
+                            poller.forget(event.fd);
+                            connection.closing = true;
+                        } else {
+                            disconnect(event.fd);
+                        }
+                        continue;
+                    }
+                    dispatch(event.fd, connection);
+                }
+            }
+
+            if (timed) {
+                std::unique_lock<std::shared_mutex> lock(managerLock);
+                manager.pollFlush();
+            }
+            if (changed || changes < 0) {
+                changed = false;
+                std::unique_lock<std::shared_mutex> lock(managerLock);
+                if (manager.refresh()) {
+                    manager.prepareFuzzySearch();
+                    manager.prepareTextSearch();
+                }
+            }
+        }
+    }
+
+    for (const auto& connection : connections) {
+        ::close(connection.first);
+    }
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+    daemonWakeFd = -1;
+    ::close(wake[0]);
+    ::close(wake[1]);
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    return 0;
+}
+
+#endif // PASSWORD_MANAGER_H
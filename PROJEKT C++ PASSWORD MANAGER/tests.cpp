@@ -0,0 +1,385 @@
+/**
+ * \file tests.cpp
+ * \brief Runs batch scripts against text and binary vaults and compares their output with the expected one.
+ *
+ * Every case starts from a fresh vault holding a single password set and runs its sessions in turn,
+ * each with the vault opened anew, so what a session expects also checks what the ones before it wrote.
+ * Failed writes, journal recovery and the import/export round trip are checked the same way. Built
+ * into its own executable next to the password manager and its benchmarks:
+ *
+ *     g++ -std=c++17 -O2 -pthread -o pm-test tests.cpp
+ */
+
+#include "password_manager.h"
+
+
+/// \brief The vault all cases run on; it is removed with everything next to it after each case.
+const std::string testVault = "pm-test.vault";
+
+/// \brief The password set every fresh vault starts with, as its line in the output of list.
+const std::string seedLine = "seed\tmisc\twww.seed.com\tsl\tsp\n";
+
+
+/**
+ * \struct Session
+ * \brief A script run on the vault opened once, and the output it must produce.
+ */
+struct Session {
+    const char* script;
+    const char* expected;
+};
+
+
+/**
+ * \struct BatchCase
+ * \brief A named sequence of sessions run on the same vault.
+ */
+struct BatchCase {
+    const char* name;
+    std::vector<Session> sessions;
+};
+
+
+/// \brief The cases, with "{seed}" standing for seedLine in the expected output.
+const std::vector<BatchCase> batchCases = {
+    {"add, search and list", {
+        {"add beta bl bp work www.beta.com\n"
+         "add alpha al ap work www.alpha.com\n"
+         "search alpha\n"
+         "list\n",
+         "alpha\twork\twww.alpha.com\tal\tap\n"
+         "alpha\twork\twww.alpha.com\tal\tap\n"
+         "beta\twork\twww.beta.com\tbl\tbp\n"
+         "{seed}"},
+        {"list\n"
+         "category work\n",
+         "alpha\twork\twww.alpha.com\tal\tap\n"
+         "beta\twork\twww.beta.com\tbl\tbp\n"
+         "{seed}"
+         "beta\twork\twww.beta.com\tbl\tbp\n"
+         "alpha\twork\twww.alpha.com\tal\tap\n"}}},
+    {"delete survives reopening", {
+        {"add github gl gp work www.github.com\n"
+         "add bank kl kp money www.bank.com\n"
+         "delete github\n"
+         "delete nothing\n",
+         "deleted 1\n"
+         "deleted 0\n"},
+        {"list\n",
+         "bank\tmoney\twww.bank.com\tkl\tkp\n"
+         "{seed}"}}},
+    {"deletecategory survives reopening", {
+        {"add one l1 p1 gone www.one.com\n"
+         "add two l2 p2 gone www.two.com\n"
+         "add three l3 p3 kept www.three.com\n"
+         "deletecategory gone\n",
+         "deleted 2\n"},
+        {"list\n"
+         "category gone\n",
+         "{seed}"
+         "three\tkept\twww.three.com\tl3\tp3\n"}}},
+    {"edit survives reopening", {
+        {"add old ol op work www.old.com\n"
+         "edit old new nl np home www.new.com\n"
+         "search old\n"
+         "category work\n",
+         "edited 1\n"},
+        {"list\n"
+         "category home\n",
+         "new\thome\twww.new.com\tnl\tnp\n"
+         "{seed}"
+         "new\thome\twww.new.com\tnl\tnp\n"}}},
+    {"contains finds an edited set", {
+        {"add aaaa al ap work www.a.com\n"
+         "add xyzq1 l1 p1 work www.1.com\n"
+         "add xyzq2 l2 p2 work www.2.com\n"
+         "add xyzw lw pw work www.w.com\n"
+         "contains xyzq\n"
+         "edit aaaa xyzq0 al ap work www.a.com\n"
+         "contains xyzq\n"
+         "edit xyzq0 aaaa al ap work www.a.com\n"
+         "contains xyzq\n",
+         "xyzq1\twork\twww.1.com\tl1\tp1\n"
+         "xyzq2\twork\twww.2.com\tl2\tp2\n"
+         "edited 1\n"
+         "xyzq0\twork\twww.a.com\tal\tap\n"
+         "xyzq1\twork\twww.1.com\tl1\tp1\n"
+         "xyzq2\twork\twww.2.com\tl2\tp2\n"
+         "edited 1\n"
+         "xyzq1\twork\twww.1.com\tl1\tp1\n"
+         "xyzq2\twork\twww.2.com\tl2\tp2\n"}}},
+    {"a shared name can't be edited", {
+        {"add twin l1 p1 work www.1.com\n"
+         "add twin l2 p2 work www.2.com\n"
+         "edit twin solo l3 p3 work www.3.com\n"
+         "search twin\n",
+         "error: line 3: several password sets are named twin\n"
+         "twin\twork\twww.1.com\tl1\tp1\n"
+         "twin\twork\twww.2.com\tl2\tp2\n"}}},
+    {"a tombstone only cancels older sets", {
+        {"add mail l1 first web www.mail.com\n"
+         "delete mail\n"
+         "add mail l2 second web www.mail.com\n",
+         "deleted 1\n"},
+        {"search mail\n",
+         "mail\tweb\twww.mail.com\tl2\tsecond\n"}}},
+    {"compaction keeps the live sets", {
+        {"add a1 l1 p1 work www.1.com\n"
+         "add a2 l2 p2 work www.2.com\n"
+         "add a3 l3 p3 work www.3.com\n"
+         "delete a1\n"
+         "delete a2\n"
+         "flush\n"
+         "delete a3\n"
+         "add a4 l4 p4 work www.4.com\n",
+         "deleted 1\n"
+         "deleted 1\n"
+         "deleted 1\n"},
+        {"delete seed\n"
+         "add a5 l5 p5 work www.5.com\n",
+         "deleted 1\n"},
+        {"list\n",
+         "a4\twork\twww.4.com\tl4\tp4\n"
+         "a5\twork\twww.5.com\tl5\tp5\n"}}},
+    {"malformed lines are reported", {
+        {"# a comment\n"
+         "\n"
+         "bogus\n"
+         "add x\n"
+         "edit missing a b c d e\n",
+         "error: line 3: unknown command bogus\n"
+         "error: line 4: add takes 5 arguments\n"
+         "edited 0\n"}}},
+};
+
+
+/// \brief Removes the test vault together with its journal, sidecar and any compacted copy.
+void removeTestVault() {
+    for (const std::string& file : {testVault, journal::fileOf(testVault), testVault + ".idx", testVault + ".compact"}) {
+        std::remove(file.c_str());
+    }
+}
+
+
+/**
+ * \brief Creates a fresh test vault holding only the seed password set.
+ *
+ * A binary vault gets a header with a small iteration count, so the cases don't wait for the key
+ * derivation. A text vault is written the way the menu writes one.
+ */
+bool createTestVault(VaultFormat format) {
+
+    removeTestVault();
+    if (format == VaultFormat::Text) {
+        PasswordData seed;
+        seed.name = PasswordManager::encryptData("seed");
+        seed.password = PasswordManager::encryptData("sp");
+        seed.category = PasswordManager::encryptData("misc");
+        seed.website = PasswordManager::encryptData("www.seed.com");
+        seed.login = PasswordManager::encryptData("sl");
+        std::ofstream file(testVault, std::ios::trunc);
+        file << seed.toString();
+        return file.good();
+    }
+
+    std::string key;
+    std::string header = encodeHeader(makeVaultHeader(mainPassword, 1000, key));
+    if (!replaceFile(testVault, [&header](int fd) { return writeAll(fd, header); })) {
+        return false;
+    }
+    PasswordManager manager(testVault, mainPassword, 1);
+    std::istringstream script("add seed sl sp misc www.seed.com\n");
+    std::ostringstream out;
+    return manager.isUnlocked() && manager.runBatch(script, out) == 0;
+}
+
+
+/// \brief Opens the test vault, runs a script on it and returns the output, or a note if it doesn't open.
+std::string runSession(const std::string& script) {
+    PasswordManager manager(testVault, mainPassword, 1);
+    if (!manager.isUnlocked()) {
+        return "(the vault does not open)\n";
+    }
+    std::istringstream in(script);
+    std::ostringstream out;
+    manager.runBatch(in, out);
+    return out.str();
+}
+
+
+/// \brief Reads a whole file, or returns an empty string if it can't be read.
+std::string readFile(const std::string& fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+
+/**
+ * \brief Runs all sessions of a case and prints the first output that differs from the expected one.
+ *
+ * \return True if every session printed what it should.
+ */
+bool runBatchCase(const BatchCase& test, VaultFormat format) {
+
+    if (!createTestVault(format)) {
+        std::printf("    can't create %s\n", testVault.c_str());
+        return false;
+    }
+    for (std::size_t i = 0; i < test.sessions.size(); i++) {
+        std::string expected = test.sessions[i].expected;
+        for (std::size_t at; (at = expected.find("{seed}")) != std::string::npos;) {
+            expected.replace(at, 6, seedLine);
+        }
+        std::string output = runSession(test.sessions[i].script);
+        if (output != expected) {
+            std::printf("    session %zu printed:\n%s    instead of:\n%s", i + 1, output.c_str(), expected.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * \brief Leaves the vault as a crash would, with its last append journaled but torn, and reopens it.
+ *
+ * The password set the append added must be back after the journal is replayed, and the journal must
+ * be gone.
+ */
+bool checkJournalRecovery(VaultFormat format) {
+
+    if (!createTestVault(format)) {
+        return false;
+    }
+    std::size_t before = readFile(testVault).size();
+    runSession("add torn tl tp work www.torn.com\n");
+    std::string vault = readFile(testVault);
+    if (vault.size() <= before) {
+        return false;
+    }
+
+    std::string group = vault.substr(before);
+    std::ofstream(journal::fileOf(testVault), std::ios::binary | std::ios::trunc) << journal::encode(before, group);
+    std::ofstream(testVault, std::ios::binary | std::ios::trunc) << vault.substr(0, before + group.size() / 2);
+
+    std::string expected = "torn\twork\twww.torn.com\ttl\ttp\n";
+    struct stat info{};
+    return runSession("search torn\n") == expected && runSession("search torn\n") == expected
+           && (::stat(journal::fileOf(testVault).c_str(), &info) != 0 || info.st_size == 0);
+}
+
+
+/**
+ * \brief Replaces the vault under an open session by one sealed under another key, which that session
+ * must not write to, and checks that its adds, edits and deletes fail without changing what it holds.
+ */
+bool checkFailedWrites(VaultFormat format) {
+
+    if (!createTestVault(format)) {
+        return false;
+    }
+    PasswordManager manager(testVault, mainPassword, 1);
+    manager.setFlushPolicy({FlushPolicy::Count, 1});
+
+    std::string key;
+    std::string header = encodeHeader(makeVaultHeader(mainPassword, 1000, key));
+    if (!replaceFile(testVault, [&header](int fd) { return writeAll(fd, header); })) {
+        return false;
+    }
+
+    std::istringstream script("add new nl np work www.new.com\n"
+                              "edit seed other ol op work www.other.com\n"
+                              "delete seed\n"
+                              "deletecategory misc\n"
+                              "list\n");
+    std::ostringstream out;
+    manager.runBatch(script, out);
+    std::string expected = "error: line 1: can't write the vault\n"
+                           "error: line 2: can't write the vault\n"
+                           "error: line 3: can't write the vault\n"
+                           "error: line 4: can't write the vault\n" + seedLine;
+    if (out.str() != expected) {
+        std::printf("    printed:\n%s    instead of:\n%s", out.str().c_str(), expected.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * \brief Checks that a vault whose header was patched at the given offset no longer opens, instead of
+ * being read under a KDF or a layout it doesn't have.
+ */
+bool checkHeaderRefused(std::size_t offset, std::string_view bytes) {
+
+    std::string key;
+    std::string header = encodeHeader(makeVaultHeader(mainPassword, 1000, key));
+    header.replace(offset, bytes.size(), bytes);
+    removeTestVault();
+    if (!replaceFile(testVault, [&header](int fd) { return writeAll(fd, header); })) {
+        return false;
+    }
+    PasswordManager manager(testVault, mainPassword, 1);
+    return !manager.isUnlocked();
+}
+
+
+/**
+ * \brief Imports a CSV file into a fresh vault and exports it again, which must give back the seed
+ * password set followed by the imported ones, in the same order.
+ */
+bool checkInterchangeRoundTrip(VaultFormat format) {
+
+    if (!createTestVault(format)) {
+        return false;
+    }
+    const std::string input = "name,category,website,login,password\n"
+                              "alpha,work,www.alpha.com,al,ap\n"
+                              "\"with,comma\",home,www.comma.com,cl,\"p\"\"q\"\n";
+    const std::string csvFile = testVault + ".csv";
+    std::ofstream(csvFile, std::ios::trunc) << input;
+
+    InterchangeOptions options;
+    InterchangeResult imported = importVault(testVault, csvFile, mainPassword, options);
+    InterchangeResult exported = exportVault(testVault, csvFile, mainPassword, options);
+    std::string output = readFile(csvFile);
+    std::remove(csvFile.c_str());
+
+    std::string expected = "name,category,website,login,password\n"
+                           "seed,misc,www.seed.com,sl,sp\n" + input.substr(input.find('\n') + 1);
+    if (!imported.ok || !exported.ok || imported.records != 2 || output != expected) {
+        std::printf("    exported:\n%s    instead of:\n%s", output.c_str(), expected.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+int main() {
+
+    int failures = 0;
+    auto check = [&failures](const std::string& name, bool passed) {
+        std::printf("%-48s %s\n", name.c_str(), passed ? "ok" : "FAILED");
+        failures += passed ? 0 : 1;
+    };
+
+    for (VaultFormat format : {VaultFormat::Text, VaultFormat::Binary}) {
+        std::string suffix = format == VaultFormat::Text ? " (text)" : " (binary)";
+        for (const BatchCase& test : batchCases) {
+            check(test.name + suffix, runBatchCase(test, format));
+        }
+        check("failed writes change nothing" + suffix, checkFailedWrites(format));
+        check("journal recovery" + suffix, checkJournalRecovery(format));
+        check("import/export round trip" + suffix, checkInterchangeRoundTrip(format));
+    }
+    check("a newer header version is refused", checkHeaderRefused(4, std::string("\x03\x00", 2)));
+    check("an unknown KDF is refused", checkHeaderRefused(9, "\x07"));
+    check("an iteration count of 0 is refused", checkHeaderRefused(12, std::string(4, '\0')));
+    check("an excessive iteration count is refused", checkHeaderRefused(12, "\xff\xff\xff\xff"));
+    removeTestVault();
+
+    std::printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}